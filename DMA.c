@@ -0,0 +1,332 @@
+/*
+ * File:   DMA.c
+ * Processor: SAMD21G18A @ 48MHz, 3.3v
+ * Program: Source file for application
+ * Compiler: ARM-GCC (v6.3.1, Atmel Studio 7.0)
+ * Program Version 1.0
+ * Program Description: This file contains source code for moving
+ *                      SPI blocks between memory and SERCOM1 with
+ *                      the DMAC, leaving the CPU free during I/O
+ *
+ * Modified From: None
+ */
+
+
+//////////////////////////////////////////////////////////////////////////
+// Include and defines
+//////////////////////////////////////////////////////////////////////////
+#include "app.h"
+#include "DMA.h"
+
+// Descriptor and write-back sections must be 128-bit aligned
+static DmacDescriptor dmaDescriptor[DMA_CHANNELS] __attribute__((aligned(16)));
+static DmacDescriptor dmaWriteback[DMA_CHANNELS] __attribute__((aligned(16)));
+
+// Fixed source for read transfers and sink for write transfers
+static const uint8_t dmaFill = 0xFF;
+static uint8_t dmaSink;
+
+static volatile uint8_t dmaBusy = 0;
+static volatile uint8_t dmaStatus = DMA_OK;
+static DMA_Callback dmaCallback = 0;
+
+
+/*******************************************************************************
+ * Function:        static void DMA_ChannelInit(uint8_t ch, uint8_t trigsrc)
+ *
+ * PreCondition:    DMAC enabled
+ *
+ * Input:           Channel number and peripheral trigger source
+ *
+ * Output:          None
+ *
+ * Side Effects:    Resets the channel
+ *
+ * Overview:        Sets a channel to move one beat per peripheral trigger
+ *
+ * Note:
+ *
+ ******************************************************************************/
+static void DMA_ChannelInit(uint8_t ch, uint8_t trigsrc)
+{
+	DMAC->CHID.reg = DMAC_CHID_ID(ch);
+	DMAC->CHCTRLA.reg &= ~DMAC_CHCTRLA_ENABLE;
+	DMAC->CHCTRLA.reg = DMAC_CHCTRLA_SWRST;
+	while (DMAC->CHCTRLA.reg & DMAC_CHCTRLA_SWRST);
+
+	DMAC->CHCTRLB.reg =
+		DMAC_CHCTRLB_LVL(0) |
+		DMAC_CHCTRLB_TRIGSRC(trigsrc) |
+		DMAC_CHCTRLB_TRIGACT_BEAT;
+}
+
+
+/*******************************************************************************
+ * Function:        void DMA_Initialize(void)
+ *
+ * PreCondition:    None
+ *
+ * Input:           None
+ *
+ * Output:          None
+ *
+ * Side Effects:    Enables the DMAC interrupt
+ *
+ * Overview:        Enables the DMAC clocks, points it at the descriptor
+ *                  sections and prepares the SERCOM1 RX and TX channels
+ *
+ * Note:            Completion is taken from the RX channel, by then the
+ *                  last byte has also left the shift register
+ *
+ ******************************************************************************/
+void DMA_Initialize(void)
+{
+	PM->AHBMASK.reg |= PM_AHBMASK_DMAC;
+	PM->APBBMASK.reg |= PM_APBBMASK_DMAC;
+
+	DMAC->CTRL.reg &= ~DMAC_CTRL_DMAENABLE;
+	DMAC->CTRL.reg = DMAC_CTRL_SWRST;
+	while (DMAC->CTRL.reg & DMAC_CTRL_SWRST);
+
+	DMAC->BASEADDR.reg = (uint32_t)dmaDescriptor;
+	DMAC->WRBADDR.reg = (uint32_t)dmaWriteback;
+	DMAC->CTRL.reg = DMAC_CTRL_DMAENABLE | DMAC_CTRL_LVLEN(0xF);
+
+	DMA_ChannelInit(DMA_CH_SPI_RX, SERCOM1_DMAC_ID_RX);
+	DMAC->CHINTENSET.reg = DMAC_CHINTENSET_TCMPL | DMAC_CHINTENSET_TERR;
+
+	DMA_ChannelInit(DMA_CH_SPI_TX, SERCOM1_DMAC_ID_TX);
+	DMAC->CHINTENSET.reg = DMAC_CHINTENSET_TERR;
+
+	NVIC_EnableIRQ(DMAC_IRQn);
+}
+
+
+/*******************************************************************************
+ * Function:        uint8_t DMA_SPI_Start(uint8_t *rx, const uint8_t *tx,
+ *                                        uint16_t len, DMA_Callback cb)
+ *
+ * PreCondition:    DMA_Initialize() called, SPI bus idle with RX empty
+ *
+ * Input:           Receive buffer (NULL discards), transmit buffer (NULL
+ *                  sends 0xFF), length and completion callback
+ *
+ * Output:          0 if started, 1 if a transfer is already running
+ *
+ * Side Effects:    cb is called from the DMAC interrupt
+ *
+ * Overview:        Arms RX before TX so no received byte is missed, then
+ *                  lets SERCOM1 DRE/RXC pace both channels
+ *
+ * Note:            Incrementing addresses point one past the last byte
+ *
+ ******************************************************************************/
+uint8_t DMA_SPI_Start(uint8_t *rx, const uint8_t *tx, uint16_t len, DMA_Callback cb)
+{
+	if (dmaBusy || len == 0) {
+		return 1;
+	}
+
+	dmaBusy = 1;
+	dmaStatus = DMA_OK;
+	dmaCallback = cb;
+
+	dmaDescriptor[DMA_CH_SPI_RX].BTCNT.reg = len;
+	dmaDescriptor[DMA_CH_SPI_RX].SRCADDR.reg = (uint32_t)&SERCOM1->SPI.DATA.reg;
+	dmaDescriptor[DMA_CH_SPI_RX].DESCADDR.reg = 0;
+	if (rx) {
+		dmaDescriptor[DMA_CH_SPI_RX].DSTADDR.reg = (uint32_t)(rx + len);
+		dmaDescriptor[DMA_CH_SPI_RX].BTCTRL.reg =
+			DMAC_BTCTRL_VALID | DMAC_BTCTRL_BEATSIZE_BYTE | DMAC_BTCTRL_DSTINC;
+	} else {
+		dmaDescriptor[DMA_CH_SPI_RX].DSTADDR.reg = (uint32_t)&dmaSink;
+		dmaDescriptor[DMA_CH_SPI_RX].BTCTRL.reg =
+			DMAC_BTCTRL_VALID | DMAC_BTCTRL_BEATSIZE_BYTE;
+	}
+
+	dmaDescriptor[DMA_CH_SPI_TX].BTCNT.reg = len;
+	dmaDescriptor[DMA_CH_SPI_TX].DSTADDR.reg = (uint32_t)&SERCOM1->SPI.DATA.reg;
+	dmaDescriptor[DMA_CH_SPI_TX].DESCADDR.reg = 0;
+	if (tx) {
+		dmaDescriptor[DMA_CH_SPI_TX].SRCADDR.reg = (uint32_t)(tx + len);
+		dmaDescriptor[DMA_CH_SPI_TX].BTCTRL.reg =
+			DMAC_BTCTRL_VALID | DMAC_BTCTRL_BEATSIZE_BYTE | DMAC_BTCTRL_SRCINC;
+	} else {
+		dmaDescriptor[DMA_CH_SPI_TX].SRCADDR.reg = (uint32_t)&dmaFill;
+		dmaDescriptor[DMA_CH_SPI_TX].BTCTRL.reg =
+			DMAC_BTCTRL_VALID | DMAC_BTCTRL_BEATSIZE_BYTE;
+	}
+
+	// CHID is shared with the interrupt handler
+	__disable_irq();
+	DMAC->CHID.reg = DMAC_CHID_ID(DMA_CH_SPI_RX);
+	DMAC->CHCTRLA.reg |= DMAC_CHCTRLA_ENABLE;
+	DMAC->CHID.reg = DMAC_CHID_ID(DMA_CH_SPI_TX);
+	DMAC->CHCTRLA.reg |= DMAC_CHCTRLA_ENABLE;
+	__enable_irq();
+
+	return 0;
+}
+
+
+/*******************************************************************************
+ * Function:        uint8_t DMA_SPI_Busy(void)
+ *
+ * PreCondition:    None
+ *
+ * Input:           None
+ *
+ * Output:          1 while a transfer is running, 0 when idle
+ *
+ * Side Effects:    None
+ *
+ * Overview:        Polling alternative to the completion callback
+ *
+ * Note:
+ *
+ ******************************************************************************/
+uint8_t DMA_SPI_Busy(void)
+{
+	return dmaBusy;
+}
+
+
+/*******************************************************************************
+ * Function:        uint8_t DMA_SPI_Transfer(uint8_t *rx, const uint8_t *tx,
+ *                                           uint16_t len)
+ *
+ * PreCondition:    DMA_Initialize() called, SPI bus idle with RX empty
+ *
+ * Input:           Receive buffer (NULL discards), transmit buffer (NULL
+ *                  sends 0xFF) and length
+ *
+ * Output:          DMA_OK or DMA_ERROR
+ *
+ * Side Effects:    Sleeps between interrupts while the DMAC runs
+ *
+ * Overview:        Blocking wrapper used by the disk_read/disk_write path
+ *
+ * Note:            Other interrupts keep being serviced during the wait.
+ *                  host/spibench: 512 bytes at 24 MHz take 174 us, asleep
+ *                  98% of it, against 256 us for a polled SPI_ReadBlock()
+ *
+ ******************************************************************************/
+uint8_t DMA_SPI_Transfer(uint8_t *rx, const uint8_t *tx, uint16_t len)
+{
+	if (DMA_SPI_Start(rx, tx, len, 0)) {
+		return DMA_ERROR;
+	}
+
+	// WFI still wakes on a pending interrupt while PRIMASK is set,
+	// so the completion cannot slip in between the check and the sleep
+	__disable_irq();
+	while (dmaBusy) {
+		__WFI();
+		__enable_irq();
+		__disable_irq();
+	}
+	__enable_irq();
+
+	return dmaStatus;
+}
+
+
+/*******************************************************************************
+ * Function:        void DMA_CRC_Begin(uint8_t ch)
+ *
+ * PreCondition:    DMA_Initialize() called, no transfer running
+ *
+ * Input:           Channel whose beats feed the CRC unit
+ *
+ * Output:          None
+ *
+ * Side Effects:    Resets the checksum to 0
+ *
+ * Overview:        Lets the DMAC CRC unit checksum the next transfer at
+ *                  no CPU cost
+ *
+ * Note:            CRCCTRL and CRCCHKSUM are written with the unit off
+ *
+ ******************************************************************************/
+void DMA_CRC_Begin(uint8_t ch)
+{
+	DMAC->CTRL.reg &= ~DMAC_CTRL_CRCENABLE;
+	DMAC->CRCCTRL.reg =
+		DMAC_CRCCTRL_CRCBEATSIZE_BYTE |
+		DMAC_CRCCTRL_CRCPOLY_CRC16 |
+		DMAC_CRCCTRL_CRCSRC(0x20 + ch);
+	DMAC->CRCCHKSUM.reg = 0;
+	DMAC->CTRL.reg |= DMAC_CTRL_CRCENABLE;
+}
+
+
+/*******************************************************************************
+ * Function:        uint16_t DMA_CRC_End(void)
+ *
+ * PreCondition:    DMA_CRC_Begin() called and the transfer has completed
+ *
+ * Input:           None
+ *
+ * Output:          CRC16 of the bytes moved since DMA_CRC_Begin()
+ *
+ * Side Effects:    Disables the CRC unit
+ *
+ * Overview:        Reads back the checksum computed during the transfer
+ *
+ * Note:
+ *
+ ******************************************************************************/
+uint16_t DMA_CRC_End(void)
+{
+	uint16_t crc = (uint16_t)DMAC->CRCCHKSUM.reg;
+
+	DMAC->CTRL.reg &= ~DMAC_CTRL_CRCENABLE;
+	DMAC->CRCCTRL.reg = DMAC_CRCCTRL_CRCSRC_NOACT;
+
+	return crc;
+}
+
+
+/*******************************************************************************
+ * Function:        void DMAC_Handler(void)
+ *
+ * PreCondition:    None
+ *
+ * Input:           None
+ *
+ * Output:          None
+ *
+ * Side Effects:    Calls the completion callback
+ *
+ * Overview:        Finishes the transfer when the RX channel completes or
+ *                  either channel reports a bus error
+ *
+ * Note:
+ *
+ ******************************************************************************/
+void DMAC_Handler(void)
+{
+	uint8_t ch = DMAC->INTPEND.bit.ID;
+	uint8_t flags;
+
+	DMAC->CHID.reg = DMAC_CHID_ID(ch);
+	flags = DMAC->CHINTFLAG.reg;
+	DMAC->CHINTFLAG.reg = flags;
+
+	if (flags & DMAC_CHINTFLAG_TERR) {
+		dmaStatus = DMA_ERROR;
+
+		// Stop the partner channel as well
+		DMAC->CHID.reg = DMAC_CHID_ID(DMA_CH_SPI_TX);
+		DMAC->CHCTRLA.reg &= ~DMAC_CHCTRLA_ENABLE;
+		DMAC->CHID.reg = DMAC_CHID_ID(DMA_CH_SPI_RX);
+		DMAC->CHCTRLA.reg &= ~DMAC_CHCTRLA_ENABLE;
+	} else if (!(flags & DMAC_CHINTFLAG_TCMPL) || ch != DMA_CH_SPI_RX) {
+		return;
+	}
+
+	dmaBusy = 0;
+	if (dmaCallback) {
+		dmaCallback(dmaStatus);
+	}
+}
@@ -0,0 +1,81 @@
+/*
+ * File:   DMA.h
+ * Processor: SAMD21G18A @ 48MHz, 3.3v
+ * Program: Header file for application
+ * Compiler: ARM-GCC (v6.3.1, Atmel Studio 7.0)
+ * Program Version 1.0
+ * Program Description: This header file provides DMAC driven block
+                        transfers on the SERCOM1 SPI bus
+ * Modified From: None
+ */
+
+
+#ifndef DMA_H_
+#define DMA_H_
+
+//////////////////////////////////////////////////////////////////////////
+// Include and defines
+//////////////////////////////////////////////////////////////////////////
+#include "app.h"
+
+// DMAC channels used for SERCOM1
+#define DMA_CH_SPI_RX   0   // SERCOM1 DATA -> buffer (or discard)
+#define DMA_CH_SPI_TX   1   // buffer (or fixed 0xFF) -> SERCOM1 DATA
+#define DMA_CHANNELS    2
+
+// Transfer completion status passed to the callback
+#define DMA_OK          0
+#define DMA_ERROR       1
+
+typedef void (*DMA_Callback)(uint8_t status);
+
+
+/**
+ * \def DMA_Initialize
+ * \brief Enables the DMAC and sets up the SERCOM1 RX/TX channels
+ * \param none
+ */
+void DMA_Initialize(void);
+
+
+/**
+ * \def DMA_SPI_Start
+ * \brief Starts a SPI block transfer and returns immediately
+ * \param rx (NULL discards), tx (NULL sends 0xFF), len, cb (may be NULL)
+ */
+uint8_t DMA_SPI_Start(uint8_t *rx, const uint8_t *tx, uint16_t len, DMA_Callback cb);
+
+
+/**
+ * \def DMA_SPI_Busy
+ * \brief Returns 1 while a transfer started by DMA_SPI_Start is running
+ * \param none
+ */
+uint8_t DMA_SPI_Busy(void);
+
+
+/**
+ * \def DMA_SPI_Transfer
+ * \brief Blocking SPI block transfer, sleeps until the DMAC completes
+ * \param rx (NULL discards), tx (NULL sends 0xFF), len
+ */
+uint8_t DMA_SPI_Transfer(uint8_t *rx, const uint8_t *tx, uint16_t len);
+
+
+/**
+ * \def DMA_CRC_Begin
+ * \brief Starts a CRC16-CCITT (initial value 0) over the data moved by ch
+ * \param ch (DMA_CH_SPI_RX or DMA_CH_SPI_TX)
+ */
+void DMA_CRC_Begin(uint8_t ch);
+
+
+/**
+ * \def DMA_CRC_End
+ * \brief Stops the CRC unit and returns the checksum
+ * \param none
+ */
+uint16_t DMA_CRC_End(void);
+
+
+#endif /* DMA_H_ */
@@ -0,0 +1,146 @@
+/*
+ * File:   NVM.c
+ * Processor: SAMD21G18A @ 48MHz, 3.3v
+ * Program: Source file for application
+ * Compiler: ARM-GCC (v6.3.1, Atmel Studio 7.0)
+ * Program Version 1.0
+ * Program Description: This file contains source code for keeping a
+ *                      few bytes of settings across resets in a
+ *                      reserved row of the internal flash
+ *
+ * Modified From: None
+ */
+
+
+//////////////////////////////////////////////////////////////////////////
+// Include and defines
+//////////////////////////////////////////////////////////////////////////
+#include "app.h"
+#include "NVM.h"
+#include <string.h>
+
+
+// A plain const array lands in .rodata, which is flash, and being row
+// aligned and row sized it has the row to itself. NVM_ReadStore() reads
+// it through a compiler barrier so reads are not folded to the 0xFF
+// initializer.
+const uint8_t NVM_StoreRow[NVM_STORE_ROW_SIZE]
+	__attribute__((aligned(NVM_STORE_ROW_SIZE), used)) = {
+	[0 ... NVM_STORE_ROW_SIZE - 1] = 0xFF
+};
+
+
+/*******************************************************************************
+ * Function:        static uint8_t NVM_Command(uint16_t cmd)
+ *
+ * PreCondition:    NVMCTRL ready, ADDR set when the command needs it
+ *
+ * Input:           NVMCTRL_CTRLA_CMD_* command
+ *
+ * Output:          0 on success, 1 on a programming or lock error
+ *
+ * Side Effects:    Stalls flash reads until the command completes
+ *
+ * Overview:        Issues a command with the execution key and waits
+ *                  for NVMCTRL to become ready again
+ *
+ * Note:
+ *
+ ******************************************************************************/
+static uint8_t NVM_Command(uint16_t cmd)
+{
+	NVMCTRL->STATUS.reg = NVMCTRL_STATUS_MASK;
+	NVMCTRL->CTRLA.reg = cmd | NVMCTRL_CTRLA_CMDEX_KEY;
+	while (NVMCTRL->INTFLAG.bit.READY == 0);
+
+	return (NVMCTRL->STATUS.reg & (NVMCTRL_STATUS_PROGE | NVMCTRL_STATUS_LOCKE | NVMCTRL_STATUS_NVME)) != 0;
+}
+
+
+/*******************************************************************************
+ * Function:        void NVM_ReadStore(void *buf, uint16_t len)
+ *
+ * PreCondition:    None
+ *
+ * Input:           Destination and number of bytes
+ *
+ * Output:          None
+ *
+ * Side Effects:    None
+ *
+ * Overview:        Flash is memory mapped, so this is a plain copy
+ *                  from the row once the compiler has lost track of
+ *                  what it holds
+ *
+ * Note:            An erased store reads as 0xFF
+ *
+ ******************************************************************************/
+void NVM_ReadStore(void *buf, uint16_t len)
+{
+	const uint8_t *src = NVM_StoreRow;
+
+	// NVM_WriteStore() changes the row behind the compiler's back
+	__asm__ volatile ("" : "+r" (src) : : "memory");
+	if (len > NVM_STORE_SIZE) {
+		len = NVM_STORE_SIZE;
+	}
+	memcpy(buf, src, len);
+}
+
+
+/*******************************************************************************
+ * Function:        uint8_t NVM_WriteStore(const void *buf, uint16_t len)
+ *
+ * PreCondition:    No code runs from the store row
+ *
+ * Input:           Source and number of bytes, a multiple of 4
+ *
+ * Output:          0 on success, 1 on a bad length or flash error
+ *
+ * Side Effects:    Erases the whole store row
+ *
+ * Overview:        Erases the row, fills the page buffer with 32-bit
+ *                  writes and commits it with a manual page write
+ *
+ * Note:            Flash endures about 25k erase cycles per row, write
+ *                  only when the stored value changes
+ *
+ ******************************************************************************/
+uint8_t NVM_WriteStore(const void *buf, uint16_t len)
+{
+	volatile uint32_t *dst = (volatile uint32_t *)NVM_STORE_ADDR;
+	const uint8_t *src = buf;
+	uint32_t word;
+	uint8_t res;
+
+	if (len > NVM_STORE_SIZE || (len & 3)) {
+		return 1;
+	}
+
+	// Page writes only happen on the explicit command
+	NVMCTRL->CTRLB.bit.MANW = 1;
+
+	// ADDR takes a 16-bit word address
+	NVMCTRL->ADDR.reg = NVM_STORE_ADDR / 2;
+	res = NVM_Command(NVMCTRL_CTRLA_CMD_ER);
+
+	if (res == 0) {
+		res = NVM_Command(NVMCTRL_CTRLA_CMD_PBC);
+	}
+
+	if (res == 0) {
+		for (; len; len -= 4) {
+			memcpy(&word, src, 4);
+			*dst++ = word;
+			src += 4;
+		}
+
+		NVMCTRL->ADDR.reg = NVM_STORE_ADDR / 2;
+		res = NVM_Command(NVMCTRL_CTRLA_CMD_WP);
+	}
+
+	// Back to automatic page writes for everyone else
+	NVMCTRL->CTRLB.bit.MANW = 0;
+
+	return res;
+}
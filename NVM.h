@@ -0,0 +1,48 @@
+/*
+ * File:   NVM.h
+ * Processor: SAMD21G18A @ 48MHz, 3.3v
+ * Program: Header file for application
+ * Compiler: ARM-GCC (v6.3.1, Atmel Studio 7.0)
+ * Program Version 1.0
+ * Program Description: This header file provides a small settings
+                        store in a reserved row of the internal flash
+ * Modified From: None
+ */
+
+
+#ifndef NVM_H_
+#define NVM_H_
+
+//////////////////////////////////////////////////////////////////////////
+// Include and defines
+//////////////////////////////////////////////////////////////////////////
+#include "app.h"
+
+// The store is the first page of a flash row that NVM.c reserves as a
+// row aligned, row sized const array, so the linker keeps everything
+// else out of the row that NVM_WriteStore() erases
+#define NVM_STORE_ROW_SIZE  (FLASH_PAGE_SIZE * NVMCTRL_ROW_PAGES)
+#define NVM_STORE_ADDR      ((uint32_t)NVM_StoreRow)
+#define NVM_STORE_SIZE      FLASH_PAGE_SIZE
+
+// Backing row of the store, erased (0xFF) in a freshly programmed image
+extern const uint8_t NVM_StoreRow[NVM_STORE_ROW_SIZE];
+
+
+/**
+ * \def NVM_ReadStore
+ * \brief Copies len bytes from the start of the settings store
+ * \param buf, len (at most NVM_STORE_SIZE)
+ */
+void NVM_ReadStore(void *buf, uint16_t len);
+
+
+/**
+ * \def NVM_WriteStore
+ * \brief Erases the store row and programs len bytes, 0 on success
+ * \param buf, len (at most NVM_STORE_SIZE, multiple of 4)
+ */
+uint8_t NVM_WriteStore(const void *buf, uint16_t len);
+
+
+#endif /* NVM_H_ */
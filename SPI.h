@@ -27,10 +27,31 @@
 //////////////////////////////////////////////////////////////////////////
 #include "app.h"
 
+// SCK = GCLK0 / (2 * (BAUD + 1))
+#define SPI_GCLK_HZ         48000000UL
+#define SPI_SLOW_HZ         400000UL
+#define SPI_FAST_HZ         12000000UL
+#define SPI_BAUD(hz)        (SPI_GCLK_HZ / (2UL * (hz)) - 1)
+#define SPI_BAUD_HZ(baud)   (SPI_GCLK_HZ / (2UL * ((baud) + 1)))
+
+// Rate profile of one device sharing SERCOM1
+typedef struct {
+    uint32_t csPin;     // PORT group 0 mask of the chip select line
+    uint8_t  baud;      // BAUD value the bus runs at while the device is selected
+} SPI_Device;
+
+
+/**
+ * \def SPI_Bus_Init
+ * \brief One-time SERCOM1 clock, pin and mode setup, later calls return at once
+ * \param none
+ */
+void SPI_Bus_Init(void);
+
 
 /**
  * \def SPI_Initialize_Slow
- * \brief Initializes the SPI module in Slow Mode 400 kHz Baud
+ * \brief Sets the SPI bus up if needed and switches it to 400 kHz
  * \param none 
  */
 void SPI_Initialize_Slow(void);
@@ -38,7 +59,7 @@ void SPI_Initialize_Slow(void);
 
 /**
  * \def SPI_Initialize_Fast
- * \brief Initializes the SPI module in Fast Mode 12 MHz Baud (Att.)
+ * \brief Sets the SPI bus up if needed and switches it to 12 MHz
  * \param none 
  */
 void SPI_Initialize_Fast(void);
@@ -69,4 +90,116 @@ uint8_t SPI_SD_Send_Byte(uint8_t byte_val);
 uint8_t SPI_SD_Read_Byte(void);
 
 
+/**
+ * \def SPI_ReadBlock
+ * \brief Reads len bytes, clocking 0xFF back-to-back
+ * \param buf, len
+ */
+void SPI_ReadBlock(uint8_t *buf, uint16_t len);
+
+
+/**
+ * \def SPI_WriteBlock
+ * \brief Writes len bytes back-to-back, discarding received data
+ * \param buf, len
+ */
+void SPI_WriteBlock(const uint8_t *buf, uint16_t len);
+
+
+/**
+ * \def SPI_FillBlock
+ * \brief Clocks out the same byte len times, discarding received data
+ * \param data, len
+ */
+void SPI_FillBlock(uint8_t data, uint16_t len);
+
+
+/**
+ * \def SPI_SetBaud
+ * \brief Changes the SCK rate of the running bus, SCK = 48 MHz / (2 * (baud + 1))
+ * \param baud
+ */
+void SPI_SetBaud(uint8_t baud);
+
+
+/**
+ * \def SPI_GetBaud
+ * \brief Returns the current BAUD register value
+ * \param none
+ */
+uint8_t SPI_GetBaud(void);
+
+
+/**
+ * \def SPI_RateToBaud
+ * \brief Returns the BAUD value for the fastest SCK not above hz
+ * \param hz
+ */
+uint8_t SPI_RateToBaud(uint32_t hz);
+
+
+/**
+ * \def SPI_SetRate
+ * \brief Changes the SCK rate to the fastest one not above hz
+ * \param hz
+ */
+void SPI_SetRate(uint32_t hz);
+
+
+/**
+ * \def SPI_DeviceInit
+ * \brief Makes a device's chip select an output, deselected
+ * \param dev
+ */
+void SPI_DeviceInit(const SPI_Device *dev);
+
+
+/**
+ * \def SPI_Select
+ * \brief Switches the bus to the device's rate and asserts its chip select
+ * \param dev
+ */
+void SPI_Select(const SPI_Device *dev);
+
+
+/**
+ * \def SPI_Deselect
+ * \brief Releases the device's chip select
+ * \param dev
+ */
+void SPI_Deselect(const SPI_Device *dev);
+
+
+/**
+ * \def SPI_MISO_WakeInit
+ * \brief Sets up EXTINT3 on PA19 (MISO) as a high level wake source
+ * \param none
+ */
+void SPI_MISO_WakeInit(void);
+
+
+/**
+ * \def SPI_MISO_WakeArm
+ * \brief Moves PA19 to the EIC and enables the wake interrupt
+ * \param none
+ */
+void SPI_MISO_WakeArm(void);
+
+
+/**
+ * \def SPI_MISO_WakeRelease
+ * \brief Disables the wake interrupt and moves PA19 back to SERCOM1
+ * \param none
+ */
+void SPI_MISO_WakeRelease(void);
+
+
+/**
+ * \def SPI_MISO_WakeFired
+ * \brief Returns 1 once MISO has gone high since SPI_MISO_WakeArm()
+ * \param none
+ */
+uint8_t SPI_MISO_WakeFired(void);
+
+
 #endif /* SPI_H_ */
\ No newline at end of file
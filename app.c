@@ -77,6 +77,9 @@ void AppInit(void)
 	*/
 	ClocksInit();
 	
+	// 1 ms time base for driver timeouts
+	SysTickInit();
+	
 	// Assign SS as OUTPUT
 	REG_PORT_DIR0 = PORT_PA08;
 	
@@ -219,5 +222,6 @@ void AppRun(void)
 	
 	while (1) {
 		// Infinite loop to keep the application running
+		SDCard_Service();
 	}
 } // AppRun()
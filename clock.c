@@ -26,6 +26,9 @@
 //////////////////////////////////////////////////////////////////////////
 #include "clock.h"
 
+// Milliseconds since SysTickInit(), advanced by SysTick_Handler
+static volatile uint32_t msTicks = 0;
+
 /*******************************************************************************
  * Function:        void ClocksInit(void)
  *
@@ -271,4 +274,54 @@ void ClocksInit(void)
 	PM->APBBSEL.reg = PM_APBBSEL_APBBDIV_DIV1_Val ;
 	PM->APBCSEL.reg = PM_APBCSEL_APBCDIV_DIV1_Val ;
 	
-} // ClockSysInit48M()
\ No newline at end of file
+} // ClockSysInit48M()
+
+
+/*******************************************************************************
+ * Function:        void SysTickInit(void)
+ *
+ * PreCondition:    ClocksInit() has switched the CPU to 48 MHz
+ *
+ * Input:           None
+ *
+ * Output:          None
+ *
+ * Side Effects:    SysTick interrupt fires every millisecond
+ *
+ * Overview:        Starts a 1 ms time base used for driver timeouts
+ *
+ * Notes:
+ *
+ ******************************************************************************/
+void SysTickInit(void)
+{
+	SysTick_Config(MAIN_CLK_FREQ / 1000);
+} // SysTickInit()
+
+
+/*******************************************************************************
+ * Function:        uint32_t SysTick_Millis(void)
+ *
+ * PreCondition:    SysTickInit() has been called
+ *
+ * Input:           None
+ *
+ * Output:          Milliseconds elapsed since SysTickInit(), wraps at 2^32
+ *
+ * Side Effects:    None
+ *
+ * Overview:        Returns the current millisecond tick count
+ *
+ * Notes:           Compare ticks by subtraction so wrap-around is harmless
+ *
+ ******************************************************************************/
+uint32_t SysTick_Millis(void)
+{
+	return msTicks;
+} // SysTick_Millis()
+
+
+void SysTick_Handler(void)
+{
+	msTicks++;
+} // SysTick_Handler()
@@ -30,5 +30,11 @@
 //////////////////////////////////////////////////////////////////////////
 void ClocksInit(void);
 
+// Start the 1 ms SysTick time base
+void SysTickInit(void);
+
+// Milliseconds since SysTickInit()
+uint32_t SysTick_Millis(void);
+
 
 #endif /* CLOCK_H_ */
\ No newline at end of file
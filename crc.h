@@ -0,0 +1,39 @@
+/*
+ * File:   crc.h
+ * Processor: SAMD21G18A @ 48MHz, 3.3v
+ * Program: Header file for application
+ * Compiler: ARM-GCC (v6.3.1, Atmel Studio 7.0)
+ * Program Version 1.0
+ * Program Description: This header file provides the CRC7 and CRC16
+                        checksums used by the SD card protocol
+ * Modified From: None
+ */
+
+
+#ifndef CRC_H_
+#define CRC_H_
+
+//////////////////////////////////////////////////////////////////////////
+// Include and defines
+//////////////////////////////////////////////////////////////////////////
+#include <stdint.h>
+
+
+/**
+ * \def CRC7_Calc
+ * \brief CRC7 (x^7 + x^3 + 1) of a command frame, returned in bits 7..1
+ *        so the end bit can be ORed in directly
+ * \param buf, len
+ */
+uint8_t CRC7_Calc(const uint8_t *buf, uint16_t len);
+
+
+/**
+ * \def CRC16_Calc
+ * \brief CRC16-CCITT (x^16 + x^12 + x^5 + 1, initial value 0) of a data block
+ * \param buf, len
+ */
+uint16_t CRC16_Calc(const uint8_t *buf, uint16_t len);
+
+
+#endif /* CRC_H_ */
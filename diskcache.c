@@ -0,0 +1,268 @@
+/*-----------------------------------------------------------------------*/
+/* Write-back LRU sector cache between FatFs and the disk drivers        */
+/*-----------------------------------------------------------------------*/
+/* FatFs keeps only one win[] per volume and one buf[] per file, so FAT, */
+/* directory and data accesses keep evicting each other and re-reading   */
+/* the same sectors. Single sector requests are served from here, dirty  */
+/* sectors are held until they are evicted or CTRL_SYNC flushes them.    */
+/* Multi sector requests bypass the cache but are kept coherent with it. */
+/*-----------------------------------------------------------------------*/
+
+#include "diskcache.h"
+#include "diskqueue.h"
+#include "diskprefetch.h"
+#include <string.h>
+
+
+/* Next stage down: the write queue, the read-ahead buffer or the media */
+#if DISK_USE_QUEUE
+#define lower_read		disk_queue_read
+#define lower_write		disk_queue_write
+#elif DISK_USE_PREFETCH
+#define lower_read		disk_prefetch_read
+#define lower_write		disk_prefetch_write
+#else
+#define lower_read		disk_media_read
+#define lower_write		disk_media_write
+#endif
+
+
+#define DC_VALID	0x01	/* Entry holds a sector */
+#define DC_DIRTY	0x02	/* Entry is newer than the media */
+
+typedef struct {
+	BYTE	flags;			/* DC_VALID | DC_DIRTY */
+	BYTE	drv;			/* Physical drive number */
+	DWORD	sector;			/* Sector address in LBA */
+	DWORD	stamp;			/* Last use, larger is more recent */
+	BYTE	buf[512];		/* Sector data */
+} DCENTRY;
+
+static DCENTRY Cache[DISK_CACHE_ENTRIES];
+static DWORD Stamp;
+static DCSTATS Stats;
+
+/* Pinned sector range per drive (the first FAT), none while count is 0 */
+static DWORD PinStart[DISK_CACHE_DRIVES];
+static DWORD PinCount[DISK_CACHE_DRIVES];
+
+
+
+/*-----------------------------------------------------------------------*/
+/* Entry helpers                                                         */
+/*-----------------------------------------------------------------------*/
+
+static int is_pinned (const DCENTRY* e)
+{
+	return e->drv < DISK_CACHE_DRIVES
+		&& e->sector - PinStart[e->drv] < PinCount[e->drv];
+}
+
+
+static DCENTRY* find_entry (BYTE pdrv, DWORD sector)
+{
+	UINT i;
+
+	for (i = 0; i < DISK_CACHE_ENTRIES; i++) {
+		if ((Cache[i].flags & DC_VALID) && Cache[i].drv == pdrv && Cache[i].sector == sector)
+			return &Cache[i];
+	}
+	return 0;
+}
+
+
+static DRESULT write_back (DCENTRY* e)
+{
+	DRESULT res;
+
+	res = lower_write(e->drv, e->buf, e->sector, 1);
+	if (res == RES_OK) {
+		e->flags &= ~DC_DIRTY;
+		Stats.writebacks++;
+	}
+	return res;
+}
+
+
+/* Pick a free entry, else the least recently used one. Pinned sectors   */
+/* only age out while they hold more than DISK_CACHE_PINNED entries.     */
+static DCENTRY* alloc_entry (void)
+{
+	DCENTRY *victim = 0;
+	UINT i, npinned = 0;
+
+	for (i = 0; i < DISK_CACHE_ENTRIES; i++) {
+		if (!(Cache[i].flags & DC_VALID)) return &Cache[i];
+		if (is_pinned(&Cache[i])) npinned++;
+	}
+	for (i = 0; i < DISK_CACHE_ENTRIES; i++) {
+		if (is_pinned(&Cache[i]) && npinned < DISK_CACHE_PINNED) continue;
+		if (!victim || Cache[i].stamp < victim->stamp) victim = &Cache[i];
+	}
+
+	if ((victim->flags & DC_DIRTY) && write_back(victim) != RES_OK) return 0;
+	victim->flags = 0;
+	return victim;
+}
+
+
+
+/*-----------------------------------------------------------------------*/
+/* Read Sector(s) through the cache                                      */
+/*-----------------------------------------------------------------------*/
+
+DRESULT disk_cache_read (BYTE pdrv, BYTE* buff, DWORD sector, UINT count)
+{
+	DCENTRY *e;
+	DRESULT res;
+	UINT i;
+
+	if (count == 1) {
+		e = find_entry(pdrv, sector);
+		if (e) {
+			Stats.hits++;
+		} else {
+			Stats.misses++;
+			e = alloc_entry();
+			if (!e) return RES_ERROR;
+			res = lower_read(pdrv, e->buf, sector, 1);
+			if (res != RES_OK) return res;
+			e->flags = DC_VALID;
+			e->drv = pdrv;
+			e->sector = sector;
+		}
+		e->stamp = ++Stamp;
+		memcpy(buff, e->buf, 512);
+		return RES_OK;
+	}
+
+	/* Bulk read straight from the media, then lay any dirty sectors over it */
+	res = lower_read(pdrv, buff, sector, count);
+	if (res != RES_OK) return res;
+	for (i = 0; i < DISK_CACHE_ENTRIES; i++) {
+		e = &Cache[i];
+		if ((e->flags & DC_DIRTY) && e->drv == pdrv && e->sector - sector < count)
+			memcpy(buff + (e->sector - sector) * 512, e->buf, 512);
+	}
+	return RES_OK;
+}
+
+
+
+/*-----------------------------------------------------------------------*/
+/* Write Sector(s) through the cache                                     */
+/*-----------------------------------------------------------------------*/
+
+DRESULT disk_cache_write (BYTE pdrv, const BYTE* buff, DWORD sector, UINT count)
+{
+	DCENTRY *e;
+	DRESULT res;
+	UINT i;
+
+	if (count == 1) {
+		e = find_entry(pdrv, sector);
+		if (!e) {
+			e = alloc_entry();
+			if (!e) return RES_ERROR;
+			e->drv = pdrv;
+			e->sector = sector;
+		}
+		memcpy(e->buf, buff, 512);
+		e->flags = DC_VALID | DC_DIRTY;
+		e->stamp = ++Stamp;
+		return RES_OK;
+	}
+
+	/* Bulk write straight to the media, then refresh cached copies */
+	res = lower_write(pdrv, buff, sector, count);
+	if (res != RES_OK) return res;
+	for (i = 0; i < DISK_CACHE_ENTRIES; i++) {
+		e = &Cache[i];
+		if ((e->flags & DC_VALID) && e->drv == pdrv && e->sector - sector < count) {
+			memcpy(e->buf, buff + (e->sector - sector) * 512, 512);
+			e->flags = DC_VALID;
+		}
+	}
+	return RES_OK;
+}
+
+
+
+/*-----------------------------------------------------------------------*/
+/* Write all dirty sectors of a drive in ascending order                 */
+/*-----------------------------------------------------------------------*/
+/* Ascending order lets runs of adjacent sectors continue one open       */
+/* multiple block write on the media.                                    */
+
+DRESULT disk_cache_flush (BYTE pdrv)
+{
+	DCENTRY *e;
+	UINT i;
+
+	for (;;) {
+		e = 0;
+		for (i = 0; i < DISK_CACHE_ENTRIES; i++) {
+			if ((Cache[i].flags & DC_DIRTY) && Cache[i].drv == pdrv
+				&& (!e || Cache[i].sector < e->sector))
+				e = &Cache[i];
+		}
+		if (!e) return RES_OK;
+		if (write_back(e) != RES_OK) return RES_ERROR;
+	}
+}
+
+
+
+/*-----------------------------------------------------------------------*/
+/* Drop every entry of a drive without writing it back                   */
+/*-----------------------------------------------------------------------*/
+
+void disk_cache_invalidate (BYTE pdrv)
+{
+	UINT i;
+
+	for (i = 0; i < DISK_CACHE_ENTRIES; i++) {
+		if (Cache[i].drv == pdrv) Cache[i].flags = 0;
+	}
+	if (pdrv < DISK_CACHE_DRIVES) PinCount[pdrv] = 0;
+}
+
+
+
+/*-----------------------------------------------------------------------*/
+/* Drop the entries of a freed sector range (inclusive), dirty or not    */
+/*-----------------------------------------------------------------------*/
+
+void disk_cache_trim (BYTE pdrv, DWORD start, DWORD end)
+{
+	UINT i;
+
+	for (i = 0; i < DISK_CACHE_ENTRIES; i++) {
+		if (Cache[i].drv == pdrv && Cache[i].sector - start <= end - start) Cache[i].flags = 0;
+	}
+}
+
+
+
+/*-----------------------------------------------------------------------*/
+/* Pin a sector range (inclusive) so it stays resident                   */
+/*-----------------------------------------------------------------------*/
+
+void disk_cache_pin (BYTE pdrv, DWORD start, DWORD end)
+{
+	if (pdrv < DISK_CACHE_DRIVES && end >= start) {
+		PinStart[pdrv] = start;
+		PinCount[pdrv] = end - start + 1;
+	}
+}
+
+
+
+/*-----------------------------------------------------------------------*/
+/* Cache counters                                                        */
+/*-----------------------------------------------------------------------*/
+
+const DCSTATS* disk_cache_stats (void)
+{
+	return &Stats;
+}
@@ -0,0 +1,51 @@
+/*-----------------------------------------------------------------------/
+/  Sector cache between FatFs and the disk drivers                       /
+/-----------------------------------------------------------------------*/
+
+#ifndef _DISKCACHE_DEFINED
+#define _DISKCACHE_DEFINED
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "integer.h"
+#include "diskio.h"
+
+#define DISK_USE_CACHE		1	/* 1: Put the sector cache under disk_read/disk_write */
+#define DISK_CACHE_ENTRIES	8	/* Number of 512 byte sectors held in RAM */
+#define DISK_CACHE_PINNED	(DISK_CACHE_ENTRIES / 2)	/* Entries pinned sectors may hold before they age out */
+#define DISK_CACHE_DRIVES	3	/* Number of physical drives tracked */
+
+
+/* Cache counters */
+typedef struct {
+	DWORD	hits;		/* Single sector reads served from RAM */
+	DWORD	misses;		/* Single sector reads that went to the media */
+	DWORD	writebacks;	/* Dirty sectors written to the media */
+} DCSTATS;
+
+
+/*---------------------------------------*/
+/* Prototypes for the sector cache       */
+
+DRESULT disk_cache_read (BYTE pdrv, BYTE* buff, DWORD sector, UINT count);
+DRESULT disk_cache_write (BYTE pdrv, const BYTE* buff, DWORD sector, UINT count);
+DRESULT disk_cache_flush (BYTE pdrv);
+void disk_cache_invalidate (BYTE pdrv);
+void disk_cache_trim (BYTE pdrv, DWORD start, DWORD end);
+void disk_cache_pin (BYTE pdrv, DWORD start, DWORD end);
+const DCSTATS* disk_cache_stats (void);
+
+
+/*---------------------------------------*/
+/* Media access provided by diskio.c     */
+
+DRESULT disk_media_read (BYTE pdrv, BYTE* buff, DWORD sector, UINT count);
+DRESULT disk_media_write (BYTE pdrv, const BYTE* buff, DWORD sector, UINT count);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
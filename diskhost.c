@@ -0,0 +1,382 @@
+/*-----------------------------------------------------------------------*/
+/* Disk image backend for host builds                                    */
+/*-----------------------------------------------------------------------*/
+/* Stands in for diskio.c when DISK_HOST is defined, so ff.c and the     */
+/* sector cache, write queue and read-ahead run on Linux against a FAT   */
+/* image file. The media is either the file itself (pread/pwrite) or a   */
+/* shared mapping of it. A latency model can be injected per request and */
+/* every request can be counted per sector or traced for replay.         */
+/*-----------------------------------------------------------------------*/
+
+#ifdef DISK_HOST
+
+#include "diskhost.h"
+#include "diskcache.h"
+#include "diskqueue.h"
+#include "diskprefetch.h"
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+
+typedef struct {
+	int			fd;			/* Image file, -1 if none is attached */
+	BYTE*		map;		/* Shared mapping in DISK_HOST_MMAP mode, else 0 */
+	DWORD		sectors;	/* Image size in sectors */
+	DSTATUS		stat;
+	DWORD		next;		/* Sector following the last request */
+	DHLATENCY	lat;
+	DHSTATS		stats;
+	DWORD*		rcount;		/* Per sector read counts, 0 while off */
+	DWORD*		wcount;		/* Per sector write counts, 0 while off */
+	FILE*		trace;		/* Request trace, 0 while off */
+} DHDRIVE;
+
+static DHDRIVE Drive[DISK_HOST_DRIVES] = {
+	[0 ... DISK_HOST_DRIVES - 1] = { .fd = -1, .stat = STA_NOINIT }
+};
+
+
+
+/*-----------------------------------------------------------------------*/
+/* Attach / Detach an image                                              */
+/*-----------------------------------------------------------------------*/
+
+DRESULT disk_host_open (BYTE pdrv, const char* path, BYTE mode)
+{
+	DHDRIVE *d;
+	struct stat st;
+
+	if (pdrv >= DISK_HOST_DRIVES) return RES_PARERR;
+	disk_host_close(pdrv);
+	d = &Drive[pdrv];
+
+	d->fd = open(path, O_RDWR);
+	if (d->fd < 0) return RES_NOTRDY;
+	if (fstat(d->fd, &st) != 0 || st.st_size < 512) {
+		disk_host_close(pdrv);
+		return RES_ERROR;
+	}
+	d->sectors = (DWORD)(st.st_size / 512);
+
+	if (mode == DISK_HOST_MMAP) {
+		d->map = mmap(0, (size_t)d->sectors * 512, PROT_READ | PROT_WRITE, MAP_SHARED, d->fd, 0);
+		if (d->map == MAP_FAILED) {
+			d->map = 0;
+			disk_host_close(pdrv);
+			return RES_ERROR;
+		}
+	}
+	d->next = 0xFFFFFFFF;
+	return RES_OK;
+}
+
+
+void disk_host_close (BYTE pdrv)
+{
+	DHDRIVE *d;
+
+	if (pdrv >= DISK_HOST_DRIVES) return;
+	d = &Drive[pdrv];
+
+	if (d->map) munmap(d->map, (size_t)d->sectors * 512);
+	if (d->fd >= 0) close(d->fd);
+	free(d->rcount);
+	free(d->wcount);
+	d->fd = -1;
+	d->map = 0;
+	d->rcount = d->wcount = 0;
+	d->sectors = 0;
+	d->stat = STA_NOINIT;
+}
+
+
+
+/*-----------------------------------------------------------------------*/
+/* Latency model, statistics and tracing                                 */
+/*-----------------------------------------------------------------------*/
+
+void disk_host_latency (BYTE pdrv, const DHLATENCY* lat)
+{
+	if (pdrv < DISK_HOST_DRIVES) Drive[pdrv].lat = *lat;
+}
+
+
+/* Count reads and writes of every sector of the attached image */
+DRESULT disk_host_sector_stats (BYTE pdrv, int on)
+{
+	DHDRIVE *d;
+
+	if (pdrv >= DISK_HOST_DRIVES) return RES_PARERR;
+	d = &Drive[pdrv];
+
+	free(d->rcount);
+	free(d->wcount);
+	d->rcount = d->wcount = 0;
+	if (on) {
+		if (!d->sectors) return RES_NOTRDY;
+		d->rcount = calloc(d->sectors, sizeof(DWORD));
+		d->wcount = calloc(d->sectors, sizeof(DWORD));
+		if (!d->rcount || !d->wcount) {
+			disk_host_sector_stats(pdrv, 0);
+			return RES_ERROR;
+		}
+	}
+	return RES_OK;
+}
+
+
+const DWORD* disk_host_sector_reads (BYTE pdrv)
+{
+	return pdrv < DISK_HOST_DRIVES ? Drive[pdrv].rcount : 0;
+}
+
+
+const DWORD* disk_host_sector_writes (BYTE pdrv)
+{
+	return pdrv < DISK_HOST_DRIVES ? Drive[pdrv].wcount : 0;
+}
+
+
+/* Log every media request as "R|W|S|T <sector> <count>", one per line */
+void disk_host_trace (BYTE pdrv, FILE* fp)
+{
+	if (pdrv < DISK_HOST_DRIVES) Drive[pdrv].trace = fp;
+}
+
+
+const DHSTATS* disk_host_stats (BYTE pdrv)
+{
+	return pdrv < DISK_HOST_DRIVES ? &Drive[pdrv].stats : 0;
+}
+
+
+void disk_host_clear_stats (BYTE pdrv)
+{
+	DHDRIVE *d;
+
+	if (pdrv >= DISK_HOST_DRIVES) return;
+	d = &Drive[pdrv];
+
+	memset(&d->stats, 0, sizeof d->stats);
+	if (d->rcount) memset(d->rcount, 0, d->sectors * sizeof(DWORD));
+	if (d->wcount) memset(d->wcount, 0, d->sectors * sizeof(DWORD));
+}
+
+
+/* Account one media request and wait out its modelled latency */
+static void account (DHDRIVE* d, char op, DWORD sector, UINT count)
+{
+	DWORD us, *cnt;
+	UINT i;
+	struct timespec ts;
+
+	us = d->lat.cmd_us;
+	if (sector != d->next) {
+		d->stats.seeks++;
+		us += d->lat.seek_us;
+	}
+	us += count * (op == 'R' ? d->lat.read_us : d->lat.write_us);
+	d->next = sector + count;
+	d->stats.busy_us += us;
+
+	cnt = (op == 'R') ? d->rcount : d->wcount;
+	if (cnt) {
+		for (i = 0; i < count; i++) cnt[sector + i]++;
+	}
+	if (d->trace) fprintf(d->trace, "%c %lu %u\n", op, (unsigned long)sector, count);
+
+	if (d->lat.sleep && us) {
+		ts.tv_sec = us / 1000000;
+		ts.tv_nsec = (long)(us % 1000000) * 1000;
+		nanosleep(&ts, 0);
+	}
+}
+
+
+
+/*-----------------------------------------------------------------------*/
+/* Get Drive Status                                                      */
+/*-----------------------------------------------------------------------*/
+
+DSTATUS disk_status (BYTE pdrv)
+{
+	if (pdrv >= DISK_HOST_DRIVES) return STA_NOINIT;
+	return Drive[pdrv].stat;
+}
+
+
+
+/*-----------------------------------------------------------------------*/
+/* Initialize a Drive                                                    */
+/*-----------------------------------------------------------------------*/
+
+DSTATUS disk_initialize (BYTE pdrv)
+{
+	if (pdrv >= DISK_HOST_DRIVES) return STA_NOINIT;
+#if DISK_USE_CACHE
+	disk_cache_invalidate(pdrv);
+#endif
+#if DISK_USE_QUEUE
+	disk_queue_discard(pdrv);
+#endif
+#if DISK_USE_PREFETCH
+	disk_prefetch_discard(pdrv);
+#endif
+	Drive[pdrv].stat = (Drive[pdrv].fd >= 0) ? 0 : STA_NOINIT | STA_NODISK;
+	return Drive[pdrv].stat;
+}
+
+
+
+/*-----------------------------------------------------------------------*/
+/* Read / Write Sector(s), through the same layers as on the target      */
+/*-----------------------------------------------------------------------*/
+
+DRESULT disk_read (BYTE pdrv, BYTE* buff, DWORD sector, UINT count)
+{
+	if (pdrv >= DISK_HOST_DRIVES || !count) return RES_PARERR;
+	if (Drive[pdrv].stat & STA_NOINIT) return RES_NOTRDY;
+#if DISK_USE_CACHE
+	return disk_cache_read(pdrv, buff, sector, count);
+#elif DISK_USE_QUEUE
+	return disk_queue_read(pdrv, buff, sector, count);
+#elif DISK_USE_PREFETCH
+	return disk_prefetch_read(pdrv, buff, sector, count);
+#else
+	return disk_media_read(pdrv, buff, sector, count);
+#endif
+}
+
+
+DRESULT disk_write (BYTE pdrv, const BYTE* buff, DWORD sector, UINT count)
+{
+	if (pdrv >= DISK_HOST_DRIVES || !count) return RES_PARERR;
+	if (Drive[pdrv].stat & STA_NOINIT) return RES_NOTRDY;
+#if DISK_USE_CACHE
+	return disk_cache_write(pdrv, buff, sector, count);
+#elif DISK_USE_QUEUE
+	return disk_queue_write(pdrv, buff, sector, count);
+#elif DISK_USE_PREFETCH
+	return disk_prefetch_write(pdrv, buff, sector, count);
+#else
+	return disk_media_write(pdrv, buff, sector, count);
+#endif
+}
+
+
+/* The image is the media under the sector cache, write queue and read-ahead */
+DRESULT disk_media_read (BYTE pdrv, BYTE* buff, DWORD sector, UINT count)
+{
+	DHDRIVE *d = &Drive[pdrv];
+	size_t len = (size_t)count * 512;
+
+	if (sector >= d->sectors || count > d->sectors - sector) return RES_PARERR;
+	account(d, 'R', sector, count);
+	d->stats.reads++;
+	d->stats.sectors_read += count;
+
+	if (d->map) {
+		memcpy(buff, d->map + (size_t)sector * 512, len);
+		return RES_OK;
+	}
+	return pread(d->fd, buff, len, (off_t)sector * 512) == (ssize_t)len ? RES_OK : RES_ERROR;
+}
+
+
+DRESULT disk_media_write (BYTE pdrv, const BYTE* buff, DWORD sector, UINT count)
+{
+	DHDRIVE *d = &Drive[pdrv];
+	size_t len = (size_t)count * 512;
+
+	if (sector >= d->sectors || count > d->sectors - sector) return RES_PARERR;
+	account(d, 'W', sector, count);
+	d->stats.writes++;
+	d->stats.sectors_written += count;
+
+	if (d->map) {
+		memcpy(d->map + (size_t)sector * 512, buff, len);
+		return RES_OK;
+	}
+	return pwrite(d->fd, buff, len, (off_t)sector * 512) == (ssize_t)len ? RES_OK : RES_ERROR;
+}
+
+
+
+/*-----------------------------------------------------------------------*/
+/* Miscellaneous Functions                                               */
+/*-----------------------------------------------------------------------*/
+
+DRESULT disk_ioctl (BYTE pdrv, BYTE cmd, void* buff)
+{
+	DHDRIVE *d;
+	DWORD *range;
+
+	if (pdrv >= DISK_HOST_DRIVES) return RES_PARERR;
+	d = &Drive[pdrv];
+	if (d->stat & STA_NOINIT) return RES_NOTRDY;
+
+	switch (cmd) {
+	case CTRL_SYNC :		/* Flush the cache layers, then the image */
+#if DISK_USE_CACHE
+		if (disk_cache_flush(pdrv) != RES_OK) return RES_ERROR;
+#endif
+#if DISK_USE_QUEUE
+		if (disk_queue_flush(pdrv) != RES_OK) return RES_ERROR;
+#endif
+		d->stats.syncs++;
+		if (d->trace) fprintf(d->trace, "S 0 0\n");
+		if (d->map) return msync(d->map, (size_t)d->sectors * 512, MS_SYNC) ? RES_ERROR : RES_OK;
+		return fsync(d->fd) ? RES_ERROR : RES_OK;
+
+	case CTRL_TRIM :		/* Only counted, the image keeps its data */
+		range = (DWORD*)buff;
+		if (range[1] < range[0]) return RES_PARERR;
+#if DISK_USE_CACHE
+		disk_cache_trim(pdrv, range[0], range[1]);
+#endif
+#if DISK_USE_QUEUE
+		disk_queue_trim(pdrv, range[0], range[1]);
+#endif
+#if DISK_USE_PREFETCH
+		disk_prefetch_trim(pdrv, range[0], range[1]);
+#endif
+		d->stats.trims += range[1] - range[0] + 1;
+		if (d->trace) fprintf(d->trace, "T %lu %lu\n", (unsigned long)range[0], (unsigned long)(range[1] - range[0] + 1));
+		return RES_OK;
+
+	case GET_SECTOR_COUNT :
+		*(DWORD*)buff = d->sectors;
+		return RES_OK;
+
+	case GET_SECTOR_SIZE :
+		*(WORD*)buff = 512;
+		return RES_OK;
+
+	case GET_BLOCK_SIZE :
+		*(DWORD*)buff = 1;
+		return RES_OK;
+	}
+	return RES_PARERR;
+}
+
+
+/* Timestamp for new and modified files, from the host clock */
+DWORD get_fattime (void)
+{
+	time_t t = time(0);
+	struct tm *tm = localtime(&t);
+
+	return ((DWORD)(tm->tm_year - 80) << 25)
+		| ((DWORD)(tm->tm_mon + 1) << 21)
+		| ((DWORD)tm->tm_mday << 16)
+		| ((DWORD)tm->tm_hour << 11)
+		| ((DWORD)tm->tm_min << 5)
+		| ((DWORD)tm->tm_sec >> 1);
+}
+
+#endif /* DISK_HOST */
@@ -0,0 +1,67 @@
+/*-----------------------------------------------------------------------/
+/  Disk image backend for host builds                                    /
+/-----------------------------------------------------------------------/
+/  Build ff.c, the disk cache layers and diskhost.c with -DDISK_HOST     /
+/  (diskio.c drops out) to run the file system on a FAT image file.      /
+/-----------------------------------------------------------------------*/
+
+#ifndef _DISKHOST_DEFINED
+#define _DISKHOST_DEFINED
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdio.h>
+#include <stdint.h>
+#include "integer.h"
+#include "diskio.h"
+
+#define DISK_HOST_DRIVES	3	/* Number of physical drives that can hold an image */
+
+/* Image access modes for disk_host_open() */
+#define DISK_HOST_FILE		0	/* pread()/pwrite() on the image file */
+#define DISK_HOST_MMAP		1	/* Copy straight from/to a shared mapping of the image */
+
+
+/* Injected latency, applied per disk_media_read/write request */
+typedef struct {
+	DWORD	cmd_us;		/* Fixed cost of every request */
+	DWORD	seek_us;	/* Extra cost when a request does not continue the last one */
+	DWORD	read_us;	/* Cost per sector read */
+	DWORD	write_us;	/* Cost per sector written */
+	BYTE	sleep;		/* 1: Really wait, 0: Only add it to busy_us */
+} DHLATENCY;
+
+
+/* Image counters */
+typedef struct {
+	DWORD	reads;		/* Read requests */
+	DWORD	writes;		/* Write requests */
+	DWORD	sectors_read;
+	DWORD	sectors_written;
+	DWORD	seeks;		/* Requests that did not continue the last one */
+	DWORD	syncs;		/* CTRL_SYNC requests */
+	DWORD	trims;		/* Sectors released by CTRL_TRIM */
+	uint64_t	busy_us;	/* Injected latency, slept or not */
+} DHSTATS;
+
+
+/*---------------------------------------*/
+/* Prototypes for the image backend      */
+
+DRESULT disk_host_open (BYTE pdrv, const char* path, BYTE mode);
+void disk_host_close (BYTE pdrv);
+void disk_host_latency (BYTE pdrv, const DHLATENCY* lat);
+DRESULT disk_host_sector_stats (BYTE pdrv, int on);
+const DWORD* disk_host_sector_reads (BYTE pdrv);
+const DWORD* disk_host_sector_writes (BYTE pdrv);
+void disk_host_trace (BYTE pdrv, FILE* fp);
+const DHSTATS* disk_host_stats (BYTE pdrv);
+void disk_host_clear_stats (BYTE pdrv);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
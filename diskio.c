@@ -7,18 +7,29 @@
 /* storage control modules to the FatFs module with a defined API.       */
 /*-----------------------------------------------------------------------*/
 
+#ifndef DISK_HOST	/* Host builds use diskhost.c instead */
+
 #include "app.h"
 #include "USART3.h"
 #include "diskio.h"		/* FatFs lower layer API */
 #include <stdInt.h>
 
 #include "SD.h"
+#include <string.h>
+#include "diskcache.h"
+#include "diskqueue.h"
+#include "diskprefetch.h"
+#include "diskram.h"
 
 
 /* Definitions of physical drive number for each drive */
-#define DEV_RAM		0	/* Example: Map Ram disk to physical drive 0 */
-#define DEV_MMC		1	/* Example: Map MMC/SD card to physical drive 1 */
-#define DEV_USB		2	/* Example: Map USB MSD to physical drive 2 */
+#define DEV_MMC		0	/* SD card slots 0..SD_CARDS-1 on SERCOM1 map to drives 0.. */
+#define DEV_RAM		2	/* RAM disk for scratch files */
+
+/* SD card slot behind a drive, SD_CARDS if the drive is not an SD card */
+#define MMC_SLOT(pdrv)	((pdrv) - DEV_MMC < SD_CARDS ? (pdrv) - DEV_MMC : SD_CARDS)
+
+static BYTE MmcReady[SD_CARDS];	/* 1 once the card in a slot initialized */
 
 int diskStatus = 0;
 int diskInitialise = 0;
@@ -34,11 +45,17 @@ uint8_t getBuff1[512];
 
 DSTATUS disk_status ( BYTE pdrv) /* Physical drive number to identify the drive */
 {
-     if(pdrv)
+#if DISK_USE_RAM
+    if (pdrv == DEV_RAM)
+    {
+        return disk_ram_status();
+    }
+#endif
+     if(MMC_SLOT(pdrv) >= SD_CARDS)
     {
         return STA_NOINIT;
     }
-    return RES_OK;
+    return MmcReady[MMC_SLOT(pdrv)] ? 0 : STA_NOINIT;
 }
 
 
@@ -50,7 +67,28 @@ DSTATUS disk_status ( BYTE pdrv) /* Physical drive number to identify the drive
 DSTATUS disk_initialize (BYTE pdrv)
 {
 	DSTATUS stat;
+#if DISK_USE_RAM
+	if (pdrv == DEV_RAM)
+	{
+		return disk_ram_initialize();
+	}
+#endif
+	if (MMC_SLOT(pdrv) >= SD_CARDS)
+	{
+		return STA_NOINIT;
+	}
+	SDCard_Use(MMC_SLOT(pdrv));  //the card is reset anyway, only the bus matters
+#if DISK_USE_CACHE
+	disk_cache_invalidate(pdrv);  //a new card must not see old sectors
+#endif
+#if DISK_USE_QUEUE
+	disk_queue_discard(pdrv);
+#endif
+#if DISK_USE_PREFETCH
+	disk_prefetch_discard(pdrv);
+#endif
 	stat=SDCard_Init();  //SD card initialization
+	MmcReady[MMC_SLOT(pdrv)] = (stat == 0);
 
 	if(stat == STA_NODISK)
 	{
@@ -78,21 +116,47 @@ DRESULT disk_read (
 	UINT count                               /* Number of sectors to read */
 )
 {
-    DRESULT res;
-    if (pdrv || !count)
+    if (!count)
     {
         return RES_PARERR;
     }
-		if (count == 1)
-		{
-			res = SDCard_ReadSingleBlock(sector,buff);
-		}
-		else
-		{
-			UART3_Write_Text("read 2 \n");
+#if DISK_USE_RAM
+    if (pdrv == DEV_RAM)
+    {
+        return disk_ram_read(buff, sector, count);
+    }
+#endif
+    if (MMC_SLOT(pdrv) >= SD_CARDS)
+    {
+        return RES_PARERR;
+    }
+#if DISK_USE_CACHE
+    return disk_cache_read(pdrv, buff, sector, count);
+#elif DISK_USE_QUEUE
+    return disk_queue_read(pdrv, buff, sector, count);
+#elif DISK_USE_PREFETCH
+    return disk_prefetch_read(pdrv, buff, sector, count);
+#else
+    return disk_media_read(pdrv, buff, sector, count);
+#endif
+}
+
 
-			res = SDCard_ReadMultipleBlock(sector,buff,count);
+/* Read sectors from the card, below the sector cache, write queue and read-ahead */
+DRESULT disk_media_read (
+	BYTE pdrv,
+	BYTE *buff,
+	DWORD sector,
+	UINT count
+)
+{
+    DRESULT res;
+		/* Sequential requests continue the same CMD18 stream, on the card of this drive */
+		if (SDCard_Use(MMC_SLOT(pdrv)))
+		{
+			return RES_ERROR;
 		}
+		res = SDCard_ReadStream(sector,buff,count);
     if(res == 0x00)
     {
         return RES_OK;
@@ -115,22 +179,47 @@ DRESULT disk_write (
 	UINT count             /* Number of sectors to write */
 )
 {
-    DRESULT res;
-	if (pdrv || !count)
+	if (!count)
     {
         return RES_PARERR;
     }
-    if(count == 1)
+#if DISK_USE_RAM
+    if (pdrv == DEV_RAM)
     {
-    	UART3_Write_Text("write 1 \n");
-        res = SDCard_WriteSingleBlock(sector, buff);
+        return disk_ram_write(buff, sector, count);
     }
-    else
+#endif
+    if (MMC_SLOT(pdrv) >= SD_CARDS)
     {
-    	UART3_Write_Text("write 2 \n");
-        res = SDCard_WriteMultipleBlock(sector, buff, count);
+        return RES_PARERR;
+    }
+#if DISK_USE_CACHE
+    return disk_cache_write(pdrv, buff, sector, count);
+#elif DISK_USE_QUEUE
+    return disk_queue_write(pdrv, buff, sector, count);
+#elif DISK_USE_PREFETCH
+    return disk_prefetch_write(pdrv, buff, sector, count);
+#else
+    return disk_media_write(pdrv, buff, sector, count);
+#endif
+}
 
+
+/* Write sectors to the card, below the sector cache, write queue and read-ahead */
+DRESULT disk_media_write (
+	BYTE pdrv,
+	const BYTE *buff,
+	DWORD sector,
+	UINT count
+)
+{
+    DRESULT res;
+    /* Contiguous writes continue the same CMD25 stream, on the card of this drive */
+    if (SDCard_Use(MMC_SLOT(pdrv)))
+    {
+        return RES_ERROR;
     }
+    res = SDCard_WriteStream(sector, buff, count);
     if(res == 0)
     {
         return RES_OK;
@@ -153,31 +242,39 @@ DRESULT disk_ioctl (
 )
 {
 	DRESULT res;
-	BYTE n, csd[16];
-	DWORD csize;
+	const SD_CardInfo *info;
 
-	if (pdrv)
+#if DISK_USE_RAM
+	if (pdrv == DEV_RAM)
+	{
+		return disk_ram_ioctl(cmd, buff);
+	}
+#endif
+	if (MMC_SLOT(pdrv) >= SD_CARDS)
 	{
 		 return RES_PARERR;
 	}
+	if (SDCard_Use(MMC_SLOT(pdrv)))
+	{
+		 return RES_ERROR;
+	}
+	info = SDCard_GetInfo();
 	res = RES_ERROR;
 	switch (cmd)
 	{
-		case CTRL_SYNC        : res = RES_OK; break;
-		case GET_SECTOR_COUNT : /* Get number of sectors on the disk (WORD) */
-				if((SDCard_WriteCmd(0x49,0x00,0x95) == 0) && SDCard_CardID(0x49, csd))
+		case CTRL_SYNC        : /* Flush cached and queued sectors, then close any open stream so written data is committed */
+#if DISK_USE_CACHE
+				if (disk_cache_flush(pdrv) != RES_OK) break;
+#endif
+#if DISK_USE_QUEUE
+				if (disk_queue_flush(pdrv) != RES_OK) break;
+#endif
+				res = SDCard_StopTransfer() ? RES_ERROR : RES_OK;
+				break;
+		case GET_SECTOR_COUNT : /* Get number of sectors on the disk (DWORD), from the CSD read at init */
+				if (info->sectors)
 				{
-					if((csd[0] >> 6) == 1) /* SDC ver 2.00 */
-					{
-						csize = csd[9] + ((WORD)csd[8] << 8) + 1;
-						*(DWORD*)buff = (DWORD)csize << 10;
-					}
-					else /* MMC or SDC ver 1.XX */
-					{
-						n = (csd[5] & 15) + ((csd[10] & 128) >> 7) + ((csd[9] & 3) << 1) + 2;
-						csize = (csd[8] >> 6) + ((WORD)csd[7] << 2) + ((WORD)(csd[6] & 3) << 10) + 1;
-						*(DWORD*)buff = (DWORD)csize << (n - 9);
-					}
+					*(DWORD*)buff = info->sectors;
 					res = RES_OK;
 				}
 				break;
@@ -185,49 +282,68 @@ DRESULT disk_ioctl (
 				*(WORD*)buff = 512;
 				res = RES_OK;
 				break;
-		case GET_BLOCK_SIZE   :
-				if ((SDCard_WriteCmd(0x49,0x00,0x95) == 0) && SDCard_CardID(0x49, csd)) /* Read CSD */
+		case GET_BLOCK_SIZE   : /* Get erase block size in sectors (DWORD), the AU size when the card reports one */
+				if (info->auSectors)
 				{
-					*(DWORD*)buff = (((csd[10] & 63) << 1) + ((WORD)(csd[11] & 128) >> 7) + 1) << ((csd[13] >> 6) - 1);
+					*(DWORD*)buff = info->auSectors;
 					res = RES_OK;
-
 				}
-		break;
+				break;
+		case CTRL_TRIM        : /* Erase a freed sector range (DWORD[2], inclusive), whole erase units only */
+				if (((DWORD*)buff)[1] < ((DWORD*)buff)[0]) break;
+#if DISK_USE_CACHE
+				disk_cache_trim(pdrv, ((DWORD*)buff)[0], ((DWORD*)buff)[1]);
+#endif
+#if DISK_USE_QUEUE
+				disk_queue_trim(pdrv, ((DWORD*)buff)[0], ((DWORD*)buff)[1]);
+#endif
+#if DISK_USE_PREFETCH
+				disk_prefetch_trim(pdrv, ((DWORD*)buff)[0], ((DWORD*)buff)[1]);
+#endif
+				res = SDCard_Erase(((DWORD*)buff)[0], ((DWORD*)buff)[1]) ? RES_ERROR : RES_OK;
+				break;
+		case MMC_GET_TYPE     : /* Get card type (BYTE) */
+				*(BYTE*)buff = info->type;
+				res = RES_OK;
+				break;
+		case MMC_GET_CSD      : /* Get CSD (16 bytes) */
+				memcpy(buff, info->csd, 16);
+				res = RES_OK;
+				break;
+		case MMC_GET_CID      : /* Get CID (16 bytes) */
+				memcpy(buff, info->cid, 16);
+				res = RES_OK;
+				break;
+		case MMC_GET_OCR      : /* Get OCR (4 bytes) */
+				memcpy(buff, info->ocr, 4);
+				res = RES_OK;
+				break;
+		case MMC_GET_SDSTAT   : /* Get SD status (64 bytes) */
+				memcpy(buff, info->sdStatus, 64);
+				res = RES_OK;
+				break;
+		case MMC_GET_SPEED    : /* Get bus speed mode (BYTE), negotiated with CMD6 at init */
+				*(BYTE*)buff = info->highSpeed;
+				res = RES_OK;
+				break;
 		
+#if DISK_USE_CACHE
+		case CTRL_CACHE_PIN   : /* Keep a sector range (the FAT) resident */
+				disk_cache_pin(pdrv, ((DWORD*)buff)[0], ((DWORD*)buff)[1]);
+				res = RES_OK;
+				break;
+#endif
+
 		default:
 		 res = RES_PARERR; break;
 	}
 	return res;
 }
 
-uint8_t SDCard_ReadSingleBlock(uint32_t addr, uint8_t *buf) {
-	// Implementation here (or stub)
-	return 0;
-}
-
-uint8_t SDCard_ReadMultipleBlock(uint32_t addr, uint8_t *buf, uint8_t count) {
-	// Implementation here (or stub)
-	return 0;
-}
-
-uint8_t SDCard_WriteSingleBlock(uint32_t addr, const uint8_t *buf) {
-	// Implementation here (or stub)
-	return 0;
-}
-
-uint8_t SDCard_WriteMultipleBlock(uint32_t addr, const uint8_t *buf, uint8_t count) {
-	// Implementation here (or stub)
-	return 0;
-}
-
-uint8_t SDCard_CardID(uint8_t cmd, uint8_t *buf) {
-	// Implementation here (or stub)
-	return 0;
-}
-
 // FATTIME Work around
 DWORD get_fattime (void)
 {
 	return 0;
 }
 
+#endif /* DISK_HOST */
@@ -0,0 +1,142 @@
+/*-----------------------------------------------------------------------*/
+/* Sequential read-ahead between the disk layer and the media            */
+/*-----------------------------------------------------------------------*/
+/* f_gets() and small f_read() calls fetch one sector at a time. When a  */
+/* read starts where the previous one ended, the following sectors are   */
+/* read into a buffer in the same pass, which the open CMD18 stream      */
+/* turns into one continuous transfer. The depth doubles while the       */
+/* read-ahead is fully used and halves when most of it is thrown away.   */
+/*-----------------------------------------------------------------------*/
+
+#include "diskprefetch.h"
+#include "diskcache.h"
+#include <string.h>
+
+
+static BYTE PBuf[DISK_PREFETCH_SECTORS][512];
+static BYTE PDrv;
+static DWORD PStart;		/* First sector held in PBuf */
+static UINT PCount;			/* Sectors held in PBuf, 0: empty */
+static UINT PServed;		/* Sectors of PBuf handed out so far */
+
+static BYTE SeqDrv;
+static DWORD SeqNext;		/* Sector following the last read */
+
+static DPSTATS Stats = { 0, 0, 0, 1 };
+
+
+
+/*-----------------------------------------------------------------------*/
+/* Retire the buffer contents and adapt the depth to how much was used   */
+/*-----------------------------------------------------------------------*/
+
+static void retire (void)
+{
+	if (!PCount) return;
+
+	if (PServed >= PCount) {
+		if (Stats.depth < DISK_PREFETCH_SECTORS) Stats.depth *= 2;
+		if (Stats.depth > DISK_PREFETCH_SECTORS) Stats.depth = DISK_PREFETCH_SECTORS;
+	} else {
+		Stats.wasted += PCount - PServed;
+		if (PServed < PCount / 2 && Stats.depth > 1) Stats.depth /= 2;
+	}
+	PCount = 0;
+}
+
+
+
+/*-----------------------------------------------------------------------*/
+/* Read Sector(s)                                                        */
+/*-----------------------------------------------------------------------*/
+
+DRESULT disk_prefetch_read (BYTE pdrv, BYTE* buff, DWORD sector, UINT count)
+{
+	DRESULT res;
+	DWORD total;
+	UINT depth;
+	int seq;
+
+	seq = (pdrv == SeqDrv && sector == SeqNext);
+	SeqDrv = pdrv;
+	SeqNext = sector + count;
+
+	/* Served entirely from the read-ahead buffer */
+	if (PCount && pdrv == PDrv && sector >= PStart && sector - PStart + count <= PCount) {
+		memcpy(buff, PBuf[sector - PStart], count * 512);
+		PServed += count;
+		Stats.hits += count;
+		return RES_OK;
+	}
+
+	retire();
+	res = disk_media_read(pdrv, buff, sector, count);
+	if (res != RES_OK) {
+		SeqNext = 0xFFFFFFFF;	/* Start over once the media reads again */
+		return res;
+	}
+	if (!seq || count >= DISK_PREFETCH_SECTORS) return RES_OK;
+
+	/* Never read ahead past the last sector of the disk */
+	if (disk_ioctl(pdrv, GET_SECTOR_COUNT, &total) != RES_OK || sector + count >= total) return RES_OK;
+	depth = Stats.depth;
+	if (depth > total - (sector + count)) depth = (UINT)(total - (sector + count));
+
+	/* Sequential stream: the card is already positioned on the next sector */
+	if (disk_media_read(pdrv, PBuf[0], sector + count, depth) == RES_OK) {
+		PDrv = pdrv;
+		PStart = sector + count;
+		PCount = depth;
+		PServed = 0;
+		Stats.fetched += PCount;
+	}
+	return RES_OK;
+}
+
+
+
+/*-----------------------------------------------------------------------*/
+/* Write Sector(s), dropping read-ahead data the write makes stale       */
+/*-----------------------------------------------------------------------*/
+
+DRESULT disk_prefetch_write (BYTE pdrv, const BYTE* buff, DWORD sector, UINT count)
+{
+	if (PCount && pdrv == PDrv && sector < PStart + PCount && PStart < sector + count)
+		PCount = 0;
+	return disk_media_write(pdrv, buff, sector, count);
+}
+
+
+
+/*-----------------------------------------------------------------------*/
+/* Drop the read-ahead buffer of a drive                                 */
+/*-----------------------------------------------------------------------*/
+
+void disk_prefetch_discard (BYTE pdrv)
+{
+	if (pdrv == PDrv) PCount = 0;
+	if (pdrv == SeqDrv) SeqNext = 0xFFFFFFFF;
+}
+
+
+
+/*-----------------------------------------------------------------------*/
+/* Drop read-ahead data of a freed sector range (inclusive)              */
+/*-----------------------------------------------------------------------*/
+
+void disk_prefetch_trim (BYTE pdrv, DWORD start, DWORD end)
+{
+	if (PCount && pdrv == PDrv && start < PStart + PCount && PStart <= end)
+		PCount = 0;
+}
+
+
+
+/*-----------------------------------------------------------------------*/
+/* Read-ahead counters                                                   */
+/*-----------------------------------------------------------------------*/
+
+const DPSTATS* disk_prefetch_stats (void)
+{
+	return &Stats;
+}
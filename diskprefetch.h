@@ -0,0 +1,41 @@
+/*-----------------------------------------------------------------------/
+/  Sequential read-ahead between the disk layer and the media            /
+/-----------------------------------------------------------------------*/
+
+#ifndef _DISKPREFETCH_DEFINED
+#define _DISKPREFETCH_DEFINED
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "integer.h"
+#include "diskio.h"
+
+#define DISK_USE_PREFETCH		1	/* 1: Read ahead on sequential sector streams */
+#define DISK_PREFETCH_SECTORS	4	/* Largest read-ahead depth, RAM budget in 512 byte sectors */
+
+
+/* Read-ahead counters */
+typedef struct {
+	DWORD	fetched;	/* Sectors read ahead */
+	DWORD	hits;		/* Sectors served from the read-ahead buffer */
+	DWORD	wasted;		/* Sectors read ahead but never used */
+	UINT	depth;		/* Current read-ahead depth */
+} DPSTATS;
+
+
+/*---------------------------------------*/
+/* Prototypes for the read-ahead stage   */
+
+DRESULT disk_prefetch_read (BYTE pdrv, BYTE* buff, DWORD sector, UINT count);
+DRESULT disk_prefetch_write (BYTE pdrv, const BYTE* buff, DWORD sector, UINT count);
+void disk_prefetch_discard (BYTE pdrv);
+void disk_prefetch_trim (BYTE pdrv, DWORD start, DWORD end);
+const DPSTATS* disk_prefetch_stats (void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
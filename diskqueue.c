@@ -0,0 +1,198 @@
+/*-----------------------------------------------------------------------*/
+/* Write-behind queue that merges single sector writes                   */
+/*-----------------------------------------------------------------------*/
+/* Nearly every disk_write() from FatFs is a single sector. Instead of   */
+/* sending each one to the card, sectors are held here in (drive,sector) */
+/* order. A flush walks the queue and writes every run of adjacent       */
+/* sectors with one multiple block write, straight from the queue RAM.   */
+/* Reads are served from queued sectors, so nothing has to be flushed    */
+/* early to stay coherent.                                               */
+/*-----------------------------------------------------------------------*/
+
+#include "diskqueue.h"
+#include "diskcache.h"
+#include "diskprefetch.h"
+#include <string.h>
+
+
+/* Next stage down: the read-ahead buffer when enabled, else the media */
+#if DISK_USE_PREFETCH
+#define lower_read		disk_prefetch_read
+#define lower_write		disk_prefetch_write
+#else
+#define lower_read		disk_media_read
+#define lower_write		disk_media_write
+#endif
+
+
+/* Slots are kept sorted, so adjacent sectors are adjacent in memory */
+static BYTE QBuf[DISK_QUEUE_SECTORS][512];
+static DWORD QSector[DISK_QUEUE_SECTORS];
+static BYTE QDrv[DISK_QUEUE_SECTORS];
+static UINT QCount;
+static DQSTATS Stats;
+
+
+
+/*-----------------------------------------------------------------------*/
+/* Slot helpers                                                          */
+/*-----------------------------------------------------------------------*/
+
+/* First slot not ordered before (pdrv, sector) */
+static UINT lower_bound (BYTE pdrv, DWORD sector)
+{
+	UINT lo = 0, hi = QCount, mid;
+
+	while (lo < hi) {
+		mid = (lo + hi) / 2;
+		if (QDrv[mid] < pdrv || (QDrv[mid] == pdrv && QSector[mid] < sector))
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return lo;
+}
+
+
+static void remove_slots (UINT i, UINT n)
+{
+	UINT tail = QCount - i - n;
+
+	memmove(QBuf[i], QBuf[i + n], tail * 512);
+	memmove(&QSector[i], &QSector[i + n], tail * sizeof(DWORD));
+	memmove(&QDrv[i], &QDrv[i + n], tail);
+	QCount -= n;
+}
+
+
+
+/*-----------------------------------------------------------------------*/
+/* Read Sector(s), queued sectors take precedence over the media        */
+/*-----------------------------------------------------------------------*/
+
+DRESULT disk_queue_read (BYTE pdrv, BYTE* buff, DWORD sector, UINT count)
+{
+	DRESULT res;
+	UINT i;
+
+	i = lower_bound(pdrv, sector);
+	if (count == 1 && i < QCount && QDrv[i] == pdrv && QSector[i] == sector) {
+		memcpy(buff, QBuf[i], 512);
+		return RES_OK;
+	}
+
+	res = lower_read(pdrv, buff, sector, count);
+	if (res != RES_OK) return res;
+
+	for ( ; i < QCount && QDrv[i] == pdrv && QSector[i] - sector < count; i++)
+		memcpy(buff + (QSector[i] - sector) * 512, QBuf[i], 512);
+	return RES_OK;
+}
+
+
+
+/*-----------------------------------------------------------------------*/
+/* Write Sector(s)                                                       */
+/*-----------------------------------------------------------------------*/
+
+DRESULT disk_queue_write (BYTE pdrv, const BYTE* buff, DWORD sector, UINT count)
+{
+	DRESULT res;
+	UINT i, n;
+
+	i = lower_bound(pdrv, sector);
+
+	if (count > 1) {	/* Already a multiple block write, queued copies are superseded */
+		for (n = 0; i + n < QCount && QDrv[i + n] == pdrv && QSector[i + n] - sector < count; n++) ;
+		if (n) remove_slots(i, n);
+		return lower_write(pdrv, buff, sector, count);
+	}
+
+	if (i < QCount && QDrv[i] == pdrv && QSector[i] == sector) {
+		memcpy(QBuf[i], buff, 512);
+		Stats.rewrites++;
+		return RES_OK;
+	}
+
+	if (QCount == DISK_QUEUE_SECTORS) {		/* Out of budget, drain every drive and start over */
+		while (QCount) {
+			res = disk_queue_flush(QDrv[0]);
+			if (res != RES_OK) return res;
+		}
+		i = 0;
+	}
+
+	memmove(QBuf[i + 1], QBuf[i], (QCount - i) * 512);
+	memmove(&QSector[i + 1], &QSector[i], (QCount - i) * sizeof(DWORD));
+	memmove(&QDrv[i + 1], &QDrv[i], QCount - i);
+	memcpy(QBuf[i], buff, 512);
+	QSector[i] = sector;
+	QDrv[i] = pdrv;
+	QCount++;
+	Stats.queued++;
+	return RES_OK;
+}
+
+
+
+/*-----------------------------------------------------------------------*/
+/* Write every queued sector of a drive as runs of adjacent sectors      */
+/*-----------------------------------------------------------------------*/
+
+DRESULT disk_queue_flush (BYTE pdrv)
+{
+	DRESULT res;
+	UINT i, n;
+
+	i = lower_bound(pdrv, 0);
+	while (i < QCount && QDrv[i] == pdrv) {
+		for (n = 1; i + n < QCount && QDrv[i + n] == pdrv && QSector[i + n] == QSector[i] + n; n++) ;
+		res = lower_write(pdrv, QBuf[i], QSector[i], n);
+		if (res != RES_OK) return res;
+		Stats.runs++;
+		Stats.sectors += n;
+		remove_slots(i, n);
+	}
+	return RES_OK;
+}
+
+
+
+/*-----------------------------------------------------------------------*/
+/* Drop every queued sector of a drive without writing it                */
+/*-----------------------------------------------------------------------*/
+
+void disk_queue_discard (BYTE pdrv)
+{
+	UINT i, n;
+
+	i = lower_bound(pdrv, 0);
+	for (n = 0; i + n < QCount && QDrv[i + n] == pdrv; n++) ;
+	if (n) remove_slots(i, n);
+}
+
+
+
+/*-----------------------------------------------------------------------*/
+/* Drop the queued sectors of a freed sector range (inclusive)           */
+/*-----------------------------------------------------------------------*/
+
+void disk_queue_trim (BYTE pdrv, DWORD start, DWORD end)
+{
+	UINT i, n;
+
+	i = lower_bound(pdrv, start);
+	for (n = 0; i + n < QCount && QDrv[i + n] == pdrv && QSector[i + n] <= end; n++) ;
+	if (n) remove_slots(i, n);
+}
+
+
+
+/*-----------------------------------------------------------------------*/
+/* Queue counters                                                        */
+/*-----------------------------------------------------------------------*/
+
+const DQSTATS* disk_queue_stats (void)
+{
+	return &Stats;
+}
@@ -0,0 +1,42 @@
+/*-----------------------------------------------------------------------/
+/  Write-behind queue that merges single sector writes                   /
+/-----------------------------------------------------------------------*/
+
+#ifndef _DISKQUEUE_DEFINED
+#define _DISKQUEUE_DEFINED
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "integer.h"
+#include "diskio.h"
+
+#define DISK_USE_QUEUE		1	/* 1: Queue single sector writes and emit them as multiple block writes */
+#define DISK_QUEUE_SECTORS	8	/* RAM budget in 512 byte sectors */
+
+
+/* Queue counters */
+typedef struct {
+	DWORD	queued;		/* Sectors taken into the queue */
+	DWORD	rewrites;	/* Queued sectors overwritten before reaching the media */
+	DWORD	runs;		/* Multiple block writes issued by flushes */
+	DWORD	sectors;	/* Sectors written by flushes */
+} DQSTATS;
+
+
+/*---------------------------------------*/
+/* Prototypes for the write queue        */
+
+DRESULT disk_queue_read (BYTE pdrv, BYTE* buff, DWORD sector, UINT count);
+DRESULT disk_queue_write (BYTE pdrv, const BYTE* buff, DWORD sector, UINT count);
+DRESULT disk_queue_flush (BYTE pdrv);
+void disk_queue_discard (BYTE pdrv);
+void disk_queue_trim (BYTE pdrv, DWORD start, DWORD end);
+const DQSTATS* disk_queue_stats (void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
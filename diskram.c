@@ -0,0 +1,137 @@
+/*-----------------------------------------------------------------------*/
+/* RAM disk for scratch files                                            */
+/*-----------------------------------------------------------------------*/
+/* Temporary files live in a small FAT12 volume in SRAM, so they never   */
+/* wait on the card or wear it. f_mkfs() wants at least 128 sectors,     */
+/* more than the SAMD21 has, so the first initialize lays down an empty  */
+/* volume itself. The files survive remounts but not a reset.            */
+/*-----------------------------------------------------------------------*/
+
+#include "diskram.h"
+#include <string.h>
+
+
+/* Volume layout: boot sector, one FAT sector, one root directory sector, */
+/* then one sector per cluster                                            */
+#define RAM_FAT_SECT	1
+#define RAM_DIR_SECT	2
+#define RAM_DIR_ENTS	16
+
+static BYTE RBuf[DISK_RAM_SECTORS][512];
+static DSTATUS Stat = STA_NOINIT;
+
+
+
+/*-----------------------------------------------------------------------*/
+/* Write an empty FAT12 volume                                           */
+/*-----------------------------------------------------------------------*/
+
+static void st_word (BYTE* p, WORD val)
+{
+	p[0] = (BYTE)val;
+	p[1] = (BYTE)(val >> 8);
+}
+
+
+static void format (void)
+{
+	BYTE *bs = RBuf[0];
+
+	memset(RBuf, 0, sizeof RBuf);
+
+	bs[0] = 0xEB; bs[1] = 0xFE; bs[2] = 0x90;	/* Boot jump */
+	memcpy(bs + 3, "MSDOS5.0", 8);				/* OEM name */
+	st_word(bs + 11, 512);						/* Bytes per sector */
+	bs[13] = 1;									/* Sectors per cluster */
+	st_word(bs + 14, RAM_FAT_SECT);				/* Reserved sectors */
+	bs[16] = 1;									/* Number of FATs */
+	st_word(bs + 17, RAM_DIR_ENTS);				/* Root directory entries */
+	st_word(bs + 19, DISK_RAM_SECTORS);			/* Total sectors */
+	bs[21] = 0xF8;								/* Media descriptor */
+	st_word(bs + 22, RAM_DIR_SECT - RAM_FAT_SECT);	/* Sectors per FAT */
+	bs[38] = 0x29;								/* Extended boot signature */
+	memcpy(bs + 43, "RAMDISK    ", 11);			/* Volume label */
+	memcpy(bs + 54, "FAT12   ", 8);				/* File system type */
+	st_word(bs + 510, 0xAA55);					/* Signature */
+
+	/* Clusters 0 and 1 are reserved: media descriptor and end of chain */
+	RBuf[RAM_FAT_SECT][0] = 0xF8;
+	RBuf[RAM_FAT_SECT][1] = 0xFF;
+	RBuf[RAM_FAT_SECT][2] = 0xFF;
+}
+
+
+
+/*-----------------------------------------------------------------------*/
+/* Initialize / Get Status                                               */
+/*-----------------------------------------------------------------------*/
+
+DSTATUS disk_ram_initialize (void)
+{
+	if (Stat & STA_NOINIT) {
+		format();
+		Stat = 0;
+	}
+	return Stat;
+}
+
+
+DSTATUS disk_ram_status (void)
+{
+	return Stat;
+}
+
+
+
+/*-----------------------------------------------------------------------*/
+/* Read / Write Sector(s)                                                */
+/*-----------------------------------------------------------------------*/
+
+DRESULT disk_ram_read (BYTE* buff, DWORD sector, UINT count)
+{
+	if (Stat & STA_NOINIT) return RES_NOTRDY;
+	if (sector >= DISK_RAM_SECTORS || count > DISK_RAM_SECTORS - sector) return RES_PARERR;
+
+	memcpy(buff, RBuf[sector], count * 512);
+	return RES_OK;
+}
+
+
+DRESULT disk_ram_write (const BYTE* buff, DWORD sector, UINT count)
+{
+	if (Stat & STA_NOINIT) return RES_NOTRDY;
+	if (sector >= DISK_RAM_SECTORS || count > DISK_RAM_SECTORS - sector) return RES_PARERR;
+
+	memcpy(RBuf[sector], buff, count * 512);
+	return RES_OK;
+}
+
+
+
+/*-----------------------------------------------------------------------*/
+/* Miscellaneous Functions                                               */
+/*-----------------------------------------------------------------------*/
+
+DRESULT disk_ram_ioctl (BYTE cmd, void* buff)
+{
+	if (Stat & STA_NOINIT) return RES_NOTRDY;
+
+	switch (cmd) {
+	case CTRL_SYNC :		/* Nothing is held back */
+	case CTRL_TRIM :		/* Freed sectors cost nothing */
+		return RES_OK;
+
+	case GET_SECTOR_COUNT :
+		*(DWORD*)buff = DISK_RAM_SECTORS;
+		return RES_OK;
+
+	case GET_SECTOR_SIZE :
+		*(WORD*)buff = 512;
+		return RES_OK;
+
+	case GET_BLOCK_SIZE :
+		*(DWORD*)buff = 1;
+		return RES_OK;
+	}
+	return RES_PARERR;
+}
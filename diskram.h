@@ -0,0 +1,32 @@
+/*-----------------------------------------------------------------------/
+/  RAM disk for scratch files                                            /
+/-----------------------------------------------------------------------*/
+
+#ifndef _DISKRAM_DEFINED
+#define _DISKRAM_DEFINED
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "integer.h"
+#include "diskio.h"
+
+#define DISK_USE_RAM		1	/* 1: Serve the RAM disk drive */
+#define DISK_RAM_SECTORS	16	/* Volume size in 512 byte sectors (4..340) */
+
+
+/*---------------------------------------*/
+/* Prototypes for the RAM disk           */
+
+DSTATUS disk_ram_initialize (void);
+DSTATUS disk_ram_status (void);
+DRESULT disk_ram_read (BYTE* buff, DWORD sector, UINT count);
+DRESULT disk_ram_write (const BYTE* buff, DWORD sector, UINT count);
+DRESULT disk_ram_ioctl (BYTE cmd, void* buff);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -820,6 +820,35 @@ DWORD get_fat (	/* 0xFFFFFFFF:Disk error, 1:Internal error, 2..0x0FFFFFFF:Cluste
 
 
 
+/*-----------------------------------------------------------------------*/
+/* Free cluster map                                                      */
+/*-----------------------------------------------------------------------*/
+/* One bit per block of clusters, clear only when the block is known to  */
+/* hold no free cluster. All bits start set at mount, create_chain()     */
+/* clears a block it scanned end to end without a hit and skips cleared  */
+/* blocks without reading the FAT, put_fat() sets the bit of a cluster   */
+/* it frees. Allocation on a nearly full volume so reads each full FAT   */
+/* sector once instead of on every search.                               */
+
+#if !_FS_READONLY && _FS_FREEMAP
+static
+void fm_init (
+	FATFS* fs		/* File system object */
+)
+{
+	fs->fm_shift = 0;
+	while (((fs->n_fatent - 1) >> fs->fm_shift) >= (DWORD)_FS_FREEMAP * 8) fs->fm_shift++;
+	mem_set(fs->freemap, 0xFF, _FS_FREEMAP);
+}
+
+#define FM_BIT(fs, blk)		((fs)->freemap[(blk) / 8] & (1 << ((blk) % 8)))
+#define FM_SET(fs, blk)		((fs)->freemap[(blk) / 8] |= (BYTE)(1 << ((blk) % 8)))
+#define FM_CLR(fs, blk)		((fs)->freemap[(blk) / 8] &= (BYTE)~(1 << ((blk) % 8)))
+#endif
+
+
+
+
 /*-----------------------------------------------------------------------*/
 /* FAT access - Change value of a FAT entry                              */
 /*-----------------------------------------------------------------------*/
@@ -835,6 +864,9 @@ FRESULT put_fat (
 	UINT bc;
 	BYTE *p;
 	FRESULT res;
+#if _FS_FREEMAP
+	BYTE freed = (val == 0);	/* Taken before FAT32 merges the reserved bits into val */
+#endif
 
 
 	if (clst < 2 || clst >= fs->n_fatent) {	/* Check range */
@@ -876,6 +908,9 @@ FRESULT put_fat (
 		default :
 			res = FR_INT_ERR;
 		}
+#if _FS_FREEMAP
+		if (res == FR_OK && freed) FM_SET(fs, clst >> fs->fm_shift);	/* The block holds a free cluster again */
+#endif
 	}
 
 	return res;
@@ -950,6 +985,10 @@ DWORD create_chain (	/* 0:No free cluster, 1:Internal error, 0xFFFFFFFF:Disk err
 {
 	DWORD cs, ncl, scl;
 	FRESULT res;
+#if _FS_FREEMAP
+	DWORD blk = 0xFFFFFFFF, end;
+	BYTE whole = 0;
+#endif
 
 
 	if (clst == 0) {		/* Create a new chain */
@@ -971,6 +1010,21 @@ DWORD create_chain (	/* 0:No free cluster, 1:Internal error, 0xFFFFFFFF:Disk err
 			ncl = 2;
 			if (ncl > scl) return 0;	/* No free cluster */
 		}
+#if _FS_FREEMAP
+		if (ncl >> fs->fm_shift != blk) {	/* Entered another block of clusters */
+			if (whole) FM_CLR(fs, blk);		/* The last one was scanned end to end without a free cluster */
+			blk = ncl >> fs->fm_shift;
+			whole = (ncl == 2 || !(ncl & ((1UL << fs->fm_shift) - 1)));
+			if (!FM_BIT(fs, blk)) {			/* Known to be full, skip it */
+				end = ((blk + 1) << fs->fm_shift) - 1;
+				if (end >= fs->n_fatent) end = fs->n_fatent - 1;
+				if (scl >= ncl && scl <= end) return 0;	/* No free cluster */
+				ncl = end;
+				whole = 0;
+				continue;
+			}
+		}
+#endif
 		cs = get_fat(fs, ncl);			/* Get the cluster status */
 		if (cs == 0) break;				/* Found a free cluster */
 		if (cs == 0xFFFFFFFF || cs == 1)/* An error occurred */
@@ -999,6 +1053,164 @@ DWORD create_chain (	/* 0:No free cluster, 1:Internal error, 0xFFFFFFFF:Disk err
 
 
 
+/*-----------------------------------------------------------------------*/
+/* FAT handling - Link a run of consecutive clusters                     */
+/*-----------------------------------------------------------------------*/
+/* Each cluster of the run points to the next one and the last one gets  */
+/* the end mark. The entries are written straight into the window, and a */
+/* FAT16/32 sector the run covers end to end is not read first.          */
+
+#if !_FS_READONLY && (_FS_EXTENT || _USE_EXPAND)
+static
+FRESULT link_run (
+	FATFS* fs,			/* File system object */
+	DWORD clst,			/* First cluster of the run */
+	DWORD ncl			/* Number of clusters in the run */
+)
+{
+	DWORD ecl = clst + ncl - 1, epc, sect, val;
+	BYTE *p;
+	FRESULT res = FR_OK;
+
+
+	if (fs->fs_type == FS_FAT12) {		/* Entries straddle sectors, set one at a time */
+		for ( ; clst < ecl && res == FR_OK; clst++)
+			res = put_fat(fs, clst, clst + 1);
+		if (res == FR_OK) res = put_fat(fs, ecl, 0x0FFFFFFF);
+		return res;
+	}
+
+	epc = SS(fs) / (fs->fs_type == FS_FAT32 ? 4 : 2);	/* FAT entries per sector */
+	while (clst <= ecl) {
+		sect = fs->fatbase + clst / epc;
+		if (clst % epc == 0 && ecl - clst >= epc - 1) {	/* Whole sector is overwritten */
+			if (sect != fs->winsect) {
+				res = sync_window(fs);
+				if (res != FR_OK) break;
+				mem_set(fs->win, 0, SS(fs));
+				fs->winsect = sect;
+			}
+		} else {
+			res = move_window(fs, sect);
+			if (res != FR_OK) break;
+		}
+		do {
+			val = (clst == ecl) ? 0x0FFFFFFF : clst + 1;
+			if (fs->fs_type == FS_FAT32) {
+				p = &fs->win[clst * 4 % SS(fs)];
+				val |= LD_DWORD(p) & 0xF0000000;
+				ST_DWORD(p, val);
+			} else {
+				p = &fs->win[clst * 2 % SS(fs)];
+				ST_WORD(p, (WORD)val);
+			}
+			clst++;
+		} while (clst <= ecl && clst % epc);
+		fs->wflag = 1;
+	}
+
+	return res;
+}
+#endif
+
+
+
+
+/*-----------------------------------------------------------------------*/
+/* FAT handling - Follow or stretch the chain of a growing file          */
+/*-----------------------------------------------------------------------*/
+/* A file that runs off the end of its chain takes a run of free         */
+/* clusters behind the new one, linked in one pass over the FAT window.  */
+/* The run doubles on every stretch up to _FS_EXTENT, so a short file    */
+/* takes one cluster while a log that keeps growing stays contiguous.    */
+/* f_close() gives back the part of the last run the data did not reach. */
+
+#if !_FS_READONLY && _FS_EXTENT
+static
+DWORD stretch_file (	/* 0:No free cluster, 1:Internal error, 0xFFFFFFFF:Disk error, >=2:Next cluster# */
+	FIL* fp,			/* Pointer to the file object */
+	DWORD clst			/* Cluster# the data reached. 0 means the file has no chain. */
+)
+{
+	FATFS *fs = fp->fs;
+	DWORD cs, ncl, n;
+	FRESULT res;
+
+
+	if (clst != 0) {
+		cs = get_fat(fs, clst);			/* Check the cluster status */
+		if (cs < 2) return 1;			/* Invalid value */
+		if (cs == 0xFFFFFFFF) return cs;	/* A disk error occurred */
+		if (cs < fs->n_fatent) return cs;	/* Already followed by a (reserved) cluster */
+	}
+
+	ncl = create_chain(fs, clst);		/* Head of the run, searched as usual */
+	if (ncl < 2 || ncl == 0xFFFFFFFF) return ncl;
+
+	for (n = 1; n < fp->ext_n && ncl + n < fs->n_fatent; n++) {	/* Count free clusters behind it */
+		cs = get_fat(fs, ncl + n);
+		if (cs == 1 || cs == 0xFFFFFFFF) return cs;
+		if (cs != 0) break;
+	}
+	if (n > 1) {
+		res = link_run(fs, ncl, n);		/* Link the run behind the head */
+		if (res != FR_OK) return (res == FR_DISK_ERR) ? 0xFFFFFFFF : 1;
+		fs->last_clust = ncl + n - 1;	/* Update FSINFO */
+		if (fs->free_clust != 0xFFFFFFFF) {
+			fs->free_clust -= n - 1;
+			fs->fsi_flag |= 1;
+		}
+	}
+	if (fp->ext_n < _FS_EXTENT) fp->ext_n *= 2;	/* Still growing, reserve more next time */
+
+	return ncl;
+}
+
+
+
+
+/*-----------------------------------------------------------------------*/
+/* FAT handling - Give back clusters reserved beyond the file data      */
+/*-----------------------------------------------------------------------*/
+
+static
+FRESULT trim_file (
+	FIL* fp			/* Pointer to the file object */
+)
+{
+	FATFS *fs = fp->fs;
+	DWORD clst, nxt, n;
+	FRESULT res;
+
+
+	if (fp->err || fp->ext_n <= 1 || fp->fsize == 0) return FR_OK;	/* Nothing was reserved */
+
+	if (fp->fptr == fp->fsize) {		/* The pointer is on the last data cluster */
+		clst = fp->clust;
+	} else {							/* Walk the chain up to the last data cluster */
+		clst = fp->sclust;
+		for (n = (fp->fsize - 1) / ((DWORD)fs->csize * SS(fs)); n; n--) {
+			clst = get_fat(fs, clst);
+			if (clst == 0xFFFFFFFF) return FR_DISK_ERR;
+			if (clst < 2 || clst >= fs->n_fatent) return FR_INT_ERR;
+		}
+	}
+	nxt = get_fat(fs, clst);
+	if (nxt == 0xFFFFFFFF) return FR_DISK_ERR;
+	if (nxt < 2) return FR_INT_ERR;
+	if (nxt >= fs->n_fatent) return FR_OK;	/* The data fills the chain */
+
+	res = put_fat(fs, clst, 0x0FFFFFFF);	/* Cut the chain after the data */
+	if (res == FR_OK) res = remove_chain(fs, nxt);
+	if (res == FR_OK) fp->flag |= FA__WRITTEN;	/* Have f_sync() flush the FAT */
+
+	return res;
+}
+#endif
+
+
+
+
 /*-----------------------------------------------------------------------*/
 /* FAT handling - Convert offset into cluster with link map table        */
 /*-----------------------------------------------------------------------*/
@@ -1028,6 +1240,99 @@ DWORD clmt_clust (	/* <2:Error, >=2:Cluster number */
 
 
 
+/*-----------------------------------------------------------------------*/
+/* FAT handling - Check if the file data is one run of clusters          */
+/*-----------------------------------------------------------------------*/
+/* Files written once onto free space usually are. FA__CONTIG is set for */
+/* them, after which f_read(), f_write() and f_lseek() get the cluster   */
+/* of an offset as sclust + offset / cluster size without the FAT. The   */
+/* check runs once per open, on the first f_lseek() that walks the chain */
+/* and stops at the first cluster that is out of place.                  */
+
+#if _FS_CONTIG
+static
+FRESULT chk_contig (
+	FIL* fp			/* Pointer to the file object */
+)
+{
+	FATFS *fs = fp->fs;
+	DWORD clst, ncl, nxt;
+
+
+	fp->cchk = 1;
+	if (!fp->sclust || !fp->fsize) return FR_OK;
+	ncl = (fp->fsize - 1) / ((DWORD)fs->csize * SS(fs));	/* Links to check */
+	for (clst = fp->sclust; ncl; ncl--, clst++) {
+		nxt = get_fat(fs, clst);
+		if (nxt == 0xFFFFFFFF) return FR_DISK_ERR;
+		if (nxt != clst + 1) return FR_OK;	/* Fragmented (or broken, left to the chain walk) */
+	}
+	fp->flag |= FA__CONTIG;
+
+	return FR_OK;
+}
+#endif
+
+
+
+
+/*-----------------------------------------------------------------------*/
+/* File access - Run a direct transfer on into adjacent clusters         */
+/*-----------------------------------------------------------------------*/
+/* f_read() and f_write() clip a multi-sector transfer at the end of the */
+/* cluster. While the next cluster of the chain is the physically next   */
+/* one, the transfer carries on into it, so a long aligned read or write */
+/* on a contiguous file is one disk_read()/disk_write() call.            */
+
+static
+UINT follow_run (	/* Number of sectors the transfer is extended by */
+	FIL* fp,		/* Pointer to the file object (clust: last cluster of the transfer) */
+	DWORD ofs,		/* File offset where the transfer leaves the cluster */
+	UINT nsect,		/* Sectors still to transfer after the cluster */
+	BYTE stretch	/* 1: Stretch the chain as f_write() does */
+)
+{
+	FATFS *fs = fp->fs;
+	DWORD clst;
+	UINT n = 0;
+
+#if _FS_READONLY
+	(void)stretch;
+#endif
+
+	while (n < nsect) {
+#if _FS_CONTIG
+		if ((fp->flag & FA__CONTIG) && ofs < fp->fsize)
+			clst = fp->clust + 1;				/* Inside a contiguous file */
+		else
+#endif
+#if _USE_FASTSEEK
+		if (fp->cltbl)
+			clst = clmt_clust(fp, ofs);			/* Get cluster# from the CLMT */
+		else
+#endif
+#if !_FS_READONLY
+		if (stretch)
+#if _FS_EXTENT
+			clst = stretch_file(fp, fp->clust);	/* Follow or stretch cluster chain by a run of clusters */
+#else
+			clst = create_chain(fp->fs, fp->clust);	/* Follow or stretch cluster chain on the FAT */
+#endif
+		else
+#endif
+			clst = get_fat(fs, fp->clust);		/* Follow cluster chain on the FAT */
+		if (clst != fp->clust + 1 || clst >= fs->n_fatent) break;	/* Not adjacent or an error, left to the caller */
+		fp->clust = clst;
+		n += fs->csize;
+		ofs += (DWORD)fs->csize * SS(fs);
+	}
+
+	return (n < nsect) ? n : nsect;
+}
+
+
+
+
 /*-----------------------------------------------------------------------*/
 /* Directory handling - Set directory index                              */
 /*-----------------------------------------------------------------------*/
@@ -2277,9 +2582,21 @@ FRESULT find_volume (	/* FR_OK(0): successful, !=0: any error occurred */
 	if (fs->fsize < (szbfat + (SS(fs) - 1)) / SS(fs))	/* (BPB_FATSz must not be less than the size needed) */
 		return FR_NO_FILESYSTEM;
 
+#ifdef CTRL_CACHE_PIN
+	{	/* Ask the disk layer to keep the first FAT resident */
+		DWORD rt[2];
+		rt[0] = fs->fatbase;
+		rt[1] = fs->fatbase + fs->fsize - 1;
+		disk_ioctl(fs->drv, CTRL_CACHE_PIN, rt);
+	}
+#endif
+
 #if !_FS_READONLY
 	/* Initialize cluster allocation information */
 	fs->last_clust = fs->free_clust = 0xFFFFFFFF;
+#if _FS_FREEMAP
+	fm_init(fs);
+#endif
 
 	/* Get fsinfo if available */
 	fs->fsi_flag = 0x80;
@@ -2523,6 +2840,16 @@ FRESULT f_open (
 			fp->dsect = 0;
 #if _USE_FASTSEEK
 			fp->cltbl = 0;						/* Normal seek mode */
+#endif
+#if !_FS_READONLY && _FS_EXTENT
+			fp->ext_n = 1;						/* No reservation yet */
+#endif
+#if _FS_CONTIG
+			fp->cchk = 0;
+			if (fp->fsize <= (DWORD)dj.fs->csize * SS(dj.fs)) {	/* A single cluster is one run */
+				fp->flag |= FA__CONTIG;
+				fp->cchk = 1;
+			}
 #endif
 			fp->fs = dj.fs;	 					/* Validate file object */
 			fp->id = fp->fs->id;
@@ -2571,6 +2898,11 @@ FRESULT f_read (
 				if (fp->fptr == 0) {			/* On the top of the file? */
 					clst = fp->sclust;			/* Follow from the origin */
 				} else {						/* Middle or end of the file */
+#if _FS_CONTIG
+					if (fp->flag & FA__CONTIG)
+						clst = fp->clust + 1;			/* Inside a contiguous file, no FAT access */
+					else
+#endif
 #if _USE_FASTSEEK
 					if (fp->cltbl)
 						clst = clmt_clust(fp, fp->fptr);	/* Get cluster# from the CLMT */
@@ -2587,8 +2919,10 @@ FRESULT f_read (
 			sect += csect;
 			cc = btr / SS(fp->fs);				/* When remaining bytes >= sector size, */
 			if (cc) {							/* Read maximum contiguous sectors directly */
-				if (csect + cc > fp->fs->csize)	/* Clip at cluster boundary */
-					cc = fp->fs->csize - csect;
+				if (csect + cc > fp->fs->csize) {	/* Clip at cluster boundary */
+					cc = fp->fs->csize - csect;		/* unless the following clusters are adjacent */
+					cc += follow_run(fp, fp->fptr + cc * SS(fp->fs), btr / SS(fp->fs) - cc, 0);
+				}
 				if (disk_read(fp->fs->drv, rbuff, sect, cc) != RES_OK)
 					ABORT(fp->fs, FR_DISK_ERR);
 #if !_FS_READONLY && _FS_MINIMIZE <= 2			/* Replace one of the read sectors with cached data if it contains a dirty sector */
@@ -2672,18 +3006,34 @@ FRESULT f_write (
 				if (fp->fptr == 0) {		/* On the top of the file? */
 					clst = fp->sclust;		/* Follow from the origin */
 					if (clst == 0)			/* When no cluster is allocated, */
+#if _FS_EXTENT
+						clst = stretch_file(fp, 0);	/* Create a new cluster chain with room to grow */
+#else
 						clst = create_chain(fp->fs, 0);	/* Create a new cluster chain */
+#endif
 				} else {					/* Middle or end of the file */
+#if _FS_CONTIG
+					if ((fp->flag & FA__CONTIG) && fp->fptr < fp->fsize)
+						clst = fp->clust + 1;	/* Inside a contiguous file, no FAT access */
+					else
+#endif
 #if _USE_FASTSEEK
 					if (fp->cltbl)
 						clst = clmt_clust(fp, fp->fptr);	/* Get cluster# from the CLMT */
 					else
 #endif
+#if _FS_EXTENT
+						clst = stretch_file(fp, fp->clust);	/* Follow or stretch cluster chain by a run of clusters */
+#else
 						clst = create_chain(fp->fs, fp->clust);	/* Follow or stretch cluster chain on the FAT */
+#endif
 				}
 				if (clst == 0) break;		/* Could not allocate a new cluster (disk full) */
 				if (clst == 1) ABORT(fp->fs, FR_INT_ERR);
 				if (clst == 0xFFFFFFFF) ABORT(fp->fs, FR_DISK_ERR);
+#if _FS_CONTIG
+				if (fp->fptr && clst != fp->clust + 1) fp->flag &= ~FA__CONTIG;	/* The chain left the run */
+#endif
 				fp->clust = clst;			/* Update current cluster */
 				if (fp->sclust == 0) fp->sclust = clst;	/* Set start cluster if the first write */
 			}
@@ -2702,8 +3052,10 @@ FRESULT f_write (
 			sect += csect;
 			cc = btw / SS(fp->fs);			/* When remaining bytes >= sector size, */
 			if (cc) {						/* Write maximum contiguous sectors directly */
-				if (csect + cc > fp->fs->csize)	/* Clip at cluster boundary */
-					cc = fp->fs->csize - csect;
+				if (csect + cc > fp->fs->csize) {	/* Clip at cluster boundary */
+					cc = fp->fs->csize - csect;	/* unless the following clusters are adjacent */
+					cc += follow_run(fp, fp->fptr + cc * SS(fp->fs), btw / SS(fp->fs) - cc, 1);
+				}
 				if (disk_write(fp->fs->drv, wbuff, sect, cc) != RES_OK)
 					ABORT(fp->fs, FR_DISK_ERR);
 #if _FS_MINIMIZE <= 2
@@ -2819,7 +3171,17 @@ FRESULT f_close (
 
 
 #if !_FS_READONLY
-	res = f_sync(fp);					/* Flush cached data */
+#if _FS_EXTENT
+	res = validate(fp);					/* Lock volume */
+	if (res == FR_OK) {
+		res = trim_file(fp);			/* Give back the unused tail of the last reservation */
+#if _FS_REENTRANT
+		unlock_fs(fp->fs, res);
+#endif
+	}
+	if (res == FR_OK)
+#endif
+		res = f_sync(fp);				/* Flush cached data */
 	if (res == FR_OK)
 #endif
 	{
@@ -3067,6 +3429,18 @@ FRESULT f_lseek (
 		fp->fptr = nsect = 0;
 		if (ofs) {
 			bcs = (DWORD)fp->fs->csize * SS(fp->fs);	/* Cluster size (byte) */
+#if _FS_CONTIG
+			if (!fp->cchk && ofs > bcs) {				/* First seek that walks the chain, */
+				res = chk_contig(fp);					/* see if there is a chain to walk */
+				if (res != FR_OK) ABORT(fp->fs, res);
+			}
+			if ((fp->flag & FA__CONTIG) && fp->sclust && ofs <= fp->fsize) {	/* When the file is one run, */
+				fp->fptr = (ofs - 1) & ~(bcs - 1);		/* go to the cluster directly */
+				ofs -= fp->fptr;
+				clst = fp->sclust + fp->fptr / bcs;
+				fp->clust = clst;
+			} else
+#endif
 			if (ifptr > 0 &&
 				(ofs - 1) / bcs >= (ifptr - 1) / bcs) {	/* When seek to same or following cluster, */
 				fp->fptr = (ifptr - 1) & ~(bcs - 1);	/* start from the current cluster */
@@ -3092,6 +3466,9 @@ FRESULT f_lseek (
 						if (clst == 0) {				/* When disk gets full, clip file size */
 							ofs = bcs; break;
 						}
+#if _FS_CONTIG
+						if (clst != fp->clust + 1) fp->flag &= ~FA__CONTIG;	/* The chain left the run */
+#endif
 					} else
 #endif
 						clst = get_fat(fp->fs, clst);	/* Follow cluster chain if not in write mode */
@@ -3449,6 +3826,9 @@ FRESULT f_truncate (
 			if (fp->fptr == 0) {	/* When set file size to zero, remove entire cluster chain */
 				res = remove_chain(fp->fs, fp->sclust);
 				fp->sclust = 0;
+#if _FS_CONTIG
+				fp->flag |= FA__CONTIG;	/* An empty file is one run */
+#endif
 			} else {				/* When truncate a part of the file, remove remaining clusters */
 				ncl = get_fat(fp->fs, fp->clust);
 				res = FR_OK;
@@ -3476,6 +3856,84 @@ FRESULT f_truncate (
 
 
 
+#if _USE_EXPAND
+/*-----------------------------------------------------------------------*/
+/* Allocate a Contiguous Cluster Run to an Empty File                    */
+/*-----------------------------------------------------------------------*/
+/* The run is found in one pass over the FAT, linked with whole-sector   */
+/* updates and the file size is set to fsz. The file is then flagged     */
+/* contiguous, so f_write() gets its next cluster without the FAT.       */
+
+FRESULT f_expand (
+	FIL* fp,		/* Pointer to the file object */
+	DWORD fsz		/* File size to allocate (byte) */
+)
+{
+	FRESULT res;
+	FATFS *fs;
+	DWORD bcs, tcl, stcl, scl, clst, ncl, cs;
+
+
+	res = validate(fp);						/* Check validity of the object */
+	if (res != FR_OK) LEAVE_FF(fp->fs, res);
+	if (fp->err)							/* Check error */
+		LEAVE_FF(fp->fs, (FRESULT)fp->err);
+	if (fsz == 0 || fp->fsize != 0 || fp->sclust != 0 || !(fp->flag & FA_WRITE))
+		LEAVE_FF(fp->fs, FR_DENIED);		/* Only an empty file opened for writing */
+
+	fs = fp->fs;
+	bcs = (DWORD)fs->csize * SS(fs);		/* Cluster size (byte) */
+	tcl = fsz / bcs + ((fsz % bcs) ? 1 : 0);	/* Number of clusters required */
+	if (tcl > fs->n_fatent - 2) LEAVE_FF(fs, FR_DENIED);
+
+	stcl = fs->last_clust + 1;				/* Search from the last allocation on */
+	if (stcl < 2 || stcl >= fs->n_fatent) stcl = 2;
+	scl = clst = stcl; ncl = 0;
+	for (;;) {								/* Find tcl free clusters in a row */
+#if _FS_FREEMAP
+		if (!FM_BIT(fs, clst >> fs->fm_shift)) {	/* Known to be full, skip the block */
+			cs = ((clst >> fs->fm_shift) + 1) << fs->fm_shift;
+			if (stcl > clst && stcl <= cs) { res = FR_DENIED; break; }
+			clst = cs;
+			ncl = 0;
+		} else
+#endif
+		{
+			cs = get_fat(fs, clst);
+			if (cs == 1) { res = FR_INT_ERR; break; }
+			if (cs == 0xFFFFFFFF) { res = FR_DISK_ERR; break; }
+			if (cs != 0) ncl = 0;			/* Not a free cluster, the run starts over */
+			else if (ncl++ == 0) scl = clst;
+			if (ncl == tcl) break;			/* Found */
+			clst++;
+		}
+		if (clst >= fs->n_fatent) {			/* Wrap around, a run cannot cross the end */
+			if (stcl == 2) { res = FR_DENIED; break; }
+			clst = 2; ncl = 0;
+		}
+		if (clst == stcl) { res = FR_DENIED; break; }	/* No room for the run */
+	}
+
+	if (res == FR_OK) res = link_run(fs, scl, tcl);
+	if (res == FR_OK) {
+		fs->last_clust = scl + tcl - 1;		/* Update FSINFO */
+		if (fs->free_clust != 0xFFFFFFFF) {
+			fs->free_clust -= tcl;
+			fs->fsi_flag |= 1;
+		}
+		fp->sclust = scl;
+		fp->fsize = fsz;
+		fp->flag |= FA__WRITTEN | FA__CONTIG;
+	} else if (res != FR_DENIED) {
+		fp->err = (FRESULT)res;
+	}
+
+	LEAVE_FF(fs, res);
+}
+#endif
+
+
+
 
 /*-----------------------------------------------------------------------*/
 /* Delete a File or Directory                                            */
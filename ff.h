@@ -29,6 +29,22 @@ extern "C" {
 #error Wrong configuration file (ffconf.h).
 #endif
 
+#ifndef _FS_FREEMAP
+#define _FS_FREEMAP	512	/* Bytes per volume for the free cluster map used by create_chain() (0:Disable) */
+#endif
+
+#ifndef _FS_EXTENT
+#define _FS_EXTENT	64	/* Largest run of clusters f_write() reserves ahead of a growing file (0:Disable) */
+#endif
+
+#ifndef _USE_EXPAND
+#define _USE_EXPAND	1	/* 1: Enable f_expand() to allocate a contiguous file up front */
+#endif
+
+#ifndef _FS_CONTIG
+#define _FS_CONTIG	1	/* 1: Map offsets of files stored in one cluster run without the FAT */
+#endif
+
 
 
 /* Definitions of volume management */
@@ -93,6 +109,10 @@ typedef struct {
 #if !_FS_READONLY
 	DWORD	last_clust;		/* Last allocated cluster */
 	DWORD	free_clust;		/* Number of free clusters */
+#if _FS_FREEMAP
+	BYTE	fm_shift;		/* Each free map bit covers 1 << fm_shift clusters */
+	BYTE	freemap[_FS_FREEMAP];	/* Free map (bit clear: no free cluster in the block) */
+#endif
 #endif
 #if _FS_RPATH
 	DWORD	cdir;			/* Current directory start cluster (0:root) */
@@ -128,6 +148,12 @@ typedef struct {
 #if _USE_FASTSEEK
 	DWORD*	cltbl;			/* Pointer to the cluster link map table (Nulled on file open) */
 #endif
+#if !_FS_READONLY && _FS_EXTENT
+	DWORD	ext_n;			/* Clusters the next reservation takes (1 on file open) */
+#endif
+#if _FS_CONTIG
+	BYTE	cchk;			/* Contiguity of the chain checked since file open */
+#endif
 #if _FS_LOCK
 	UINT	lockid;			/* File lock ID origin from 1 (index of file semaphore table Files[]) */
 #endif
@@ -216,6 +242,7 @@ FRESULT f_write (FIL* fp, const void* buff, UINT btw, UINT* bw);	/* Write data t
 FRESULT f_forward (FIL* fp, UINT(*func)(const BYTE*,UINT), UINT btf, UINT* bf);	/* Forward data to the stream */
 FRESULT f_lseek (FIL* fp, DWORD ofs);								/* Move file pointer of a file object */
 FRESULT f_truncate (FIL* fp);										/* Truncate file */
+FRESULT f_expand (FIL* fp, DWORD fsz);								/* Allocate a contiguous cluster run to an empty file */
 FRESULT f_sync (FIL* fp);											/* Flush cached data of a writing file */
 FRESULT f_opendir (DIR* dp, const TCHAR* path);						/* Open a directory */
 FRESULT f_closedir (DIR* dp);										/* Close an open directory */
@@ -302,6 +329,7 @@ int ff_del_syncobj (_SYNC_t sobj);				/* Delete a sync object */
 #define FA__WRITTEN			0x20
 #define FA__DIRTY			0x40
 #endif
+#define FA__CONTIG			0x80	/* Clusters up to the file size are one run from sclust */
 
 
 /* FAT sub type (FATFS.fs_type) */
@@ -0,0 +1,2 @@
+/* Host shim: sd.c and diskio.c include the card driver header as "SD.h" */
+#include "../sd.h"
@@ -0,0 +1,81 @@
+/*---------------------------------------------------------------------------/
+/  FatFs - FAT file system module configuration file  R0.11 (C)ChaN, 2015
+/---------------------------------------------------------------------------/
+/  Host build configuration. The options marked overridable can be set
+/  with -D, so the same sources also build the read-only and fast seek
+/  free variants.
+/---------------------------------------------------------------------------*/
+
+#define _FFCONF 32020	/* Revision ID */
+
+/*---------------------------------------------------------------------------/
+/ Functions and Buffer Configurations
+/---------------------------------------------------------------------------*/
+
+#ifndef _FS_TINY
+#define	_FS_TINY		0	/* 0:Normal or 1:Tiny (overridable) */
+#endif
+
+#ifndef _FS_READONLY
+#define _FS_READONLY	0	/* 0:Read/Write or 1:Read only (overridable) */
+#endif
+
+#define _FS_MINIMIZE	0	/* 0 to 3 */
+#define	_USE_STRFUNC	1	/* 0:Disable or 1-2:Enable */
+#define _USE_FIND		0	/* 0:Disable or 1:Enable */
+
+#ifndef _USE_MKFS
+#define	_USE_MKFS		1	/* 0:Disable or 1:Enable (overridable) */
+#endif
+
+#ifndef _USE_FASTSEEK
+#define	_USE_FASTSEEK	1	/* 0:Disable or 1:Enable (overridable) */
+#endif
+
+#define _USE_LABEL		0	/* 0:Disable or 1:Enable */
+#define	_USE_FORWARD	0	/* 0:Disable or 1:Enable */
+
+
+/*---------------------------------------------------------------------------/
+/ Locale and Namespace Configurations
+/---------------------------------------------------------------------------*/
+
+#define _CODE_PAGE	437
+#define	_USE_LFN	0		/* 0 to 3 */
+#define	_MAX_LFN	255		/* Maximum LFN length to handle (12 to 255) */
+#define	_LFN_UNICODE	0	/* 0:ANSI/OEM or 1:Unicode */
+#define _STRF_ENCODE	3	/* 0:ANSI/OEM, 1:UTF-16LE, 2:UTF-16BE, 3:UTF-8 */
+#define _FS_RPATH	0		/* 0 to 2 */
+
+
+/*---------------------------------------------------------------------------/
+/ Drive/Volume Configurations
+/---------------------------------------------------------------------------*/
+
+#define _VOLUMES	3		/* Number of volumes (logical drives) to be used */
+#define _STR_VOLUME_ID	0	/* 0:Use only 0-9 for drive ID, 1:Use strings for drive ID */
+#define _VOLUME_STRS	"SD","SD2","RAM"
+#define	_MULTI_PARTITION	0	/* 0:Single partition, 1:Enable multiple partition */
+#define	_MIN_SS		512
+#define	_MAX_SS		512
+
+#ifndef _USE_TRIM
+#define	_USE_TRIM	1		/* 0:Disable or 1:Enable (overridable) */
+#endif
+
+#define _FS_NOFSINFO	0	/* 0 to 3 */
+
+
+/*---------------------------------------------------------------------------/
+/ System Configurations
+/---------------------------------------------------------------------------*/
+
+#define _FS_NORTC	0		/* get_fattime() comes from the host clock */
+#define _NORTC_MON	1
+#define _NORTC_MDAY	1
+#define _NORTC_YEAR	2015
+#define	_FS_LOCK	0		/* 0:Disable or >=1:Enable */
+#define _FS_REENTRANT	0	/* 0:Disable or 1:Enable */
+#define _FS_TIMEOUT		1000
+#define	_SYNC_t			HANDLE
+#define _WORD_ACCESS	0	/* 0 or 1 */
@@ -0,0 +1,481 @@
+/*-----------------------------------------------------------------------*/
+/* Allocation and transfer counts on the host image backend              */
+/*-----------------------------------------------------------------------*/
+/* Each scenario formats a fresh image, runs one workload and prints the */
+/* fragments, clusters and disk requests it cost, as counted by          */
+/* diskhost.c, then reads the data back to check it. The counts do not   */
+/* depend on the host, so they can be compared across builds, e.g.       */
+/* make -B bench BENCH_FLAGS=-D_FS_EXTENT=0 for the allocator without    */
+/* run reservation.                                                      */
+/*                                                                       */
+/*   fsbench [scenario ...]      (all scenarios when none is given)      */
+/*-----------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include "ff.h"
+#include "diskhost.h"
+
+/* FatFs hidden API, used to walk the chains */
+DWORD get_fat (FATFS* fs, DWORD clst);
+
+static const char* Image = "fsbench.img";
+static FATFS Fs;
+static BYTE Buf[128 * 1024], Ref[128 * 1024];
+static int Bad;
+
+
+static void fail (const char* what, int res)
+{
+	printf("FAIL: %s (%d)\n", what, res);
+	exit(1);
+}
+
+
+static void chk (FRESULT res, const char* what)
+{
+	if (res != FR_OK) fail(what, res);
+}
+
+
+/* Pattern for offset ofs of the file with the given seed */
+static void fill (BYTE* p, DWORD ofs, UINT len, int seed)
+{
+	UINT i;
+
+	for (i = 0; i < len; i++) p[i] = (BYTE)((ofs + i) * 7 + seed + ((ofs + i) >> 9));
+}
+
+
+/* Create and format an image of mb megabytes with clusters of au bytes */
+static void format (DWORD mb, UINT au)
+{
+	int fd;
+
+	fd = open(Image, O_RDWR | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0 || ftruncate(fd, (off_t)mb << 20) != 0) fail("create image", 0);
+	close(fd);
+	if (disk_host_open(0, Image, DISK_HOST_MMAP) != RES_OK) fail("disk_host_open", 0);
+	chk(f_mount(&Fs, "", 0), "f_mount");
+	chk(f_mkfs("", 0, au), "f_mkfs");
+	chk(f_mount(&Fs, "", 1), "f_mount");
+}
+
+
+static void remount (void)
+{
+	chk(f_mount(0, "", 0), "unmount");
+	chk(f_mount(&Fs, "", 1), "remount");
+}
+
+
+static void finish (void)
+{
+	f_mount(0, "", 0);
+	disk_host_close(0);
+	unlink(Image);
+}
+
+
+static DWORD free_clusters (void)
+{
+	FATFS *fs;
+	DWORD n;
+
+	chk(f_getfree("", &n, &fs), "f_getfree");
+	return n;
+}
+
+
+/* Number of cluster runs the file is stored in, *ncl its cluster count */
+static DWORD fragments (const char* name, DWORD* ncl)
+{
+	FIL f;
+	DWORD cl, nxt, frags = 0;
+
+	*ncl = 0;
+	chk(f_open(&f, name, FA_READ), "open for fragments");
+	for (cl = f.sclust; cl >= 2 && cl < Fs.n_fatent; cl = nxt) {
+		nxt = get_fat(&Fs, cl);
+		(*ncl)++;
+		if (nxt != cl + 1) frags++;
+	}
+	f_close(&f);
+	return frags;
+}
+
+
+/* Read the whole file in chunks of len bytes and compare it with the pattern */
+static DWORD read_check (const char* name, UINT len, int seed)
+{
+	FIL f;
+	DWORD ofs;
+	UINT br;
+
+	chk(f_open(&f, name, FA_READ), "open for read");
+	for (ofs = 0; ; ofs += br) {
+		chk(f_read(&f, Buf, len, &br), "f_read");
+		if (!br) break;
+		fill(Ref, ofs, br, seed);
+		if (memcmp(Buf, Ref, br)) Bad++;
+	}
+	if (ofs != f.fsize) Bad++;
+	f_close(&f);
+	return ofs;
+}
+
+
+
+/*-----------------------------------------------------------------------*/
+/* interleave: writers growing their files in turn                       */
+/*-----------------------------------------------------------------------*/
+/* Three files on FAT16 with 1 KB clusters get 700 bytes each in turn,   */
+/* the third stops early and the second is closed with its pointer away  */
+/* from the end. Each file should end up in few runs and the volume      */
+/* should lose exactly the clusters the files hold.                      */
+
+static void bench_interleave (void)
+{
+	static const char* name[3] = { "A.DAT", "B.DAT", "C.DAT" };
+	FIL f[3];
+	DWORD size[3] = { 0 }, fre0, fre, ncl, total = 0, frags, r;
+	UINT bw;
+	int i;
+
+	format(16, 1024);
+	fre0 = free_clusters();
+	for (i = 0; i < 3; i++) chk(f_open(&f[i], name[i], FA_WRITE | FA_CREATE_ALWAYS), "f_open");
+
+	for (r = 0; r < 3000; r++) {
+		for (i = 0; i < 3; i++) {
+			if (i == 2 && r > 200) continue;
+			fill(Buf, size[i], 700, i);
+			chk(f_write(&f[i], Buf, 700, &bw), "f_write");
+			if (bw != 700) fail("short write", (int)bw);
+			size[i] += 700;
+			if (r == 1500 && i == 0) chk(f_sync(&f[0]), "f_sync");
+		}
+	}
+	chk(f_lseek(&f[1], 1000), "f_lseek");	/* Closed away from the end */
+	for (i = 0; i < 3; i++) chk(f_close(&f[i]), "f_close");
+
+	remount();
+	fre = free_clusters();
+	for (i = 0; i < 3; i++) {
+		frags = fragments(name[i], &ncl);
+		total += ncl;
+		printf("interleave: %s %lu bytes, %lu clusters in %lu fragments\n", name[i],
+			(unsigned long)size[i], (unsigned long)ncl, (unsigned long)frags);
+		if (ncl != (size[i] + 1023) / 1024) Bad++;
+		if (read_check(name[i], 700, i) != size[i]) Bad++;
+	}
+	printf("interleave: %lu clusters used, %lu held by the files\n",
+		(unsigned long)(fre0 - fre), (unsigned long)total);
+	if (fre0 - fre != total) Bad++;
+	finish();
+}
+
+
+
+/*-----------------------------------------------------------------------*/
+/* expand: a recording allocated up front in fragmented free space       */
+/*-----------------------------------------------------------------------*/
+/* Small files are created and every other one deleted, then f_expand()  */
+/* allocates a quarter of the volume and the file is written in 4 KB     */
+/* chunks. The file should be one fragment, the writes should not read   */
+/* the FAT more than once and an expansion that does not fit should be   */
+/* denied without touching the small files.                              */
+
+#if _USE_EXPAND
+static void expand_volume (DWORD mb, UINT au)
+{
+	static const char* type[] = { "", "FAT12", "FAT16", "FAT32" };
+	FIL f;
+	DWORD size, ofs, fre0, fre, ncl, frags, rd;
+	UINT bw, br, len;
+	int i, contig;
+	char name[8];
+
+	format(mb, au);
+	for (i = 0; i < 60; i++) {
+		sprintf(name, "S%02d", i);
+		chk(f_open(&f, name, FA_WRITE | FA_CREATE_ALWAYS), "f_open");
+		fill(Buf, 0, au * 2, i);
+		chk(f_write(&f, Buf, au * 2, &bw), "f_write");
+		chk(f_close(&f), "f_close");
+	}
+	for (i = 0; i < 60; i += 2) {
+		sprintf(name, "S%02d", i);
+		chk(f_unlink(name), "f_unlink");
+	}
+	fre0 = free_clusters();
+
+	size = (mb / 4 << 20) + 1000;
+	chk(f_open(&f, "REC.DAT", FA_WRITE | FA_CREATE_ALWAYS), "f_open");
+	chk(f_expand(&f, size), "f_expand");
+	if (f_expand(&f, size) == FR_OK) Bad++;	/* Only an empty file can be expanded */
+	disk_host_clear_stats(0);
+	for (ofs = 0; ofs < size; ofs += len) {
+		len = size - ofs < 4096 ? size - ofs : 4096;
+		fill(Buf, ofs, len, 60);
+		chk(f_write(&f, Buf, len, &bw), "f_write");
+		if (bw != len) fail("short write", (int)bw);
+	}
+	rd = disk_host_stats(0)->sectors_read;
+	contig = (f.flag & FA__CONTIG) != 0;
+	fill(Buf, size, 10000, 60);		/* Grow it past the expanded size */
+	chk(f_write(&f, Buf, 10000, &bw), "f_write");
+	size += 10000;
+	chk(f_close(&f), "f_close");
+
+	remount();
+	fre = free_clusters();
+	frags = fragments("REC.DAT", &ncl);
+	printf("expand: %s %lu bytes, %lu sectors read while writing, %lu clusters in %lu fragments\n",
+		type[Fs.fs_type], (unsigned long)size, (unsigned long)rd, (unsigned long)ncl, (unsigned long)frags);
+	if (Fs.fs_type != (mb < 8 ? FS_FAT12 : mb < 32 ? FS_FAT16 : FS_FAT32)) Bad++;
+	if (!contig || rd > 1) Bad++;
+	if (fre0 - fre != ncl || ncl != (size + au - 1) / au) Bad++;
+	if (read_check("REC.DAT", 4096, 60) != size) Bad++;
+
+	chk(f_open(&f, "BIG.DAT", FA_WRITE | FA_CREATE_ALWAYS), "f_open");
+	if (f_expand(&f, fre * au) != FR_DENIED) Bad++;	/* Free space is not in one run */
+	chk(f_close(&f), "f_close");
+	for (i = 1; i < 60; i += 2) {
+		sprintf(name, "S%02d", i);
+		chk(f_open(&f, name, FA_READ), "f_open");
+		chk(f_read(&f, Buf, au * 2, &br), "f_read");
+		fill(Ref, 0, au * 2, i);
+		if (br != au * 2 || memcmp(Buf, Ref, br)) Bad++;
+		f_close(&f);
+	}
+	finish();
+}
+
+
+static void bench_expand (void)
+{
+	expand_volume(4, 1024);
+	expand_volume(16, 1024);
+	expand_volume(64, 512);
+}
+#endif
+
+
+
+/*-----------------------------------------------------------------------*/
+/* coalesce: large transfers across adjacent clusters                    */
+/*-----------------------------------------------------------------------*/
+/* On FAT16 with 1 KB clusters, a 4 MB file is written in 64 KB chunks   */
+/* and two files are grown in turn by 40000 bytes. Reading them back in  */
+/* 64 KB chunks should cost a few disk requests per chunk rather than    */
+/* one per cluster. Unaligned, fast-seek and overwriting transfers are   */
+/* checked for the data only.                                            */
+
+static void bench_coalesce (void)
+{
+	static const char* name[3] = { "REC.DAT", "X.DAT", "Y.DAT" };
+#if _USE_FASTSEEK
+	static DWORD tbl[256];
+#endif
+	FIL f, g;
+	DWORD ofs, size;
+	UINT bw, br;
+	int i, t;
+
+	format(16, 1024);
+	size = 4UL << 20;
+	chk(f_open(&f, name[0], FA_WRITE | FA_CREATE_ALWAYS), "f_open");
+#if _USE_EXPAND
+	chk(f_expand(&f, size), "f_expand");
+#endif
+	disk_host_clear_stats(0);
+	for (ofs = 0; ofs < size; ofs += 65536) {
+		fill(Buf, ofs, 65536, 0);
+		chk(f_write(&f, Buf, 65536, &bw), "f_write");
+	}
+	printf("coalesce: %s written in %lu disk writes\n", name[0], (unsigned long)disk_host_stats(0)->writes);
+	chk(f_close(&f), "f_close");
+
+	chk(f_open(&f, name[1], FA_WRITE | FA_CREATE_ALWAYS), "f_open");
+	chk(f_open(&g, name[2], FA_WRITE | FA_CREATE_ALWAYS), "f_open");
+	disk_host_clear_stats(0);
+	for (ofs = 0; ofs < 2UL << 20; ofs += 40000) {
+		fill(Buf, ofs, 40000, 1);
+		chk(f_write(&f, Buf, 40000, &bw), "f_write");
+		fill(Buf, ofs, 40000, 2);
+		chk(f_write(&g, Buf, 40000, &bw), "f_write");
+	}
+	printf("coalesce: %s and %s grown in turn in %lu disk writes\n", name[1], name[2],
+		(unsigned long)disk_host_stats(0)->writes);
+	chk(f_close(&f), "f_close");
+	chk(f_close(&g), "f_close");
+
+	remount();
+	for (i = 0; i < 3; i++) {
+		disk_host_clear_stats(0);
+		size = read_check(name[i], 65536, i);
+		printf("coalesce: %s %lu bytes read in %lu disk reads\n", name[i],
+			(unsigned long)size, (unsigned long)disk_host_stats(0)->reads);
+
+		chk(f_open(&f, name[i], FA_READ), "f_open");
+		for (t = 0; t < 50; t++) {		/* Unaligned reads */
+			ofs = (DWORD)t * 7919 * 131 % (f.fsize - 30000);
+			chk(f_lseek(&f, ofs), "f_lseek");
+			chk(f_read(&f, Buf, 30000, &br), "f_read");
+			fill(Ref, ofs, 30000, i);
+			if (br != 30000 || memcmp(Buf, Ref, br)) Bad++;
+		}
+#if _USE_FASTSEEK
+		f.cltbl = tbl;
+		tbl[0] = sizeof tbl / sizeof tbl[0];
+		chk(f_lseek(&f, CREATE_LINKMAP), "create link map");
+		for (t = 0; t < 50; t++) {		/* Reads through the link map */
+			ofs = (DWORD)t * 104729 % (f.fsize - 60000);
+			chk(f_lseek(&f, ofs), "f_lseek");
+			chk(f_read(&f, Buf, 60000, &br), "f_read");
+			fill(Ref, ofs, 60000, i);
+			if (br != 60000 || memcmp(Buf, Ref, br)) Bad++;
+		}
+#endif
+		f_close(&f);
+	}
+
+	chk(f_open(&f, name[1], FA_WRITE), "f_open");	/* Overwrite off the cluster grid */
+	size = f.fsize;
+	chk(f_lseek(&f, 5120), "f_lseek");
+	fill(Buf, 5120, 65536, 1);
+	chk(f_write(&f, Buf, 65536, &bw), "f_write");
+	chk(f_close(&f), "f_close");
+	if (read_check(name[1], 65536, 1) != size) Bad++;
+	finish();
+}
+
+
+
+/*-----------------------------------------------------------------------*/
+/* seek: random reads from contiguous and fragmented files               */
+/*-----------------------------------------------------------------------*/
+/* On FAT32 with 512 byte clusters, an 8 MB log is written in one run    */
+/* and two files are grown in turn by 1000 bytes. After a remount each   */
+/* file gets 200 random 5000 byte reads, which cost about 2000 sectors   */
+/* of data plus whatever it takes to find the clusters. Overwriting,     */
+/* appending and truncating are checked for the data only.               */
+
+static void bench_seek (void)
+{
+	static const char* name[3] = { "LOG.DAT", "P.DAT", "Q.DAT" };
+	FIL f, g;
+	DWORD ofs, size;
+	UINT bw, br, len;
+	int i, t;
+
+	format(64, 512);
+	size = (8UL << 20) + 777;
+	chk(f_open(&f, name[0], FA_WRITE | FA_CREATE_ALWAYS), "f_open");
+	for (ofs = 0; ofs < size; ofs += len) {
+		len = size - ofs < 65536 ? size - ofs : 65536;
+		fill(Buf, ofs, len, 0);
+		chk(f_write(&f, Buf, len, &bw), "f_write");
+	}
+	chk(f_close(&f), "f_close");
+	chk(f_open(&f, name[1], FA_WRITE | FA_CREATE_ALWAYS), "f_open");
+	chk(f_open(&g, name[2], FA_WRITE | FA_CREATE_ALWAYS), "f_open");
+	for (ofs = 0; ofs < 1UL << 20; ofs += 1000) {
+		fill(Buf, ofs, 1000, 1);
+		chk(f_write(&f, Buf, 1000, &bw), "f_write");
+		fill(Buf, ofs, 1000, 2);
+		chk(f_write(&g, Buf, 1000, &bw), "f_write");
+	}
+	chk(f_close(&f), "f_close");
+	chk(f_close(&g), "f_close");
+
+	remount();
+	for (i = 0; i < 3; i++) {
+		chk(f_open(&f, name[i], FA_READ), "f_open");
+		disk_host_clear_stats(0);
+		for (t = 0; t < 200; t++) {
+			ofs = (DWORD)((t * 2654435761u) % (f.fsize - 5000));
+			chk(f_lseek(&f, ofs), "f_lseek");
+			chk(f_read(&f, Buf, 5000, &br), "f_read");
+			fill(Ref, ofs, 5000, i);
+			if (br != 5000 || memcmp(Buf, Ref, br)) Bad++;
+		}
+		printf("seek: %s %lu bytes, 200 random reads took %lu sectors\n", name[i],
+			(unsigned long)f.fsize, (unsigned long)disk_host_stats(0)->sectors_read);
+		f_close(&f);
+	}
+
+	chk(f_open(&f, name[0], FA_READ | FA_WRITE), "f_open");
+	chk(f_lseek(&f, 3000000), "f_lseek");		/* Overwrite in the middle */
+	fill(Buf, 3000000, 70000, 0);
+	chk(f_write(&f, Buf, 70000, &bw), "f_write");
+	size = f.fsize;
+	chk(f_lseek(&f, size), "f_lseek");		/* Append */
+	fill(Buf, size, 100000, 0);
+	chk(f_write(&f, Buf, 100000, &bw), "f_write");
+	size += 100000;
+	chk(f_lseek(&f, 5000000), "f_lseek");		/* Read back after the append */
+	chk(f_read(&f, Buf, 1000, &br), "f_read");
+	fill(Ref, 5000000, 1000, 0);
+	if (br != 1000 || memcmp(Buf, Ref, br)) Bad++;
+	chk(f_close(&f), "f_close");
+	if (read_check(name[0], 65536, 0) != size) Bad++;
+
+	chk(f_open(&f, name[1], FA_READ | FA_WRITE), "f_open");
+	chk(f_lseek(&f, 500000), "f_lseek");
+	chk(f_truncate(&f), "f_truncate");
+	chk(f_lseek(&f, 0), "f_lseek");
+	chk(f_truncate(&f), "f_truncate");
+	fill(Buf, 0, 65536, 1);			/* Rewrite it from empty */
+	chk(f_write(&f, Buf, 65536, &bw), "f_write");
+	chk(f_lseek(&f, 30000), "f_lseek");
+	chk(f_read(&f, Buf, 1000, &br), "f_read");
+	fill(Ref, 30000, 1000, 1);
+	if (br != 1000 || memcmp(Buf, Ref, br)) Bad++;
+	chk(f_close(&f), "f_close");
+	if (read_check(name[1], 65536, 1) != 65536) Bad++;
+	finish();
+}
+
+
+
+/*-----------------------------------------------------------------------*/
+/* Scenario table                                                        */
+/*-----------------------------------------------------------------------*/
+
+typedef struct {
+	const char* name;
+	void (*run)(void);
+} SCENARIO;
+
+static const SCENARIO Scenario[] = {
+	{ "interleave", bench_interleave },
+#if _USE_EXPAND
+	{ "expand", bench_expand },
+#endif
+	{ "coalesce", bench_coalesce },
+	{ "seek", bench_seek }
+};
+
+#define NSCENARIOS	(sizeof Scenario / sizeof Scenario[0])
+
+
+int main (int argc, char* argv[])
+{
+	unsigned i;
+	int a;
+
+	for (i = 0; i < NSCENARIOS; i++) {
+		for (a = 1; a < argc && strcmp(argv[a], Scenario[i].name); a++) ;
+		if (argc == 1 || a < argc) Scenario[i].run();
+	}
+	if (Bad) {
+		printf("FAIL: %d mismatches\n", Bad);
+		return 1;
+	}
+	return 0;
+}
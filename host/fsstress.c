@@ -0,0 +1,393 @@
+/*-----------------------------------------------------------------------*/
+/* Randomized file system check on the host image backend                */
+/*-----------------------------------------------------------------------*/
+/* Formats a FAT12, a FAT16 and a FAT32 image and runs a random mix of   */
+/* open/create, f_expand, write, read, seek (also past the end), truncate*/
+/* sync and close on a few files, checking every read against a shadow   */
+/* copy of the data. Whenever all files are closed, and at the end, the  */
+/* FAT is walked: each chain must be exactly as long as its file, no     */
+/* cluster may sit in two chains or in none, and f_getfree() must agree  */
+/* with a count of the free entries. After a remount every file is read  */
+/* back whole and at random offsets through fast seek.                   */
+/*                                                                       */
+/*   fsstress [seed [operations [image]]]                                */
+/*-----------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include "ff.h"
+#include "diskhost.h"
+
+/* FatFs hidden API, used to walk the chains */
+DWORD get_fat (FATFS* fs, DWORD clst);
+
+#define NFILES		4		/* Files the random operations act on */
+#define NBALLAST	12		/* Small files left between them so free space is fragmented */
+#define XFER_MAX	(64 * 1024)
+
+typedef struct {
+	const char*	name;
+	DWORD		mb;			/* Image size */
+	UINT		au;			/* Cluster size passed to f_mkfs() */
+	BYTE		fs_type;	/* Type the format must come out as */
+} VOLCFG;
+
+static const VOLCFG Vol[] = {
+	{ "FAT12",  2, 1024, FS_FAT12 },
+	{ "FAT16", 16, 1024, FS_FAT16 },
+	{ "FAT32", 64,  512, FS_FAT32 }
+};
+
+typedef struct {
+	char	name[13];
+	FIL		fil;
+	BYTE	open;
+	BYTE	exists;
+	DWORD	size;			/* Expected file size */
+	BYTE*	shadow;			/* Expected contents */
+} TFILE;
+
+static FATFS Fs;
+static TFILE File[NFILES + NBALLAST];
+static DWORD MaxSize;		/* Largest size a file may grow to on this volume */
+static BYTE Buf[XFER_MAX], RBuf[XFER_MAX];
+static DWORD Seed;
+static unsigned long Op;
+
+
+static DWORD rnd (void)
+{
+	Seed = Seed * 1103515245 + 12345;
+	return Seed >> 8;
+}
+
+
+static void fail (const char* what, int res)
+{
+	printf("FAIL op %lu: %s (%d)\n", Op, what, res);
+	exit(1);
+}
+
+
+static void chk (FRESULT res, const char* what)
+{
+	if (res != FR_OK) fail(what, res);
+}
+
+
+
+/*-----------------------------------------------------------------------*/
+/* FAT consistency                                                       */
+/*-----------------------------------------------------------------------*/
+
+static void fat_check (void)
+{
+	DWORD n = Fs.n_fatent, bcs = (DWORD)Fs.csize * 512;
+	DWORD cl, cnt, nfree = 0, lost = 0, fre;
+	FATFS *fs;
+	BYTE *mark;
+	FIL t;
+	int i;
+
+	mark = calloc(n, 1);
+	if (!mark) fail("calloc", 0);
+
+	for (i = 0; i < NFILES + NBALLAST; i++) {
+		if (!File[i].exists) continue;
+		chk(f_open(&t, File[i].name, FA_READ), "open for check");
+		if (t.fsize != File[i].size) fail("file size", (int)i);
+		cnt = 0;
+		for (cl = t.sclust; cl >= 2 && cl < n; cl = get_fat(&Fs, cl)) {
+			if (mark[cl]) fail("cross-linked cluster", (int)cl);
+			mark[cl] = 1;
+			cnt++;
+		}
+		if (cnt != (File[i].size + bcs - 1) / bcs) fail("chain length", (int)i);
+		f_close(&t);
+	}
+	if (Fs.fs_type == FS_FAT32) {
+		for (cl = Fs.dirbase; cl >= 2 && cl < n; cl = get_fat(&Fs, cl)) mark[cl] = 1;
+	}
+
+	for (cl = 2; cl < n; cl++) {
+		if (get_fat(&Fs, cl) == 0) nfree++;
+		else if (!mark[cl]) lost++;
+	}
+	free(mark);
+	if (lost) fail("lost clusters", (int)lost);
+
+	chk(f_getfree("", &fre, &fs), "f_getfree");
+	if (fre != nfree) fail("free count", (int)(fre - nfree));
+}
+
+
+
+/*-----------------------------------------------------------------------*/
+/* Random operations                                                     */
+/*-----------------------------------------------------------------------*/
+
+static DWORD xfer_len (void)
+{
+	return (rnd() % 4 == 0) ? rnd() % XFER_MAX : rnd() % 3000;
+}
+
+
+static void do_open (TFILE* f)
+{
+	int create = !f->exists || rnd() % 8 == 0;
+
+	chk(f_open(&f->fil, f->name, FA_READ | FA_WRITE | (create ? FA_CREATE_ALWAYS : FA_OPEN_ALWAYS)), "f_open");
+	f->open = 1;
+	if (create) {
+		f->exists = 1;
+		f->size = 0;
+		memset(f->shadow, 0, MaxSize);
+#if _USE_EXPAND
+		if (rnd() % 3 == 0) {
+			DWORD sz;
+			UINT br;
+			FRESULT res;
+
+			/* The expanded contents are whatever the clusters held, take them as read */
+			sz = rnd() % (MaxSize / 2) + 1;
+			res = f_expand(&f->fil, sz);
+			if (res == FR_OK) {
+				f->size = sz;
+				chk(f_read(&f->fil, f->shadow, sz, &br), "read expanded");
+				if (br != sz) fail("short read of expanded file", (int)br);
+				chk(f_lseek(&f->fil, 0), "rewind");
+			} else if (res != FR_DENIED) {
+				fail("f_expand", res);
+			}
+		}
+#endif
+	}
+	if (rnd() % 2) chk(f_lseek(&f->fil, f->fil.fsize), "seek to end");
+}
+
+
+static void do_write (TFILE* f)
+{
+	DWORD at = f->fil.fptr, len = xfer_len(), i;
+	UINT bw;
+
+	if (at + len > MaxSize) len = MaxSize - at;
+	for (i = 0; i < len; i++) Buf[i] = (BYTE)rnd();
+	chk(f_write(&f->fil, Buf, len, &bw), "f_write");
+	if (bw != len) fail("short write", (int)bw);
+	memcpy(f->shadow + at, Buf, len);
+	if (at + len > f->size) f->size = at + len;
+}
+
+
+static void do_read (TFILE* f)
+{
+	DWORD at = f->fil.fptr, len = xfer_len(), want;
+	UINT br;
+
+	chk(f_read(&f->fil, RBuf, len, &br), "f_read");
+	want = at >= f->size ? 0 : (f->size - at < len ? f->size - at : len);
+	if (br != want) fail("read length", (int)br);
+	if (memcmp(RBuf, f->shadow + at, br)) fail("read data", (int)at);
+}
+
+
+static void do_seek (TFILE* f)
+{
+	DWORD to, old, bcs = (DWORD)Fs.csize * 512;
+	UINT br;
+
+	switch (rnd() % 3) {
+	case 0:		/* Past the end, which grows the file */
+		to = f->size + rnd() % (8 * 1024);
+		if (to > MaxSize) to = MaxSize;
+		break;
+	case 1:		/* A cluster boundary */
+		to = (rnd() % (f->size / bcs + 1)) * bcs;
+		if (to > f->size) to = f->size;
+		break;
+	default:
+		to = rnd() % (f->size + 1);
+	}
+	chk(f_lseek(&f->fil, to), "f_lseek");
+	if (f->fil.fptr != to) fail("seek position", (int)f->fil.fptr);
+
+	if (to > f->size) {
+		/* The grown part is unspecified, take it as read */
+		old = f->size;
+		f->size = to;
+		chk(f_lseek(&f->fil, old), "seek back");
+		chk(f_read(&f->fil, f->shadow + old, to - old, &br), "read grown part");
+		if (br != to - old) fail("short read of grown part", (int)br);
+		chk(f_lseek(&f->fil, to), "seek again");
+	}
+}
+
+
+static void close_all (void)
+{
+	int i;
+
+	for (i = 0; i < NFILES; i++) {
+		if (File[i].open) {
+			chk(f_close(&File[i].fil), "f_close");
+			File[i].open = 0;
+		}
+	}
+}
+
+
+static void random_op (void)
+{
+	TFILE *f = &File[rnd() % NFILES];
+	DWORD r = rnd() % 100;
+
+	if (!f->open) {
+		do_open(f);
+	} else if (r < 35) {
+		do_write(f);
+	} else if (r < 60) {
+		do_read(f);
+	} else if (r < 80) {
+		do_seek(f);
+	} else if (r < 85) {
+		chk(f_truncate(&f->fil), "f_truncate");
+		f->size = f->fil.fptr;
+		memset(f->shadow + f->size, 0, MaxSize - f->size);
+	} else if (r < 90) {
+		chk(f_sync(&f->fil), "f_sync");
+	} else {
+		chk(f_close(&f->fil), "f_close");
+		f->open = 0;
+		if (rnd() % 4 == 0) {
+			close_all();
+			fat_check();
+		}
+	}
+}
+
+
+
+/*-----------------------------------------------------------------------*/
+/* Read back after a remount                                             */
+/*-----------------------------------------------------------------------*/
+
+static void verify_all (void)
+{
+	DWORD tbl[256], at, len, want;
+	UINT br;
+	FIL t;
+	int i, k;
+
+	for (i = 0; i < NFILES + NBALLAST; i++) {
+		if (!File[i].exists) continue;
+		chk(f_open(&t, File[i].name, FA_READ), "open for verify");
+		for (at = 0; ; at += br) {
+			chk(f_read(&t, RBuf, XFER_MAX, &br), "read back");
+			if (!br) break;
+			if (memcmp(RBuf, File[i].shadow + at, br)) fail("read back data", (int)at);
+		}
+		if (at != File[i].size) fail("read back length", (int)at);
+
+		t.cltbl = tbl;
+		tbl[0] = sizeof tbl / sizeof tbl[0];
+		chk(f_lseek(&t, CREATE_LINKMAP), "create link map");
+		for (k = 0; k < 50; k++) {
+			at = File[i].size ? rnd() % File[i].size : 0;
+			len = rnd() % XFER_MAX;
+			chk(f_lseek(&t, at), "fast seek");
+			chk(f_read(&t, RBuf, len, &br), "fast seek read");
+			want = File[i].size - at < len ? File[i].size - at : len;
+			if (br != want || memcmp(RBuf, File[i].shadow + at, br)) fail("fast seek data", (int)at);
+		}
+		f_close(&t);
+	}
+}
+
+
+
+/*-----------------------------------------------------------------------*/
+/* One volume                                                            */
+/*-----------------------------------------------------------------------*/
+
+static void run (const VOLCFG* v, const char* img, unsigned long ops)
+{
+	const DHSTATS *st;
+	TFILE *f;
+	UINT bw;
+	int fd, i;
+
+	fd = open(img, O_RDWR | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0 || ftruncate(fd, (off_t)v->mb << 20) != 0) fail("create image", 0);
+	close(fd);
+	if (disk_host_open(0, img, DISK_HOST_MMAP) != RES_OK) fail("disk_host_open", 0);
+	Op = 0;
+	chk(f_mount(&Fs, "", 0), "f_mount");
+	chk(f_mkfs("", 1, v->au), "f_mkfs");
+	chk(f_mount(&Fs, "", 1), "f_mount");
+	if (Fs.fs_type != v->fs_type) fail("unexpected FAT type", Fs.fs_type);
+
+	MaxSize = (v->mb << 20) / (NFILES * 2);
+	memset(File, 0, sizeof File);
+	for (i = 0; i < NFILES + NBALLAST; i++) {
+		f = &File[i];
+		sprintf(f->name, i < NFILES ? "F%d.DAT" : "B%d.DAT", i);
+		f->shadow = calloc(MaxSize, 1);
+		if (!f->shadow) fail("calloc", 0);
+	}
+
+	/* Ballast files of one to four clusters, each followed by a hole */
+	for (i = NFILES; i < NFILES + NBALLAST; i++) {
+		f = &File[i];
+		f->size = (rnd() % 4 + 1) * Fs.csize * 512 - rnd() % 100;
+		memset(f->shadow, i, f->size);
+		chk(f_open(&f->fil, f->name, FA_WRITE | FA_CREATE_ALWAYS), "create ballast");
+		chk(f_write(&f->fil, f->shadow, f->size, &bw), "write ballast");
+		chk(f_close(&f->fil), "close ballast");
+		f->exists = 1;
+		chk(f_open(&f->fil, "GAP.DAT", FA_WRITE | FA_CREATE_ALWAYS), "create gap");
+		chk(f_write(&f->fil, Buf, (rnd() % 4 + 1) * Fs.csize * 512, &bw), "write gap");
+		chk(f_close(&f->fil), "close gap");
+		chk(f_unlink("GAP.DAT"), "delete gap");
+	}
+
+	disk_host_clear_stats(0);
+	for (Op = 0; Op < ops; Op++) random_op();
+	close_all();
+	fat_check();
+
+	chk(f_mount(0, "", 0), "unmount");
+	chk(f_mount(&Fs, "", 1), "remount");
+	verify_all();
+	fat_check();
+
+	st = disk_host_stats(0);
+	printf("%s: %lu operations OK, %lu reads, %lu writes, %lu sectors read, %lu written\n",
+		v->name, ops, (unsigned long)st->reads, (unsigned long)st->writes,
+		(unsigned long)st->sectors_read, (unsigned long)st->sectors_written);
+
+	f_mount(0, "", 0);
+	disk_host_close(0);
+	for (i = 0; i < NFILES + NBALLAST; i++) free(File[i].shadow);
+	unlink(img);
+}
+
+
+int main (int argc, char* argv[])
+{
+	unsigned long ops = 20000;
+	const char *img = "fsstress.img";
+	unsigned i;
+
+	Seed = 1;
+	if (argc > 1) Seed = (DWORD)strtoul(argv[1], 0, 0);
+	if (argc > 2) ops = strtoul(argv[2], 0, 0);
+	if (argc > 3) img = argv[3];
+
+	printf("seed %lu\n", (unsigned long)Seed);
+	for (i = 0; i < sizeof Vol / sizeof Vol[0]; i++) run(&Vol[i], img, ops);
+	return 0;
+}
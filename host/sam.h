@@ -0,0 +1,502 @@
+/*-----------------------------------------------------------------------/
+/  SAMD21G18A device header for host builds                             /
+/-----------------------------------------------------------------------/
+/  Stands in for the vendor sam.h so the firmware's driver sources       /
+/  build on Linux unchanged. The register blocks keep their SAMD21       /
+/  layout and addresses, where samd21.c maps its peripheral model, and   /
+/  the CMSIS core calls (interrupt mask, WFI, NVIC, SysTick) go to the   /
+/  model. Only the registers and fields the firmware uses are declared.  /
+/-----------------------------------------------------------------------*/
+
+#ifndef _SAMD21_HOST_SAM_H
+#define _SAMD21_HOST_SAM_H
+
+#include <stdint.h>
+
+#define __I		volatile const
+#define __O		volatile
+#define __IO	volatile
+
+
+/* Interrupt numbers */
+typedef enum {
+	SysTick_IRQn	= -1,
+	PM_IRQn			= 0,
+	SYSCTRL_IRQn	= 1,
+	WDT_IRQn		= 2,
+	RTC_IRQn		= 3,
+	EIC_IRQn		= 4,
+	NVMCTRL_IRQn	= 5,
+	DMAC_IRQn		= 6,
+	SERCOM1_IRQn	= 10
+} IRQn_Type;
+
+
+/* CMSIS core, served by the model */
+void samd21_primask (int set);
+void samd21_wfi (void);
+void samd21_nvic_enable (int irq, int on);
+uint32_t samd21_systick_config (uint32_t ticks);
+
+static inline void __disable_irq (void) { samd21_primask(1); }
+static inline void __enable_irq (void) { samd21_primask(0); }
+static inline void __WFI (void) { samd21_wfi(); }
+static inline void __DSB (void) { __sync_synchronize(); }
+static inline void __DMB (void) { __sync_synchronize(); }
+static inline void __NOP (void) { }
+static inline void NVIC_EnableIRQ (IRQn_Type irq) { samd21_nvic_enable(irq, 1); }
+static inline void NVIC_DisableIRQ (IRQn_Type irq) { samd21_nvic_enable(irq, 0); }
+static inline uint32_t SysTick_Config (uint32_t ticks) { return samd21_systick_config(ticks); }
+
+
+/* Plain registers, for the ones only accessed through .reg */
+typedef union { uint8_t reg; } SAM_REG8;
+typedef union { uint16_t reg; } SAM_REG16;
+typedef union { uint32_t reg; } SAM_REG32;
+
+
+
+/*--------------------------------------------------------------*/
+/* PM                                                           */
+
+typedef struct {
+	__IO SAM_REG8		CTRL;			/* 0x00 */
+	__IO SAM_REG8		SLEEP;			/* 0x01 */
+	uint8_t				Reserved1[6];
+	__IO SAM_REG8		CPUSEL;			/* 0x08 */
+	__IO SAM_REG8		APBASEL;		/* 0x09 */
+	__IO SAM_REG8		APBBSEL;		/* 0x0A */
+	__IO SAM_REG8		APBCSEL;		/* 0x0B */
+	uint8_t				Reserved2[8];
+	__IO SAM_REG32		AHBMASK;		/* 0x14 */
+	__IO SAM_REG32		APBAMASK;		/* 0x18 */
+	__IO SAM_REG32		APBBMASK;		/* 0x1C */
+	__IO SAM_REG32		APBCMASK;		/* 0x20 */
+} Pm;
+
+#define PM_CPUSEL_CPUDIV_DIV1			0x0u
+#define PM_APBASEL_APBADIV_DIV1_Val		0x0u
+#define PM_APBBSEL_APBBDIV_DIV1_Val		0x0u
+#define PM_APBCSEL_APBCDIV_DIV1_Val		0x0u
+#define PM_AHBMASK_DMAC					(1u << 5)
+#define PM_APBAMASK_EIC					(1u << 6)
+#define PM_APBBMASK_DMAC				(1u << 4)
+#define PM_APBCMASK_SERCOM1				(1u << 3)
+
+
+
+/*--------------------------------------------------------------*/
+/* SYSCTRL                                                      */
+
+typedef union {
+	struct {
+		uint32_t XOSCRDY:1, XOSC32KRDY:1, OSC32KRDY:1, OSC8MRDY:1, DFLLRDY:1, :27;
+	} bit;
+	uint32_t reg;
+} SYSCTRL_PCLKSR_Type;
+
+typedef union {
+	struct {
+		uint16_t :1, ENABLE:1, XTALEN:1, EN32K:1, :1, AAMPEN:1, RUNSTDBY:1, ONDEMAND:1,
+			STARTUP:3, :1, WRTLOCK:1, :3;
+	} bit;
+	uint16_t reg;
+} SYSCTRL_XOSC32K_Type;
+
+typedef union {
+	struct {
+		uint32_t :1, ENABLE:1, :4, RUNSTDBY:1, ONDEMAND:1, PRESC:2, :6, CALIB:12, :2, FRANGE:2;
+	} bit;
+	uint32_t reg;
+} SYSCTRL_OSC8M_Type;
+
+typedef union {
+	struct {
+		uint32_t FINE:10, COARSE:6, DIFF:16;
+	} bit;
+	uint32_t reg;
+} SYSCTRL_DFLLVAL_Type;
+
+typedef union {
+	struct {
+		uint32_t MUL:16, FSTEP:10, CSTEP:6;
+	} bit;
+	uint32_t reg;
+} SYSCTRL_DFLLMUL_Type;
+
+typedef struct {
+	__IO SAM_REG32				INTENCLR;	/* 0x00 */
+	__IO SAM_REG32				INTENSET;	/* 0x04 */
+	__IO SAM_REG32				INTFLAG;	/* 0x08 */
+	__I  SYSCTRL_PCLKSR_Type	PCLKSR;		/* 0x0C */
+	__IO SAM_REG16				XOSC;		/* 0x10 */
+	uint8_t						Reserved1[2];
+	__IO SYSCTRL_XOSC32K_Type	XOSC32K;	/* 0x14 */
+	uint8_t						Reserved2[2];
+	__IO SAM_REG32				OSC32K;		/* 0x18 */
+	__IO SAM_REG8				OSCULP32K;	/* 0x1C */
+	uint8_t						Reserved3[3];
+	__IO SYSCTRL_OSC8M_Type		OSC8M;		/* 0x20 */
+	__IO SAM_REG16				DFLLCTRL;	/* 0x24 */
+	uint8_t						Reserved4[2];
+	__IO SYSCTRL_DFLLVAL_Type	DFLLVAL;	/* 0x28 */
+	__IO SYSCTRL_DFLLMUL_Type	DFLLMUL;	/* 0x2C */
+} Sysctrl;
+
+#define SYSCTRL_DFLLCTRL_ENABLE			(1u << 1)
+#define SYSCTRL_DFLLCTRL_MODE			(1u << 2)
+#define SYSCTRL_DFLLCTRL_WAITLOCK		(1u << 11)
+
+#define FUSES_DFLL48M_COARSE_CAL_ADDR	0x00806024u
+#define FUSES_DFLL48M_COARSE_CAL_Pos	26
+#define FUSES_DFLL48M_COARSE_CAL_Msk	(0x3Fu << FUSES_DFLL48M_COARSE_CAL_Pos)
+
+
+
+/*--------------------------------------------------------------*/
+/* GCLK                                                         */
+
+typedef union {
+	struct {
+		uint8_t :7, SYNCBUSY:1;
+	} bit;
+	uint8_t reg;
+} GCLK_STATUS_Type;
+
+typedef union {
+	struct {
+		uint16_t ID:6, :2, GEN:4, :2, CLKEN:1, WRTLOCK:1;
+	} bit;
+	uint16_t reg;
+} GCLK_CLKCTRL_Type;
+
+typedef union {
+	struct {
+		uint32_t ID:4, :4, SRC:5, :3, GENEN:1, IDC:1, OOV:1, OE:1, DIVSEL:1, RUNSTDBY:1, :10;
+	} bit;
+	uint32_t reg;
+} GCLK_GENCTRL_Type;
+
+typedef union {
+	struct {
+		uint32_t ID:4, :4, DIV:16, :8;
+	} bit;
+	uint32_t reg;
+} GCLK_GENDIV_Type;
+
+typedef struct {
+	__IO SAM_REG8			CTRL;		/* 0x0 */
+	__I  GCLK_STATUS_Type	STATUS;		/* 0x1 */
+	__IO GCLK_CLKCTRL_Type	CLKCTRL;	/* 0x2 */
+	__IO GCLK_GENCTRL_Type	GENCTRL;	/* 0x4 */
+	__IO GCLK_GENDIV_Type	GENDIV;		/* 0x8 */
+} Gclk;
+
+#define GCLK_CLKCTRL_ID(v)				((uint16_t)(v) & 0x3Fu)
+#define GCLK_CLKCTRL_GEN(v)				(((uint16_t)(v) & 0xFu) << 8)
+#define GCLK_CLKCTRL_CLKEN				(1u << 14)
+
+#define EIC_GCLK_ID						0x05u
+#define SERCOM1_GCLK_ID_CORE			0x15u
+
+
+
+/*--------------------------------------------------------------*/
+/* EIC                                                          */
+
+typedef union {
+	struct {
+		uint8_t :7, SYNCBUSY:1;
+	} bit;
+	uint8_t reg;
+} EIC_STATUS_Type;
+
+typedef struct {
+	__IO SAM_REG8			CTRL;		/* 0x00 */
+	__I  EIC_STATUS_Type	STATUS;		/* 0x01 */
+	__IO SAM_REG8			NMICTRL;	/* 0x02 */
+	__IO SAM_REG8			NMIFLAG;	/* 0x03 */
+	__IO SAM_REG32			EVCTRL;		/* 0x04 */
+	__IO SAM_REG32			INTENCLR;	/* 0x08 */
+	__IO SAM_REG32			INTENSET;	/* 0x0C */
+	__IO SAM_REG32			INTFLAG;	/* 0x10 */
+	__IO SAM_REG32			WAKEUP;		/* 0x14 */
+	__IO SAM_REG32			CONFIG[2];	/* 0x18 */
+} Eic;
+
+#define EIC_CTRL_SWRST					(1u << 0)
+#define EIC_CTRL_ENABLE					(1u << 1)
+#define EIC_INTENCLR_EXTINT3			(1u << 3)
+#define EIC_INTENSET_EXTINT3			(1u << 3)
+#define EIC_INTFLAG_EXTINT3				(1u << 3)
+#define EIC_WAKEUP_WAKEUPEN3			(1u << 3)
+#define EIC_CONFIG_SENSE3_Pos			12
+#define EIC_CONFIG_SENSE3_Msk			(0x7u << EIC_CONFIG_SENSE3_Pos)
+#define EIC_CONFIG_SENSE3_HIGH			(0x4u << EIC_CONFIG_SENSE3_Pos)
+
+
+
+/*--------------------------------------------------------------*/
+/* NVMCTRL                                                      */
+
+typedef union {
+	struct {
+		uint32_t :1, RWS:4, :2, MANW:1, SLEEPPRM:2, :6, READMODE:2, CACHEDIS:1, :13;
+	} bit;
+	uint32_t reg;
+} NVMCTRL_CTRLB_Type;
+
+typedef union {
+	struct {
+		uint8_t READY:1, ERROR:1, :6;
+	} bit;
+	uint8_t reg;
+} NVMCTRL_INTFLAG_Type;
+
+typedef struct {
+	__IO SAM_REG16				CTRLA;		/* 0x00 */
+	uint8_t						Reserved1[2];
+	__IO NVMCTRL_CTRLB_Type		CTRLB;		/* 0x04 */
+	__IO SAM_REG32				PARAM;		/* 0x08 */
+	__IO SAM_REG8				INTENCLR;	/* 0x0C */
+	uint8_t						Reserved2[3];
+	__IO SAM_REG8				INTENSET;	/* 0x10 */
+	uint8_t						Reserved3[3];
+	__IO NVMCTRL_INTFLAG_Type	INTFLAG;	/* 0x14 */
+	uint8_t						Reserved4[3];
+	__IO SAM_REG16				STATUS;		/* 0x18 */
+	uint8_t						Reserved5[2];
+	__IO SAM_REG32				ADDR;		/* 0x1C */
+	__IO SAM_REG16				LOCK;		/* 0x20 */
+} Nvmctrl;
+
+#define NVMCTRL_CTRLA_CMD_ER			0x02u
+#define NVMCTRL_CTRLA_CMD_WP			0x04u
+#define NVMCTRL_CTRLA_CMD_PBC			0x44u
+#define NVMCTRL_CTRLA_CMDEX_KEY			(0xA5u << 8)
+#define NVMCTRL_STATUS_PROGE			(1u << 2)
+#define NVMCTRL_STATUS_LOCKE			(1u << 3)
+#define NVMCTRL_STATUS_NVME				(1u << 4)
+#define NVMCTRL_STATUS_MASK				0x011Fu
+
+#define FLASH_PAGE_SIZE					64
+#define NVMCTRL_ROW_PAGES				4
+
+
+
+/*--------------------------------------------------------------*/
+/* PORT                                                         */
+
+typedef union {
+	struct {
+		uint32_t PINMASK:16, PMUXEN:1, INEN:1, PULLEN:1, :3, DRVSTR:1, :1, PMUX:4,
+			WRPMUX:1, :1, WRPINCFG:1, HWSEL:1;
+	} bit;
+	uint32_t reg;
+} PORT_WRCONFIG_Type;
+
+typedef struct {
+	__IO SAM_REG32			DIR;		/* 0x00 */
+	__IO SAM_REG32			DIRCLR;		/* 0x04 */
+	__IO SAM_REG32			DIRSET;		/* 0x08 */
+	__IO SAM_REG32			DIRTGL;		/* 0x0C */
+	__IO SAM_REG32			OUT;		/* 0x10 */
+	__IO SAM_REG32			OUTCLR;		/* 0x14 */
+	__IO SAM_REG32			OUTSET;		/* 0x18 */
+	__IO SAM_REG32			OUTTGL;		/* 0x1C */
+	__I  SAM_REG32			IN;			/* 0x20 */
+	__IO SAM_REG32			CTRL;		/* 0x24 */
+	__O  PORT_WRCONFIG_Type	WRCONFIG;	/* 0x28 */
+	uint8_t					Reserved1[4];
+	__IO SAM_REG8			PMUX[16];	/* 0x30 */
+	__IO SAM_REG8			PINCFG[32];	/* 0x40 */
+	uint8_t					Reserved2[32];
+} PortGroup;
+
+typedef struct {
+	PortGroup				Group[2];
+} Port;
+
+#define PORT_WRCONFIG_PINMASK(v)		((uint32_t)(v) & 0xFFFFu)
+#define PORT_WRCONFIG_PMUXEN			(1u << 16)
+#define PORT_WRCONFIG_INEN				(1u << 17)
+#define PORT_WRCONFIG_PULLEN			(1u << 18)
+#define PORT_WRCONFIG_DRVSTR			(1u << 22)
+#define PORT_WRCONFIG_PMUX(v)			(((uint32_t)(v) & 0xFu) << 24)
+#define PORT_WRCONFIG_WRPMUX			(1u << 28)
+#define PORT_WRCONFIG_WRPINCFG			(1u << 30)
+#define PORT_WRCONFIG_HWSEL				(1u << 31)
+
+#define PORT_PA08						(1u << 8)
+#define PORT_PA09						(1u << 9)
+#define PORT_PA16						(1u << 16)
+#define PORT_PA17						(1u << 17)
+#define PORT_PA18						(1u << 18)
+#define PORT_PA19						(1u << 19)
+#define PORT_PA21						(1u << 21)
+#define PORT_PA28						(1u << 28)
+
+#define MUX_PA16C_SERCOM1_PAD0			2u
+#define MUX_PA17C_SERCOM1_PAD1			2u
+#define MUX_PA18C_SERCOM1_PAD2			2u
+#define MUX_PA19C_SERCOM1_PAD3			2u
+#define MUX_PA19A_EIC_EXTINT3			0u
+
+
+
+/*--------------------------------------------------------------*/
+/* DMAC                                                         */
+
+typedef union {
+	struct {
+		uint16_t ID:4, :4, TERR:1, TCMPL:1, SUSP:1, :2, FERR:1, BUSY:1, PEND:1;
+	} bit;
+	uint16_t reg;
+} DMAC_INTPEND_Type;
+
+typedef struct {
+	__IO SAM_REG16			CTRL;		/* 0x00 */
+	__IO SAM_REG16			CRCCTRL;	/* 0x02 */
+	__IO SAM_REG32			CRCDATAIN;	/* 0x04 */
+	__IO SAM_REG32			CRCCHKSUM;	/* 0x08 */
+	__IO SAM_REG8			CRCSTATUS;	/* 0x0C */
+	__IO SAM_REG8			DBGCTRL;	/* 0x0D */
+	__IO SAM_REG8			QOSCTRL;	/* 0x0E */
+	uint8_t					Reserved1[1];
+	__IO SAM_REG32			SWTRIGCTRL;	/* 0x10 */
+	__IO SAM_REG32			PRICTRL0;	/* 0x14 */
+	uint8_t					Reserved2[8];
+	__IO DMAC_INTPEND_Type	INTPEND;	/* 0x20 */
+	uint8_t					Reserved3[2];
+	__I  SAM_REG32			INTSTATUS;	/* 0x24 */
+	__I  SAM_REG32			BUSYCH;		/* 0x28 */
+	__I  SAM_REG32			PENDCH;		/* 0x2C */
+	__I  SAM_REG32			ACTIVE;		/* 0x30 */
+	__IO SAM_REG32			BASEADDR;	/* 0x34 */
+	__IO SAM_REG32			WRBADDR;	/* 0x38 */
+	uint8_t					Reserved4[3];
+	__IO SAM_REG8			CHID;		/* 0x3F */
+	__IO SAM_REG8			CHCTRLA;	/* 0x40 */
+	uint8_t					Reserved5[3];
+	__IO SAM_REG32			CHCTRLB;	/* 0x44 */
+	uint8_t					Reserved6[4];
+	__IO SAM_REG8			CHINTENCLR;	/* 0x4C */
+	__IO SAM_REG8			CHINTENSET;	/* 0x4D */
+	__IO SAM_REG8			CHINTFLAG;	/* 0x4E */
+	__I  SAM_REG8			CHSTATUS;	/* 0x4F */
+} Dmac;
+
+/* Transfer descriptor, in SRAM */
+typedef struct {
+	__IO SAM_REG16			BTCTRL;		/* 0x00 */
+	__IO SAM_REG16			BTCNT;		/* 0x02 */
+	__IO SAM_REG32			SRCADDR;	/* 0x04 */
+	__IO SAM_REG32			DSTADDR;	/* 0x08 */
+	__IO SAM_REG32			DESCADDR;	/* 0x0C */
+} DmacDescriptor;
+
+#define DMAC_CTRL_SWRST					(1u << 0)
+#define DMAC_CTRL_DMAENABLE				(1u << 1)
+#define DMAC_CTRL_CRCENABLE				(1u << 2)
+#define DMAC_CTRL_LVLEN(v)				(((uint16_t)(v) & 0xFu) << 8)
+#define DMAC_CRCCTRL_CRCBEATSIZE_BYTE	(0x0u << 0)
+#define DMAC_CRCCTRL_CRCPOLY_CRC16		(0x0u << 2)
+#define DMAC_CRCCTRL_CRCSRC(v)			(((uint16_t)(v) & 0x3Fu) << 8)
+#define DMAC_CRCCTRL_CRCSRC_NOACT		(0x0u << 8)
+#define DMAC_CHID_ID(v)					((uint8_t)(v) & 0xFu)
+#define DMAC_CHCTRLA_SWRST				(1u << 0)
+#define DMAC_CHCTRLA_ENABLE				(1u << 1)
+#define DMAC_CHCTRLB_LVL(v)				(((uint32_t)(v) & 0x3u) << 5)
+#define DMAC_CHCTRLB_TRIGSRC(v)			(((uint32_t)(v) & 0x3Fu) << 8)
+#define DMAC_CHCTRLB_TRIGACT_BEAT		(0x2u << 22)
+#define DMAC_CHINTENSET_TERR			(1u << 0)
+#define DMAC_CHINTENSET_TCMPL			(1u << 1)
+#define DMAC_CHINTFLAG_TERR				(1u << 0)
+#define DMAC_CHINTFLAG_TCMPL			(1u << 1)
+#define DMAC_BTCTRL_VALID				(1u << 0)
+#define DMAC_BTCTRL_BEATSIZE_BYTE		(0x0u << 8)
+#define DMAC_BTCTRL_SRCINC				(1u << 10)
+#define DMAC_BTCTRL_DSTINC				(1u << 11)
+
+#define SERCOM1_DMAC_ID_RX				0x03u
+#define SERCOM1_DMAC_ID_TX				0x04u
+
+
+
+/*--------------------------------------------------------------*/
+/* SERCOM in SPI mode                                           */
+
+typedef union {
+	struct {
+		uint32_t SWRST:1, ENABLE:1, MODE:3, :2, RUNSTDBY:1, IBON:1, :7, DOPO:2, :2, DIPO:2, :2,
+			FORM:4, CPHA:1, CPOL:1, DORD:1, :1;
+	} bit;
+	uint32_t reg;
+} SERCOM_SPI_CTRLA_Type;
+
+typedef union {
+	struct {
+		uint8_t DRE:1, TXC:1, RXC:1, SSL:1, :3, ERROR:1;
+	} bit;
+	uint8_t reg;
+} SERCOM_SPI_INTFLAG_Type;
+
+typedef union {
+	struct {
+		uint32_t SWRST:1, ENABLE:1, CTRLB:1, :29;
+	} bit;
+	uint32_t reg;
+} SERCOM_SPI_SYNCBUSY_Type;
+
+typedef struct {
+	__IO SERCOM_SPI_CTRLA_Type		CTRLA;		/* 0x00 */
+	__IO SAM_REG32					CTRLB;		/* 0x04 */
+	uint8_t							Reserved1[4];
+	__IO SAM_REG8					BAUD;		/* 0x0C */
+	uint8_t							Reserved2[7];
+	__IO SAM_REG8					INTENCLR;	/* 0x14 */
+	uint8_t							Reserved3[1];
+	__IO SAM_REG8					INTENSET;	/* 0x16 */
+	uint8_t							Reserved4[1];
+	__IO SERCOM_SPI_INTFLAG_Type	INTFLAG;	/* 0x18 */
+	uint8_t							Reserved5[1];
+	__IO SAM_REG16					STATUS;		/* 0x1A */
+	__I  SERCOM_SPI_SYNCBUSY_Type	SYNCBUSY;	/* 0x1C */
+	uint8_t							Reserved6[4];
+	__IO SAM_REG32					ADDR;		/* 0x24 */
+	__IO SAM_REG32					DATA;		/* 0x28 */
+	uint8_t							Reserved7[4];
+	__IO SAM_REG8					DBGCTRL;	/* 0x30 */
+} SercomSpi;
+
+typedef union {
+	SercomSpi				SPI;
+} Sercom;
+
+#define SERCOM_SPI_CTRLA_SWRST			(1u << 0)
+#define SERCOM_SPI_CTRLA_ENABLE			(1u << 1)
+#define SERCOM_SPI_CTRLA_MODE_SPI_MASTER	(0x3u << 2)
+#define SERCOM_SPI_CTRLA_DOPO(v)		(((uint32_t)(v) & 0x3u) << 16)
+#define SERCOM_SPI_CTRLA_DIPO(v)		(((uint32_t)(v) & 0x3u) << 20)
+#define SERCOM_SPI_CTRLB_RXEN			(1u << 17)
+#define SERCOM_SPI_BAUD_BAUD(v)			((uint8_t)(v))
+#define SERCOM_SPI_INTFLAG_DRE			(1u << 0)
+#define SERCOM_SPI_INTFLAG_TXC			(1u << 1)
+#define SERCOM_SPI_INTFLAG_RXC			(1u << 2)
+#define SERCOM_SPI_STATUS_BUFOVF		(1u << 2)
+
+
+
+/*--------------------------------------------------------------*/
+/* Peripheral instances                                         */
+
+#define PM				((Pm      *)0x40000400u)
+#define SYSCTRL			((Sysctrl *)0x40000800u)
+#define GCLK			((Gclk    *)0x40000C00u)
+#define EIC				((Eic     *)0x40001800u)
+#define NVMCTRL			((Nvmctrl *)0x41004000u)
+#define PORT			((Port    *)0x41004400u)
+#define DMAC			((Dmac    *)0x41004800u)
+#define SERCOM1			((Sercom  *)0x42000C00u)
+
+#endif
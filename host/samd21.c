@@ -0,0 +1,1489 @@
+/*-----------------------------------------------------------------------*/
+/* SAMD21 peripheral model for host builds                               */
+/*-----------------------------------------------------------------------*/
+/* The register pages are mapped without access at their SAMD21         */
+/* addresses, so every peripheral access of the firmware faults into     */
+/* this file. The faulting load or store is decoded and applied to the   */
+/* model (single stepped when it is not a plain mov or ALU form), and    */
+/* charged SAMD21_ACCESS_CYCLES on a 48 MHz cycle clock. Between         */
+/* accesses the clock runs the SERCOM1 shifter, the DMAC channels, the   */
+/* NVM controller, SysTick and the EIC level on PA19, and the DMAC, EIC  */
+/* and SysTick handlers are raised the way the NVIC would. Only the      */
+/* features the firmware uses are modelled: SPI master on SERCOM1,       */
+/* byte beats on DMAC channels 0 and 1 with the CRC16 unit, EXTINT3,     */
+/* and page writes to the one flash row registered with samd21_flash().  */
+/*-----------------------------------------------------------------------*/
+
+#define _GNU_SOURCE
+#include "sam.h"
+#include "samd21.h"
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ucontext.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/time.h>
+
+#define MAX_DEVS	4
+#define PAGE		4096u
+#define STACK_SIZE	(1u << 20)
+#define SPI_DATA	0x42000C28u
+
+/* Firmware handlers, optional so builds without DMA.c or SPI.c link */
+void SysTick_Handler (void) __attribute__((weak));
+void EIC_Handler (void) __attribute__((weak));
+void DMAC_Handler (void) __attribute__((weak));
+
+
+/* Register pages, mapped twice: without access at the device address,
+   read/write for the model */
+static const uint32_t PageAddr[] = { 0x40000000u, 0x40001000u, 0x41004000u, 0x42000000u };
+#define NPAGES	(sizeof PageAddr / sizeof PageAddr[0])
+static uint8_t* Shadow[NPAGES];
+
+/* Register layout as offset/size pairs, everything else is byte wide */
+static const uint8_t PmRegs[] = { 0x14,4, 0x18,4, 0x1C,4, 0x20,4, 0xFF };
+static const uint8_t SysctrlRegs[] = { 0x00,4, 0x04,4, 0x08,4, 0x0C,4, 0x10,2, 0x14,2, 0x18,4,
+	0x20,4, 0x24,2, 0x28,4, 0x2C,4, 0xFF };
+static const uint8_t GclkRegs[] = { 0x02,2, 0x04,4, 0x08,4, 0xFF };
+static const uint8_t EicRegs[] = { 0x04,4, 0x08,4, 0x0C,4, 0x10,4, 0x14,4, 0x18,4, 0x1C,4, 0xFF };
+static const uint8_t NvmRegs[] = { 0x00,2, 0x04,4, 0x08,4, 0x18,2, 0x1C,4, 0x20,2, 0xFF };
+static const uint8_t PortRegs[] = { 0x00,4, 0x04,4, 0x08,4, 0x0C,4, 0x10,4, 0x14,4, 0x18,4, 0x1C,4,
+	0x20,4, 0x24,4, 0x28,4, 0xFF };
+static const uint8_t DmacRegs[] = { 0x00,2, 0x02,2, 0x04,4, 0x08,4, 0x10,4, 0x14,4, 0x20,2, 0x24,4,
+	0x28,4, 0x2C,4, 0x30,4, 0x34,4, 0x38,4, 0x44,4, 0xFF };
+static const uint8_t SercomRegs[] = { 0x00,4, 0x04,4, 0x0C,1, 0x1A,2, 0x1C,4, 0x24,4, 0x28,4, 0xFF };
+
+enum { P_PM, P_SYSCTRL, P_GCLK, P_EIC, P_NVM, P_PORT, P_DMAC, P_SERCOM, P_NONE };
+
+static const struct {
+	uint32_t base, span;
+	const uint8_t* regs;
+} Periph[] = {
+	{ 0x40000400u, 0x24, PmRegs },
+	{ 0x40000800u, 0x30, SysctrlRegs },
+	{ 0x40000C00u, 0x0C, GclkRegs },
+	{ 0x40001800u, 0x20, EicRegs },
+	{ 0x41004000u, 0x24, NvmRegs },
+	{ 0x41004400u, 0x100, PortRegs },
+	{ 0x41004800u, 0x50, DmacRegs },
+	{ 0x42000C00u, 0x34, SercomRegs }
+};
+
+
+/* SERCOM1 in SPI master mode */
+static struct {
+	uint8_t		tx, txFull;		/* DATA transmit buffer */
+	uint8_t		sh, shifting;	/* Shift register */
+	uint64_t	shEnd;
+	uint8_t		rx[2], rxn;		/* Receive buffer */
+	uint8_t		txc, ovf;
+} Spi;
+
+/* DMAC channels 0 and 1 */
+typedef struct {
+	uint8_t		ctrla, inten, intflag, on;
+	uint32_t	ctrlb;
+	uint8_t		*src, *dst;
+	uint8_t		srcIo, dstIo, srcInc, dstInc;
+	uint32_t	left;
+	uint64_t	beatAt;
+} DMACH;
+
+static DMACH Ch[2];
+static uint16_t Crc;
+
+/* NVM controller and the flash row it may program */
+static struct {
+	uint8_t		busy, cmd;
+	uint64_t	doneAt;
+	uint8_t*	row;
+	unsigned	rowSize;
+	uint8_t		buf[FLASH_PAGE_SIZE];
+	int			bufPage;		/* Page the buffer was loaded for, -1 if none */
+} Nvm = { .bufPage = -1 };
+
+/* Core */
+static SAMDEV Dev[MAX_DEVS];
+static int NDevs;
+static uint8_t DevSel[MAX_DEVS];
+static uint64_t Now;
+static uint64_t TickNext = SAMD21_NEVER, TickPeriod;
+static int TickPending, Primask, InIsr, Nvic;
+static volatile int InModel;
+static SAMSTATS Stats;
+static FILE* Uart;
+
+/* Single step in progress */
+static uint32_t StepBase;
+static int StepSize, StepWrite;
+
+/* samd21_spin() state */
+static int SpinOn, SpinIdle;
+static uint32_t SpinSeen;
+
+/* Firmware context */
+static ucontext_t HostCtx, FwCtx;
+static void (*FwEntry)(void);
+static uint8_t* FwStack;
+
+
+static void fatal (const char* msg)
+{
+	fprintf(stderr, "samd21: %s (at cycle %llu)\n", msg, (unsigned long long)Now);
+	abort();
+}
+
+
+
+/*-----------------------------------------------------------------------*/
+/* Register storage                                                      */
+/*-----------------------------------------------------------------------*/
+
+static uint8_t* loc (uint32_t a)
+{
+	unsigned i;
+
+	for (i = 0; i < NPAGES; i++) {
+		if (a - PageAddr[i] < PAGE) return Shadow[i] + (a - PageAddr[i]);
+	}
+	return 0;
+}
+
+
+static uint32_t get (uint32_t a, int size)
+{
+	uint32_t v = 0;
+
+	memcpy(&v, loc(a), size);
+	return v;
+}
+
+
+static void put (uint32_t a, int size, uint32_t v)
+{
+	memcpy(loc(a), &v, size);
+}
+
+
+/* Peripheral of address a, the register holding it and its size */
+static int reg_at (uint32_t a, uint32_t* base, int* size)
+{
+	unsigned i;
+	uint32_t off, grp;
+	const uint8_t* r;
+
+	*base = a;
+	*size = 1;
+	for (i = 0; i < sizeof Periph / sizeof Periph[0]; i++) {
+		if (a - Periph[i].base >= Periph[i].span) continue;
+		off = a - Periph[i].base;
+		grp = 0;
+		if (i == P_PORT) {		/* Two groups of the same layout */
+			grp = off & ~0x7Fu;
+			off &= 0x7F;
+		}
+		for (r = Periph[i].regs; *r != 0xFF; r += 2) {
+			if (off - r[0] < r[1]) {
+				*base = Periph[i].base + grp + r[0];
+				*size = r[1];
+				break;
+			}
+		}
+		return (int)i;
+	}
+	return P_NONE;
+}
+
+
+
+/*-----------------------------------------------------------------------*/
+/* PORT, chip selects and the EIC line on PA19                           */
+/*-----------------------------------------------------------------------*/
+
+#define PORT_A(off)	(0x41004400u + (off))
+
+static uint8_t pin_mux (int pin)
+{
+	uint8_t pmux = *loc(PORT_A(0x30 + pin / 2));
+
+	if (!(*loc(PORT_A(0x40 + pin)) & 1)) return 0xFF;	/* PMUXEN off: plain GPIO */
+	return (pin & 1) ? pmux >> 4 : pmux & 15;
+}
+
+
+static int sck_routed (void)
+{
+	return pin_mux(17) == MUX_PA17C_SERCOM1_PAD1 && pin_mux(16) == MUX_PA16C_SERCOM1_PAD0;
+}
+
+
+static int miso_routed (void)
+{
+	return pin_mux(19) == MUX_PA19C_SERCOM1_PAD3;
+}
+
+
+/* Selected device, 0 if none; *n gets the number selected */
+static SAMDEV* selected (int* n)
+{
+	SAMDEV* d = 0;
+	int i, c = 0;
+
+	for (i = 0; i < NDevs; i++) {
+		if (DevSel[i]) {
+			d = &Dev[i];
+			c++;
+		}
+	}
+	if (n) *n = c;
+	return d;
+}
+
+
+/* Follow chip select changes */
+static void cs_update (void)
+{
+	uint32_t dir = get(PORT_A(0x00), 4), out = get(PORT_A(0x10), 4);
+	int i, sel;
+
+	for (i = 0; i < NDevs; i++) {
+		sel = (dir & Dev[i].cs) && !(out & Dev[i].cs);
+		if (sel != DevSel[i]) {
+			DevSel[i] = (uint8_t)sel;
+			if (Dev[i].select) Dev[i].select(Dev[i].ctx, sel, Now);
+		}
+	}
+}
+
+
+/* Time MISO goes high, pulled up while no card drives it */
+static uint64_t miso_high_at (void)
+{
+	SAMDEV* d = selected(0);
+
+	if (!d || !d->ready) return Now;
+	return d->ready(d->ctx, Now);
+}
+
+
+/* EXTINT3 is armed: EIC on, sensing a high level, PA19 muxed to it */
+static int eic_armed (void)
+{
+	return (*loc(0x40001800u) & EIC_CTRL_ENABLE)
+		&& (get(0x40001818u, 4) & EIC_CONFIG_SENSE3_Msk) == EIC_CONFIG_SENSE3_HIGH
+		&& pin_mux(19) == MUX_PA19A_EIC_EXTINT3;
+}
+
+
+/* Level sensing keeps setting the flag while the line is high */
+static void eic_update (void)
+{
+	if (eic_armed() && miso_high_at() <= Now) {
+		put(0x40001810u, 4, get(0x40001810u, 4) | EIC_INTFLAG_EXTINT3);
+	}
+}
+
+
+static uint32_t port_read (uint32_t a, uint32_t off)
+{
+	uint32_t grp = a - off;
+
+	switch (off) {
+	case 0x04: case 0x08: case 0x0C:	/* DIRCLR/DIRSET/DIRTGL read DIR */
+		return get(grp + 0x00, 4);
+	case 0x14: case 0x18: case 0x1C:	/* OUTCLR/OUTSET/OUTTGL read OUT */
+		return get(grp + 0x10, 4);
+	case 0x20:							/* IN, with MISO on PA19 */
+		return (get(grp + 0x10, 4) & ~PORT_PA19) | (grp == PORT_A(0) && miso_high_at() <= Now ? PORT_PA19 : 0);
+	case 0x28:
+		return 0;
+	}
+	return get(a, off < 0x30 ? 4 : 1);
+}
+
+
+static void port_write (uint32_t a, uint32_t off, uint32_t v)
+{
+	uint32_t grp = a - off, dir = get(grp, 4), out = get(grp + 0x10, 4);
+	int pin, first;
+
+	switch (off) {
+	case 0x00: dir = v; break;
+	case 0x04: dir &= ~v; break;
+	case 0x08: dir |= v; break;
+	case 0x0C: dir ^= v; break;
+	case 0x10: out = v; break;
+	case 0x14: out &= ~v; break;
+	case 0x18: out |= v; break;
+	case 0x1C: out ^= v; break;
+	case 0x28:							/* WRCONFIG */
+		first = (v & PORT_WRCONFIG_HWSEL) ? 16 : 0;
+		for (pin = 0; pin < 16; pin++) {
+			if (!(v & (1u << pin))) continue;
+			if (v & PORT_WRCONFIG_WRPINCFG) {
+				*loc(grp + 0x40 + first + pin) = (uint8_t)((v >> 16 & 7) | (v >> 16 & 0x40));
+			}
+			if (v & PORT_WRCONFIG_WRPMUX) {
+				uint8_t* p = loc(grp + 0x30 + (first + pin) / 2);
+				uint8_t mux = (uint8_t)(v >> 24 & 15);
+				*p = (pin & 1) ? (uint8_t)((*p & 0x0F) | mux << 4) : (uint8_t)((*p & 0xF0) | mux);
+			}
+		}
+		break;
+	default:
+		put(a, off < 0x30 ? 4 : 1, v);
+		break;
+	}
+	put(grp, 4, dir);
+	put(grp + 0x10, 4, out);
+	if (grp == PORT_A(0)) {
+		cs_update();
+		eic_update();
+	}
+}
+
+
+static uint32_t eic_read (uint32_t a, uint32_t off)
+{
+	switch (off) {
+	case 0x01: return 0;				/* STATUS: never busy */
+	case 0x08: return get(a + 4, 4);	/* INTENCLR reads INTENSET */
+	}
+	return get(a, off < 4 ? 1 : 4);
+}
+
+
+static void eic_write (uint32_t a, uint32_t off, uint32_t v)
+{
+	switch (off) {
+	case 0x00:
+		if (v & EIC_CTRL_SWRST) {
+			memset(loc(a), 0, 0x20);
+			return;
+		}
+		put(a, 1, v & EIC_CTRL_ENABLE);
+		break;
+	case 0x08: put(a + 4, 4, get(a + 4, 4) & ~v); break;
+	case 0x0C: put(a, 4, get(a, 4) | v); break;
+	case 0x10: put(a, 4, get(a, 4) & ~v); break;
+	default: put(a, off < 4 ? 1 : 4, v); break;
+	}
+	eic_update();
+}
+
+
+
+/*-----------------------------------------------------------------------*/
+/* SERCOM1                                                               */
+/*-----------------------------------------------------------------------*/
+
+#define SERCOM_A(off)	(0x42000C00u + (off))
+
+static int spi_enabled (void)
+{
+	return (get(SERCOM_A(0x00), 4) & SERCOM_SPI_CTRLA_ENABLE) != 0;
+}
+
+
+static uint32_t spi_byte_cycles (void)
+{
+	return 16u * (*loc(SERCOM_A(0x0C)) + 1u);
+}
+
+
+static void spi_shift (void)
+{
+	if (Spi.shifting || !Spi.txFull) return;
+	Spi.sh = Spi.tx;
+	Spi.txFull = 0;
+	Spi.shifting = 1;
+	Spi.shEnd = Now + spi_byte_cycles();
+	Spi.txc = 0;
+	Stats.spiCycles += spi_byte_cycles();
+}
+
+
+/* End of a shift: exchange the byte with the selected device */
+static void spi_shift_done (void)
+{
+	int n;
+	SAMDEV* d = selected(&n);
+	uint8_t miso = 0xFF;
+
+	if (n > 1) Stats.clashes++;
+	if (d && sck_routed()) {
+		miso = d->xfer(d->ctx, Spi.sh, Now, SAMD21_HZ / (2u * (*loc(SERCOM_A(0x0C)) + 1u)));
+	}
+	if (!miso_routed()) {
+		Stats.detached++;
+		miso = 0x00;
+	}
+	Stats.spiBytes++;
+	Spi.shifting = 0;
+
+	if (get(SERCOM_A(0x04), 4) & SERCOM_SPI_CTRLB_RXEN) {
+		if (Spi.rxn < 2) {
+			Spi.rx[Spi.rxn++] = miso;
+		} else {
+			Spi.ovf = 1;
+			Stats.overflows++;
+		}
+	}
+	if (Spi.txFull) {
+		spi_shift();
+	} else {
+		Spi.txc = 1;
+	}
+}
+
+
+static uint8_t spi_pop (void)
+{
+	uint8_t b = Spi.rx[0];
+
+	if (Spi.rxn) {
+		Spi.rx[0] = Spi.rx[1];
+		Spi.rxn--;
+	}
+	return b;
+}
+
+
+static void spi_push (uint8_t b)
+{
+	if (!spi_enabled() || Spi.txFull) {
+		Stats.dropped++;
+		return;
+	}
+	Spi.tx = b;
+	Spi.txFull = 1;
+	Spi.txc = 0;
+	spi_shift();
+}
+
+
+static uint32_t sercom_read (uint32_t a, uint32_t off, int peek)
+{
+	switch (off) {
+	case 0x18:							/* INTFLAG */
+		return (spi_enabled() && !Spi.txFull ? SERCOM_SPI_INTFLAG_DRE : 0)
+			| (Spi.txc ? SERCOM_SPI_INTFLAG_TXC : 0)
+			| (Spi.rxn ? SERCOM_SPI_INTFLAG_RXC : 0);
+	case 0x1A:
+		return Spi.ovf ? SERCOM_SPI_STATUS_BUFOVF : 0;
+	case 0x1C:							/* SYNCBUSY: synchronization is instant */
+		return 0;
+	case 0x28:
+		return peek ? Spi.rx[0] : spi_pop();
+	}
+	return get(a, off == 0x0C || off == 0x14 || off == 0x16 || off == 0x30 ? 1 : 4);
+}
+
+
+static void sercom_write (uint32_t a, uint32_t off, uint32_t v)
+{
+	switch (off) {
+	case 0x00:
+		if (v & SERCOM_SPI_CTRLA_SWRST) {
+			memset(loc(SERCOM_A(0)), 0, 0x34);
+			memset(&Spi, 0, sizeof Spi);
+			return;
+		}
+		if (!(v & SERCOM_SPI_CTRLA_ENABLE)) {	/* Disabling drops the bytes in flight */
+			memset(&Spi, 0, sizeof Spi);
+		}
+		put(a, 4, v);
+		break;
+	case 0x18:
+		if (v & SERCOM_SPI_INTFLAG_TXC) Spi.txc = 0;
+		break;
+	case 0x1A:
+		if (v & SERCOM_SPI_STATUS_BUFOVF) Spi.ovf = 0;
+		break;
+	case 0x28:
+		spi_push((uint8_t)v);
+		break;
+	default:
+		put(a, off == 0x0C || off == 0x14 || off == 0x16 || off == 0x30 ? 1 : 4, v);
+		break;
+	}
+}
+
+
+
+/*-----------------------------------------------------------------------*/
+/* DMAC                                                                  */
+/*-----------------------------------------------------------------------*/
+
+#define DMAC_A(off)	(0x41004800u + (off))
+
+static void crc_byte (uint8_t b)
+{
+	int i;
+
+	Crc ^= (uint16_t)(b << 8);
+	for (i = 0; i < 8; i++) Crc = (Crc & 0x8000) ? (uint16_t)(Crc << 1 ^ 0x1021) : (uint16_t)(Crc << 1);
+}
+
+
+/* Schedule the next beat of channels whose trigger is up */
+static void dma_trigger (void)
+{
+	int i, trig;
+
+	if (!(get(DMAC_A(0x00), 2) & DMAC_CTRL_DMAENABLE)) return;
+	for (i = 0; i < 2; i++) {
+		if (!Ch[i].on || Ch[i].beatAt != SAMD21_NEVER) continue;
+		switch (Ch[i].ctrlb >> 8 & 0x3F) {
+		case SERCOM1_DMAC_ID_RX: trig = Spi.rxn > 0; break;
+		case SERCOM1_DMAC_ID_TX: trig = spi_enabled() && !Spi.txFull; break;
+		default: trig = 0; break;
+		}
+		if (trig) Ch[i].beatAt = Now + SAMD21_DMA_CYCLES;
+	}
+}
+
+
+static void dma_beat (int i)
+{
+	DMACH* c = &Ch[i];
+	uint8_t b;
+	uint16_t crcctrl = (uint16_t)get(DMAC_A(0x02), 2);
+
+	c->beatAt = SAMD21_NEVER;
+	b = c->srcIo ? spi_pop() : *c->src;
+	if (c->dstIo) spi_push(b); else *c->dst = b;
+	if ((get(DMAC_A(0x00), 2) & DMAC_CTRL_CRCENABLE) && (crcctrl >> 8 & 0x3F) == 0x20u + i) crc_byte(b);
+	if (c->srcInc) c->src++;
+	if (c->dstInc) c->dst++;
+	Stats.dmaBeats++;
+
+	if (--c->left == 0) {				/* Block done, write back the descriptor */
+		DmacDescriptor* wb = (DmacDescriptor*)(uintptr_t)get(DMAC_A(0x38), 4) + i;
+
+		c->on = 0;
+		c->intflag |= DMAC_CHINTFLAG_TCMPL;
+		wb->BTCNT.reg = 0;
+	}
+}
+
+
+/* CHCTRLA.ENABLE set: fetch the descriptor */
+static void dma_start (int i)
+{
+	DMACH* c = &Ch[i];
+	DmacDescriptor* d = (DmacDescriptor*)(uintptr_t)get(DMAC_A(0x34), 4) + i;
+	uint16_t bt = d->BTCTRL.reg;
+	uint32_t n = d->BTCNT.reg;
+
+	if (!(bt & DMAC_BTCTRL_VALID) || (bt >> 8 & 3) != 0 || n == 0 || d->DESCADDR.reg != 0) {
+		c->intflag |= DMAC_CHINTFLAG_TERR;	/* Only single byte-beat blocks are modelled */
+		return;
+	}
+	c->left = n;
+	c->srcInc = (bt & DMAC_BTCTRL_SRCINC) != 0;
+	c->dstInc = (bt & DMAC_BTCTRL_DSTINC) != 0;
+	c->srcIo = d->SRCADDR.reg == SPI_DATA;
+	c->dstIo = d->DSTADDR.reg == SPI_DATA;
+	c->src = (uint8_t*)(uintptr_t)(d->SRCADDR.reg - (c->srcInc ? n : 0));
+	c->dst = (uint8_t*)(uintptr_t)(d->DSTADDR.reg - (c->dstInc ? n : 0));
+	c->beatAt = SAMD21_NEVER;
+	c->on = 1;
+}
+
+
+static uint32_t dmac_read (uint32_t a, uint32_t off)
+{
+	DMACH* c = &Ch[*loc(DMAC_A(0x3F)) & 1];
+	uint32_t v = 0;
+	int i;
+
+	switch (off) {
+	case 0x00:
+		return get(a, 2) & ~DMAC_CTRL_SWRST;
+	case 0x08:
+		return Crc;
+	case 0x20:							/* INTPEND: lowest channel with an interrupt */
+		for (i = 0; i < 2; i++) {
+			if (Ch[i].intflag & Ch[i].inten) {
+				return (uint32_t)i | (uint32_t)Ch[i].intflag << 8 | 1u << 15;
+			}
+		}
+		return 0;
+	case 0x24:
+		for (i = 0; i < 2; i++) if (Ch[i].intflag & Ch[i].inten) v |= 1u << i;
+		return v;
+	case 0x28: case 0x30:
+		for (i = 0; i < 2; i++) if (Ch[i].on) v |= 1u << i;
+		return v;
+	case 0x40: return c->on ? DMAC_CHCTRLA_ENABLE : 0;
+	case 0x44: return c->ctrlb;
+	case 0x4C: case 0x4D: return c->inten;
+	case 0x4E: return c->intflag;
+	case 0x4F: return 0;
+	}
+	return get(a, (off >= 0x0C && off < 0x10) || off == 0x3F ? 1 : off < 4 ? 2 : 4);
+}
+
+
+static void dmac_write (uint32_t a, uint32_t off, uint32_t v)
+{
+	DMACH* c = &Ch[*loc(DMAC_A(0x3F)) & 1];
+	int i = (int)(c - Ch);
+
+	switch (off) {
+	case 0x00:
+		if (v & DMAC_CTRL_SWRST) {
+			memset(loc(DMAC_A(0)), 0, 0x50);
+			memset(Ch, 0, sizeof Ch);
+			Ch[0].beatAt = Ch[1].beatAt = SAMD21_NEVER;
+			Crc = 0;
+			return;
+		}
+		put(a, 2, v);
+		break;
+	case 0x08:
+		Crc = (uint16_t)v;
+		break;
+	case 0x20:							/* INTPEND: clear the flags of channel ID */
+		Ch[v & 1].intflag &= (uint8_t)~(v >> 8 & 3);
+		break;
+	case 0x3F:
+		if ((v & 15) > 1) fatal("only DMAC channels 0 and 1 are modelled");
+		put(a, 1, v);
+		break;
+	case 0x40:
+		if (v & DMAC_CHCTRLA_SWRST) {
+			memset(c, 0, sizeof *c);
+			c->beatAt = SAMD21_NEVER;
+		} else if ((v & DMAC_CHCTRLA_ENABLE) && !c->on) {
+			dma_start(i);
+		} else if (!(v & DMAC_CHCTRLA_ENABLE)) {
+			c->on = 0;
+			c->beatAt = SAMD21_NEVER;
+		}
+		break;
+	case 0x44: c->ctrlb = v; break;
+	case 0x4C: c->inten &= (uint8_t)~v; break;
+	case 0x4D: c->inten |= (uint8_t)v; break;
+	case 0x4E: c->intflag &= (uint8_t)~v; break;
+	default:
+		put(a, (off >= 0x0C && off < 0x10) || off == 0x3F ? 1 : off < 4 ? 2 : 4, v);
+		break;
+	}
+	dma_trigger();
+}
+
+
+
+/*-----------------------------------------------------------------------*/
+/* NVMCTRL and the flash row                                             */
+/*-----------------------------------------------------------------------*/
+
+#define NVM_A(off)	(0x41004000u + (off))
+
+/* Row erase and page write times, typical figures from the datasheet */
+#define NVM_ER_CYCLES	(SAMD21_HZ / 1000u * 6u)
+#define NVM_WP_CYCLES	(SAMD21_HZ / 1000u * 25u / 10u)
+
+static void flash_open (int rw)
+{
+	uintptr_t p = (uintptr_t)Nvm.row & ~(uintptr_t)(PAGE - 1);
+	uintptr_t e = ((uintptr_t)Nvm.row + Nvm.rowSize + PAGE - 1) & ~(uintptr_t)(PAGE - 1);
+
+	if (mprotect((void*)p, e - p, rw ? PROT_READ | PROT_WRITE : PROT_READ) != 0) fatal("mprotect of the flash row");
+}
+
+
+/* Flash row offset of the word address in ADDR, -1 outside the row */
+static long nvm_target (void)
+{
+	uintptr_t a = (uintptr_t)get(NVM_A(0x1C), 4) * 2;
+
+	if (!Nvm.row || a < (uintptr_t)Nvm.row || a >= (uintptr_t)Nvm.row + Nvm.rowSize) return -1;
+	return (long)(a - (uintptr_t)Nvm.row);
+}
+
+
+static void nvm_page_write (long off)
+{
+	int i, page = (int)(off / FLASH_PAGE_SIZE);
+
+	flash_open(1);
+	for (i = 0; i < FLASH_PAGE_SIZE; i++) Nvm.row[page * FLASH_PAGE_SIZE + i] &= Nvm.buf[i];	/* Programming only clears bits */
+	flash_open(0);
+	memset(Nvm.buf, 0xFF, sizeof Nvm.buf);
+	Nvm.bufPage = -1;
+	Stats.flashWrites++;
+}
+
+
+static void nvm_done (void)
+{
+	long off = nvm_target();
+
+	Nvm.busy = 0;
+	Nvm.doneAt = SAMD21_NEVER;
+	switch (Nvm.cmd) {
+	case NVMCTRL_CTRLA_CMD_ER:
+		flash_open(1);
+		memset(Nvm.row + (off & ~(long)(Nvm.rowSize - 1)), 0xFF, Nvm.rowSize);
+		flash_open(0);
+		break;
+	case NVMCTRL_CTRLA_CMD_WP:
+		nvm_page_write(off);
+		break;
+	}
+}
+
+
+static void nvm_command (uint32_t v)
+{
+	uint16_t status = (uint16_t)get(NVM_A(0x18), 2);
+
+	if ((v >> 8) != 0xA5 || Nvm.busy) {
+		put(NVM_A(0x18), 2, status | NVMCTRL_STATUS_PROGE);
+		return;
+	}
+	Nvm.cmd = (uint8_t)(v & 0x7F);
+	switch (Nvm.cmd) {
+	case NVMCTRL_CTRLA_CMD_PBC:
+		memset(Nvm.buf, 0xFF, sizeof Nvm.buf);
+		Nvm.bufPage = -1;
+		return;
+	case NVMCTRL_CTRLA_CMD_ER:
+	case NVMCTRL_CTRLA_CMD_WP:
+		if (nvm_target() < 0) fatal("NVM command outside the flash row");
+		Nvm.busy = 1;
+		Nvm.doneAt = Now + (Nvm.cmd == NVMCTRL_CTRLA_CMD_ER ? NVM_ER_CYCLES : NVM_WP_CYCLES);
+		return;
+	}
+	put(NVM_A(0x18), 2, status | NVMCTRL_STATUS_PROGE);
+}
+
+
+/* Store into the flash row: goes to the page buffer */
+static void flash_store (uintptr_t a, int n, uint64_t v)
+{
+	long off = (long)(a - (uintptr_t)Nvm.row);
+	int page = (int)(off / FLASH_PAGE_SIZE), i;
+
+	if (Nvm.bufPage >= 0 && Nvm.bufPage != page) fatal("page buffer loaded across pages");
+	Nvm.bufPage = page;
+	for (i = 0; i < n; i++) Nvm.buf[(off + i) % FLASH_PAGE_SIZE] = (uint8_t)(v >> 8 * i);
+
+	/* Without MANW, writing the last word of the page starts the write */
+	if (!(get(NVM_A(0x04), 4) & (1u << 7)) && (off + n) % FLASH_PAGE_SIZE == 0) {
+		nvm_page_write(off);
+	}
+}
+
+
+static uint32_t nvm_read (uint32_t a, uint32_t off)
+{
+	if (off == 0x14) return (Nvm.busy ? 0 : 1) | (get(a, 1) & 2);	/* INTFLAG.READY */
+	return get(a, off == 0x0C || off == 0x10 || off == 0x14 ? 1 : off == 0x00 || off == 0x18 || off == 0x20 ? 2 : 4);
+}
+
+
+static void nvm_write (uint32_t a, uint32_t off, uint32_t v)
+{
+	switch (off) {
+	case 0x00: nvm_command(v); break;
+	case 0x14: put(a, 1, get(a, 1) & ~(v & 2)); break;
+	case 0x18: put(a, 2, get(a, 2) & ~v); break;
+	default:
+		put(a, off == 0x0C || off == 0x10 ? 1 : off == 0x20 ? 2 : 4, v);
+		break;
+	}
+}
+
+
+
+/*-----------------------------------------------------------------------*/
+/* Clock and interrupts                                                  */
+/*-----------------------------------------------------------------------*/
+
+static uint64_t next_event (void)
+{
+	uint64_t t = SAMD21_NEVER, h;
+
+	if (Spi.shifting && Spi.shEnd < t) t = Spi.shEnd;
+	if (Ch[0].beatAt < t) t = Ch[0].beatAt;
+	if (Ch[1].beatAt < t) t = Ch[1].beatAt;
+	if (TickNext < t) t = TickNext;
+	if (Nvm.busy && Nvm.doneAt < t) t = Nvm.doneAt;
+	if (eic_armed() && !(get(0x40001810u, 4) & EIC_INTFLAG_EXTINT3)) {
+		h = miso_high_at();
+		if (h < t) t = h > Now ? h : Now;
+	}
+	return t;
+}
+
+
+/* Run the peripherals up to time t */
+static void advance (uint64_t t)
+{
+	uint64_t e;
+
+	while ((e = next_event()) <= t) {
+		if (e > Now) Now = e;
+		if (Spi.shifting && Spi.shEnd <= Now) spi_shift_done();
+		if (Ch[0].beatAt <= Now) dma_beat(0);
+		if (Ch[1].beatAt <= Now) dma_beat(1);
+		if (TickNext <= Now) {
+			TickPending = 1;
+			TickNext += TickPeriod;
+		}
+		if (Nvm.busy && Nvm.doneAt <= Now) nvm_done();
+		eic_update();
+		dma_trigger();
+	}
+	if (t > Now) Now = t;
+}
+
+
+/* Interrupts pending in the NVIC, PRIMASK aside */
+static int irq_pending (void)
+{
+	int p = 0;
+
+	if (TickPending) p |= 1;
+	if ((Nvic & 1 << EIC_IRQn) && (get(0x40001810u, 4) & get(0x4000180Cu, 4))) p |= 1 << EIC_IRQn;
+	if ((Nvic & 1 << DMAC_IRQn) && ((Ch[0].intflag & Ch[0].inten) || (Ch[1].intflag & Ch[1].inten))) {
+		p |= 1 << DMAC_IRQn;
+	}
+	return p;
+}
+
+
+/* Take pending interrupts, lowest exception number first */
+static void dispatch (void)
+{
+	int p, storm = 0;
+
+	while (!InIsr && !Primask && (p = irq_pending()) != 0) {
+		if (++storm > 1000) fatal("interrupt not cleared by its handler");
+		InIsr = 1;
+		advance(Now + SAMD21_ISR_CYCLES);
+		if (p & 1) {
+			TickPending = 0;
+			Stats.ticks++;
+			if (SysTick_Handler) SysTick_Handler();
+		} else if (p & 1 << EIC_IRQn) {
+			Stats.eicIrqs++;
+			if (!EIC_Handler) fatal("EIC interrupt without EIC_Handler");
+			EIC_Handler();
+		} else {
+			Stats.dmacIrqs++;
+			if (!DMAC_Handler) fatal("DMAC interrupt without DMAC_Handler");
+			DMAC_Handler();
+		}
+		InIsr = 0;
+	}
+}
+
+
+/* Let c cycles of CPU time pass, taking interrupts as they come */
+static void run_cycles (uint64_t c)
+{
+	uint64_t end = Now + c, e;
+
+	while (Now < end) {
+		e = next_event();
+		advance(e < end ? e : end);
+		dispatch();
+	}
+}
+
+
+void samd21_primask (int set)
+{
+	InModel++;
+	Primask = set;
+	dispatch();
+	InModel--;
+}
+
+
+void samd21_nvic_enable (int irq, int on)
+{
+	InModel++;
+	if (irq < 0 || irq > 31) fatal("bad IRQ number");
+	if (on) Nvic |= 1 << irq; else Nvic &= ~(1 << irq);
+	dispatch();
+	InModel--;
+}
+
+
+uint32_t samd21_systick_config (uint32_t ticks)
+{
+	if (ticks == 0 || ticks > 0x1000000u) return 1;
+	TickPeriod = ticks;
+	TickNext = Now + ticks;
+	return 0;
+}
+
+
+/* Sleep until an enabled interrupt is pending, PRIMASK does not stop the wake-up */
+void samd21_wfi (void)
+{
+	uint64_t start, e;
+
+	InModel++;
+	start = Now;
+	while (!irq_pending()) {
+		e = next_event();
+		if (e == SAMD21_NEVER) fatal("WFI with no wake-up source");
+		advance(e);
+	}
+	if (Now > start) {
+		Stats.sleep += Now - start;
+		Stats.wakeups++;
+	}
+	dispatch();
+	InModel--;
+}
+
+
+/* delay.c: 7 cycles per loop */
+void delay_n_cycles (unsigned long n)
+{
+	InModel++;
+	run_cycles((uint64_t)n * 7);
+	InModel--;
+}
+
+
+/* USART3.c: the driver's messages go to the stream set with samd21_uart() */
+void UART3_Write_Text (char* text)
+{
+	Stats.uartLines++;
+	if (Uart) fputs(text, Uart);
+}
+
+
+
+/*-----------------------------------------------------------------------*/
+/* Register access                                                       */
+/*-----------------------------------------------------------------------*/
+
+/* Current value of the register at a, with read side effects unless peek */
+static uint32_t reg_read (uint32_t a, int size, int peek)
+{
+	uint32_t base;
+	int sz, p = reg_at(a, &base, &sz);
+	uint32_t off = a - Periph[p < P_NONE ? p : 0].base;
+
+	(void)size;
+	switch (p) {
+	case P_SYSCTRL:
+		if (off == 0x0C) return 0x1F;	/* PCLKSR: every oscillator ready */
+		break;
+	case P_GCLK:
+		if (off == 0x01) return 0;		/* STATUS: never busy */
+		break;
+	case P_EIC: return eic_read(a, off);
+	case P_NVM: return nvm_read(a, off);
+	case P_PORT: return port_read(a, off & 0x7F);
+	case P_DMAC: return dmac_read(a, off);
+	case P_SERCOM: return sercom_read(a, off, peek);
+	}
+	return get(a, sz);
+}
+
+
+static void reg_write (uint32_t a, int size, uint32_t v)
+{
+	uint32_t base;
+	int sz, p = reg_at(a, &base, &sz);
+	uint32_t off = a - Periph[p < P_NONE ? p : 0].base;
+
+	switch (p) {
+	case P_EIC: eic_write(a, off, v); break;
+	case P_NVM: nvm_write(a, off, v); break;
+	case P_PORT: port_write(a, off & 0x7F, v); break;
+	case P_DMAC: dmac_write(a, off, v); break;
+	case P_SERCOM: sercom_write(a, off, v); break;
+	default: put(a, size, v); break;
+	}
+}
+
+
+/* Load n bytes at a, each register in the range read once */
+static uint64_t io_load (uint32_t a, int n)
+{
+	uint32_t p, base;
+	uint64_t v = 0;
+	int size, i;
+
+	for (p = a; p < a + n; p = base + size) {
+		reg_at(p, &base, &size);
+		put(base, size, reg_read(base, size, 0));
+	}
+	for (i = n - 1; i >= 0; i--) v = v << 8 | *loc(a + i);
+	return v;
+}
+
+
+/* Store n bytes at a, merged into the registers they cover */
+static void io_store (uint32_t a, int n, uint64_t v)
+{
+	uint32_t p, base, cur;
+	int size, i;
+
+	for (p = a; p < a + n; p = base + size) {
+		reg_at(p, &base, &size);
+		cur = reg_read(base, size, 1);
+		for (i = 0; i < size; i++) {
+			if (base + i >= a && base + i < a + n) {
+				cur = (cur & ~(0xFFu << 8 * i)) | (uint32_t)(v >> 8 * (base + i - a) & 0xFF) << 8 * i;
+			}
+		}
+		reg_write(base, size, cur);
+	}
+}
+
+
+static void access_begin (void)
+{
+	InModel++;
+	Stats.accesses++;
+	advance(Now + SAMD21_ACCESS_CYCLES);
+}
+
+
+static void access_end (void)
+{
+	dispatch();
+	InModel--;
+}
+
+
+
+/*-----------------------------------------------------------------------*/
+/* x86-64 decoding of the faulting instruction                           */
+/*-----------------------------------------------------------------------*/
+/* Covers what GCC emits for volatile register access: mov, movzx,       */
+/* movsx, and the ALU forms add/or/and/sub/xor/cmp and test against a    */
+/* register or an immediate. Anything else is single stepped.            */
+
+static const int GregOf[16] = {
+	REG_RAX, REG_RCX, REG_RDX, REG_RBX, REG_RSP, REG_RBP, REG_RSI, REG_RDI,
+	REG_R8, REG_R9, REG_R10, REG_R11, REG_R12, REG_R13, REG_R14, REG_R15
+};
+
+enum { OP_LOAD, OP_LOADZX, OP_LOADSX, OP_STORE, OP_ALU_RM, OP_ALU_R, OP_TEST };
+
+typedef struct {
+	int len, op, size, srcSize, reg, rex, alu, useImm;
+	int64_t imm;
+} INSN;
+
+
+static uint64_t size_mask (int size)
+{
+	return size == 8 ? ~(uint64_t)0 : ((uint64_t)1 << 8 * size) - 1;
+}
+
+
+static uint64_t get_reg (ucontext_t* uc, const INSN* in)
+{
+	greg_t* g = uc->uc_mcontext.gregs;
+
+	if (in->size == 1 && !in->rex && in->reg >= 4 && in->reg < 8) {	/* AH, CH, DH, BH */
+		return (uint64_t)g[GregOf[in->reg - 4]] >> 8 & 0xFF;
+	}
+	return (uint64_t)g[GregOf[in->reg]] & size_mask(in->size);
+}
+
+
+static void set_reg (ucontext_t* uc, const INSN* in, int size, uint64_t v)
+{
+	greg_t* r;
+
+	if (size == 1 && !in->rex && in->reg >= 4 && in->reg < 8) {
+		r = &uc->uc_mcontext.gregs[GregOf[in->reg - 4]];
+		*r = (greg_t)(((uint64_t)*r & ~(uint64_t)0xFF00) | (v & 0xFF) << 8);
+		return;
+	}
+	r = &uc->uc_mcontext.gregs[GregOf[in->reg]];
+	if (size >= 4) {
+		*r = (greg_t)(v & size_mask(size));		/* 32-bit writes zero the upper half */
+	} else {
+		*r = (greg_t)(((uint64_t)*r & ~size_mask(size)) | (v & size_mask(size)));
+	}
+}
+
+
+static int decode (const uint8_t* ip, INSN* in)
+{
+	const uint8_t* p = ip;
+	int opsize16 = 0, rexw = 0, mod, rm, immSize = 0, w;
+	uint8_t opc, modrm;
+
+	memset(in, 0, sizeof *in);
+	for (;; p++) {
+		if (*p == 0x66) opsize16 = 1;
+		else if (*p == 0x2E || *p == 0x3E || *p == 0x26 || *p == 0x36 || *p == 0xF0) ;
+		else break;
+	}
+	if ((*p & 0xF0) == 0x40) {
+		in->rex = *p++;
+		rexw = in->rex & 8;
+	}
+	opc = *p++;
+	w = opc & 1;
+
+	if (opc == 0x0F) {
+		opc = *p++;
+		if (opc != 0xB6 && opc != 0xB7 && opc != 0xBE && opc != 0xBF) return 0;
+		in->op = (opc & 8) ? OP_LOADSX : OP_LOADZX;
+		in->srcSize = (opc & 1) ? 2 : 1;
+		w = 1;
+	} else if (opc == 0x88 || opc == 0x89) {
+		in->op = OP_STORE;
+	} else if (opc == 0x8A || opc == 0x8B) {
+		in->op = OP_LOAD;
+	} else if (opc == 0xC6 || opc == 0xC7) {
+		in->op = OP_STORE;
+		in->useImm = 1;
+		immSize = w ? (opsize16 ? 2 : 4) : 1;
+	} else if (opc == 0x84 || opc == 0x85) {
+		in->op = OP_TEST;
+	} else if (opc == 0xF6 || opc == 0xF7) {
+		in->op = OP_TEST;
+		in->useImm = 1;
+		immSize = w ? (opsize16 ? 2 : 4) : 1;
+	} else if (opc < 0x40 && (opc & 7) < 4 && (opc >> 3) != 2 && (opc >> 3) != 3) {
+		in->alu = opc >> 3;				/* add, or, and, sub, xor, cmp; not adc/sbb */
+		in->op = (opc & 2) ? OP_ALU_R : OP_ALU_RM;
+	} else if (opc == 0x80 || opc == 0x81 || opc == 0x83) {
+		in->op = OP_ALU_RM;
+		in->useImm = 1;
+		immSize = opc == 0x81 ? (opsize16 ? 2 : 4) : 1;
+		w = opc != 0x80;
+	} else {
+		return 0;
+	}
+
+	in->size = !w ? 1 : rexw ? 8 : opsize16 ? 2 : 4;
+	modrm = *p++;
+	mod = modrm >> 6;
+	rm = modrm & 7;
+	in->reg = (modrm >> 3 & 7) | ((in->rex & 4) ? 8 : 0);
+	if (mod == 3) return 0;				/* Register operand, cannot have faulted */
+	if (in->useImm && (opc == 0x80 || opc == 0x81 || opc == 0x83)) {
+		in->alu = modrm >> 3 & 7;
+		if (in->alu == 2 || in->alu == 3) return 0;
+	}
+	if (in->useImm && (opc & 0xFE) == 0xF6 && (modrm >> 3 & 7) != 0) return 0;
+	if (in->useImm && (opc & 0xFE) == 0xC6 && (modrm >> 3 & 7) != 0) return 0;
+
+	if (rm == 4) {						/* SIB */
+		if (mod == 0 && (*p & 7) == 5) p += 4;
+		p++;
+	} else if (mod == 0 && rm == 5) {	/* RIP relative */
+		p += 4;
+	}
+	if (mod == 1) p += 1;
+	if (mod == 2) p += 4;
+
+	if (immSize == 1) in->imm = (int8_t)*p;
+	if (immSize == 2) in->imm = (int16_t)(p[0] | p[1] << 8);
+	if (immSize == 4) in->imm = (int32_t)(p[0] | p[1] << 8 | p[2] << 16 | (uint32_t)p[3] << 24);
+	p += immSize;
+	in->len = (int)(p - ip);
+	return 1;
+}
+
+
+/* Arithmetic flags of an ALU operation */
+static uint64_t alu (ucontext_t* uc, int op, int size, uint64_t a, uint64_t b)
+{
+	uint64_t m = size_mask(size), sign = (uint64_t)1 << (8 * size - 1), r;
+	greg_t* efl = &uc->uc_mcontext.gregs[REG_EFL];
+	long f = 0;
+	int par;
+
+	a &= m;
+	b &= m;
+	switch (op) {
+	case 0: r = (a + b) & m; if (r < a) f |= 0x001; if (~(a ^ b) & (a ^ r) & sign) f |= 0x800; break;
+	case 1: r = a | b; break;
+	case 4: r = a & b; break;
+	case 5: case 7: r = (a - b) & m; if (a < b) f |= 0x001; if ((a ^ b) & (a ^ r) & sign) f |= 0x800; break;
+	case 6: r = a ^ b; break;
+	default: r = a & b; break;			/* test */
+	}
+	if ((op == 0 || op == 5 || op == 7) && ((a ^ b ^ r) & 0x10)) f |= 0x010;
+	if (r == 0) f |= 0x040;
+	if (r & sign) f |= 0x080;
+	par = __builtin_parity((unsigned)(r & 0xFF));
+	if (!par) f |= 0x004;
+	*efl = (*efl & ~0x8D5L) | f;
+	return r;
+}
+
+
+/* Apply the decoded instruction, ld/st doing the memory side */
+static void execute (ucontext_t* uc, const INSN* in, uint64_t (*ld)(uintptr_t, int), void (*st)(uintptr_t, int, uint64_t), uintptr_t a)
+{
+	uint64_t v, src;
+
+	switch (in->op) {
+	case OP_LOAD:
+		set_reg(uc, in, in->size, ld(a, in->size));
+		break;
+	case OP_LOADZX:
+	case OP_LOADSX:
+		v = ld(a, in->srcSize);
+		if (in->op == OP_LOADSX) v = in->srcSize == 1 ? (uint64_t)(int64_t)(int8_t)v : (uint64_t)(int64_t)(int16_t)v;
+		set_reg(uc, in, in->size, v);
+		break;
+	case OP_STORE:
+		st(a, in->size, in->useImm ? (uint64_t)in->imm : get_reg(uc, in));
+		break;
+	case OP_TEST:
+		alu(uc, -1, in->size, ld(a, in->size), in->useImm ? (uint64_t)in->imm : get_reg(uc, in));
+		break;
+	case OP_ALU_RM:						/* Memory is the destination */
+		src = in->useImm ? (uint64_t)in->imm : get_reg(uc, in);
+		v = alu(uc, in->alu, in->size, ld(a, in->size), src);
+		if (in->alu != 7) st(a, in->size, v);
+		break;
+	case OP_ALU_R:						/* Register is the destination */
+		v = alu(uc, in->alu, in->size, get_reg(uc, in), ld(a, in->size));
+		if (in->alu != 7) set_reg(uc, in, in->size, v);
+		break;
+	}
+	uc->uc_mcontext.gregs[REG_RIP] += in->len;
+}
+
+
+static uint64_t io_ld (uintptr_t a, int n) { return io_load((uint32_t)a, n); }
+static void io_st (uintptr_t a, int n, uint64_t v) { io_store((uint32_t)a, n, v); }
+
+static uint64_t flash_ld (uintptr_t a, int n)
+{
+	uint64_t v = 0;
+
+	memcpy(&v, (const void*)a, n);
+	return v;
+}
+
+
+
+/*-----------------------------------------------------------------------*/
+/* Fault handlers                                                        */
+/*-----------------------------------------------------------------------*/
+
+static int io_page (uintptr_t a)
+{
+	unsigned i;
+
+	for (i = 0; i < NPAGES; i++) {
+		if (a - PageAddr[i] < PAGE) return (int)i;
+	}
+	return -1;
+}
+
+
+static void on_segv (int sig, siginfo_t* si, void* ctx)
+{
+	ucontext_t* uc = ctx;
+	uintptr_t a = (uintptr_t)si->si_addr;
+	int write = (uc->uc_mcontext.gregs[REG_ERR] >> 1) & 1, pg = io_page(a);
+	INSN in;
+
+	(void)sig;
+	if (pg >= 0) {
+		access_begin();
+		if (decode((const uint8_t*)uc->uc_mcontext.gregs[REG_RIP], &in)) {
+			execute(uc, &in, io_ld, io_st, a);
+			access_end();
+			return;
+		}
+
+		/* Single step it with the page open: reads see the register prepared
+		   beforehand, writes are picked up from the page afterwards */
+		Stats.stepped++;
+		reg_at((uint32_t)a, &StepBase, &StepSize);
+		StepWrite = write;
+		put(StepBase, StepSize, reg_read(StepBase, StepSize, write));
+		mprotect((void*)(uintptr_t)PageAddr[pg], PAGE, PROT_READ | PROT_WRITE);
+		uc->uc_mcontext.gregs[REG_EFL] |= 0x100;
+		return;
+	}
+
+	if (Nvm.row && write && a >= (uintptr_t)Nvm.row && a < (uintptr_t)Nvm.row + Nvm.rowSize
+		&& decode((const uint8_t*)uc->uc_mcontext.gregs[REG_RIP], &in) && in.op == OP_STORE) {
+		InModel++;
+		execute(uc, &in, flash_ld, flash_store, a);
+		InModel--;
+		return;
+	}
+
+	fprintf(stderr, "samd21: fault at %p, rip %p\n", (void*)a, (void*)uc->uc_mcontext.gregs[REG_RIP]);
+	signal(SIGSEGV, SIG_DFL);
+}
+
+
+static void on_trap (int sig, siginfo_t* si, void* ctx)
+{
+	ucontext_t* uc = ctx;
+
+	(void)sig;
+	(void)si;
+	uc->uc_mcontext.gregs[REG_EFL] &= ~0x100L;
+	mprotect((void*)(uintptr_t)(StepBase & ~(PAGE - 1)), PAGE, PROT_NONE);
+	if (StepWrite) reg_write(StepBase, StepSize, get(StepBase, StepSize));
+	access_end();
+}
+
+
+/* samd21_spin(): a loop polling RAM that an interrupt will end */
+static void on_alarm (int sig)
+{
+	uint64_t start = Now, e;
+
+	(void)sig;
+	if (!SpinOn || InModel || InIsr) return;
+	if (Stats.accesses != SpinSeen) {
+		SpinSeen = Stats.accesses;
+		SpinIdle = 0;
+		return;
+	}
+	if (++SpinIdle < 2 || Primask) return;
+
+	InModel++;
+	while (!irq_pending() && (e = next_event()) != SAMD21_NEVER) advance(e);
+	Stats.spin += Now - start;
+	dispatch();
+	SpinIdle = 0;
+	InModel--;
+}
+
+
+
+/*-----------------------------------------------------------------------*/
+/* Public functions                                                      */
+/*-----------------------------------------------------------------------*/
+
+void samd21_init (void)
+{
+	static int fd = -1;
+	struct sigaction sa;
+	unsigned i;
+
+	if (fd < 0) {
+		fd = memfd_create("samd21", 0);
+		if (fd < 0 || ftruncate(fd, NPAGES * PAGE) != 0) fatal("memfd");
+		for (i = 0; i < NPAGES; i++) {
+			if (mmap((void*)(uintptr_t)PageAddr[i], PAGE, PROT_NONE, MAP_SHARED | MAP_FIXED_NOREPLACE, fd, i * PAGE)
+				!= (void*)(uintptr_t)PageAddr[i]) fatal("cannot map the register pages");
+			Shadow[i] = mmap(0, PAGE, PROT_READ | PROT_WRITE, MAP_SHARED, fd, i * PAGE);
+			if (Shadow[i] == MAP_FAILED) fatal("mmap");
+		}
+		FwStack = mmap(0, STACK_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_32BIT | MAP_STACK, -1, 0);
+		if (FwStack == MAP_FAILED) fatal("stack below 4 GB");
+
+		memset(&sa, 0, sizeof sa);
+		sa.sa_flags = SA_SIGINFO | SA_NODEFER;
+		sigaddset(&sa.sa_mask, SIGALRM);
+		sa.sa_sigaction = on_segv;
+		sigaction(SIGSEGV, &sa, 0);
+		sa.sa_sigaction = on_trap;
+		sigaction(SIGTRAP, &sa, 0);
+		signal(SIGALRM, on_alarm);
+	}
+
+	/* Power-on reset */
+	for (i = 0; i < NPAGES; i++) memset(Shadow[i], 0, PAGE);
+	memset(&Spi, 0, sizeof Spi);
+	memset(Ch, 0, sizeof Ch);
+	Ch[0].beatAt = Ch[1].beatAt = SAMD21_NEVER;
+	Crc = 0;
+	Nvm.busy = 0;
+	Nvm.bufPage = -1;
+	memset(Nvm.buf, 0xFF, sizeof Nvm.buf);
+	TickNext = SAMD21_NEVER;
+	TickPending = Primask = InIsr = Nvic = 0;
+	memset(DevSel, 0, sizeof DevSel);
+	samd21_clear_stats();
+}
+
+
+void samd21_attach (const SAMDEV* dev)
+{
+	if (NDevs == MAX_DEVS) fatal("too many devices");
+	Dev[NDevs++] = *dev;
+}
+
+
+/* The flash row the NVM controller may program, kept across samd21_init().
+   The row is a const array in .rodata, whose pages are read-only anyway,
+   so stores to it fault into the page buffer. */
+void samd21_flash (const void* row, unsigned size)
+{
+	Nvm.row = (uint8_t*)(uintptr_t)row;
+	Nvm.rowSize = size;
+	flash_open(0);
+}
+
+
+void samd21_uart (FILE* fp)
+{
+	Uart = fp;
+}
+
+
+/* Fast-forward to the next interrupt when the firmware polls RAM only */
+void samd21_spin (int on)
+{
+	struct itimerval it = { { 0, 1000 }, { 0, 1000 } };
+
+	SpinOn = on;
+	if (!on) memset(&it, 0, sizeof it);
+	setitimer(ITIMER_REAL, &it, 0);
+}
+
+
+static void fw_main (void)
+{
+	FwEntry();
+}
+
+
+/* Call fn on a stack below 4 GB, where the firmware's pointer casts hold */
+void samd21_run (void (*fn)(void))
+{
+	FwEntry = fn;
+	getcontext(&FwCtx);
+	FwCtx.uc_stack.ss_sp = FwStack;
+	FwCtx.uc_stack.ss_size = STACK_SIZE;
+	FwCtx.uc_link = &HostCtx;
+	makecontext(&FwCtx, fw_main, 0);
+	swapcontext(&HostCtx, &FwCtx);
+}
+
+
+uint64_t samd21_now (void)
+{
+	return Now;
+}
+
+
+const SAMSTATS* samd21_stats (void)
+{
+	Stats.cycles = Now;
+	return &Stats;
+}
+
+
+void samd21_clear_stats (void)
+{
+	memset(&Stats, 0, sizeof Stats);
+}
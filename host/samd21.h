@@ -0,0 +1,83 @@
+/*-----------------------------------------------------------------------/
+/  SAMD21 peripheral model for host builds                               /
+/-----------------------------------------------------------------------/
+/  Runs the firmware's driver sources unmodified on Linux, built with    /
+/  the sam.h in this directory and -no-pie. Firmware code is started     /
+/  with samd21_run() and its time is kept in 48 MHz CPU cycles.          /
+/-----------------------------------------------------------------------*/
+
+#ifndef _SAMD21_DEFINED
+#define _SAMD21_DEFINED
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdio.h>
+#include <stdint.h>
+
+#define SAMD21_HZ		48000000u	/* CPU clock, also GCLK0 of SERCOM1 */
+#define SAMD21_NEVER	(~(uint64_t)0)
+
+#ifndef SAMD21_ACCESS_CYCLES
+#define SAMD21_ACCESS_CYCLES	6	/* CPU cycles charged per register access, loop overhead included */
+#endif
+#ifndef SAMD21_DMA_CYCLES
+#define SAMD21_DMA_CYCLES		6	/* DMAC latency from trigger to completed beat */
+#endif
+#ifndef SAMD21_ISR_CYCLES
+#define SAMD21_ISR_CYCLES		30	/* Exception entry and return */
+#endif
+
+
+/* Device on SERCOM1, selected while its chip select pin drives low */
+typedef struct {
+	uint32_t	cs;			/* PORT group 0 pin mask of the chip select */
+	void*		ctx;
+	uint8_t		(*xfer)(void* ctx, uint8_t mosi, uint64_t now, uint32_t hz);	/* One byte, at the end of its shift */
+	void		(*select)(void* ctx, int sel, uint64_t now);
+	uint64_t	(*ready)(void* ctx, uint64_t now);	/* When DO next goes high (now if high, SAMD21_NEVER if never) */
+} SAMDEV;
+
+
+/* Model counters */
+typedef struct {
+	uint64_t	cycles;		/* Model time */
+	uint64_t	sleep;		/* Cycles spent in WFI */
+	uint64_t	spin;		/* Cycles skipped over by samd21_spin() */
+	uint32_t	wakeups;	/* WFI calls that had to wait */
+	uint32_t	accesses;	/* Peripheral register accesses */
+	uint32_t	stepped;	/* ... that were single stepped instead of decoded */
+	uint32_t	spiBytes;	/* Bytes shifted by SERCOM1 */
+	uint64_t	spiCycles;	/* Cycles SCK was running */
+	uint32_t	dmaBeats;
+	uint32_t	ticks;		/* SysTick_Handler calls */
+	uint32_t	eicIrqs;	/* EIC_Handler calls */
+	uint32_t	dmacIrqs;	/* DMAC_Handler calls */
+	uint32_t	detached;	/* Bytes clocked while MISO was muxed away from SERCOM1 */
+	uint32_t	overflows;	/* Bytes lost to a full receive buffer */
+	uint32_t	dropped;	/* DATA writes with the transmit buffer full or SERCOM1 disabled */
+	uint32_t	clashes;	/* Bytes clocked with two devices selected */
+	uint32_t	flashWrites;	/* NVM page writes */
+	uint32_t	uartLines;	/* UART3_Write_Text calls */
+} SAMSTATS;
+
+
+/*---------------------------------------*/
+/* Prototypes for the model              */
+
+void samd21_init (void);
+void samd21_attach (const SAMDEV* dev);
+void samd21_flash (const void* row, unsigned size);
+void samd21_uart (FILE* fp);
+void samd21_spin (int on);
+void samd21_run (void (*fn)(void));
+uint64_t samd21_now (void);
+const SAMSTATS* samd21_stats (void);
+void samd21_clear_stats (void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
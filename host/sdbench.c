@@ -0,0 +1,457 @@
+/*-----------------------------------------------------------------------*/
+/* SD driver throughput and command counts on the SAMD21 model           */
+/*-----------------------------------------------------------------------*/
+/* sd.c, SPI.c, DMA.c, crc.c, clock.c, diskio.c and the cache layers     */
+/* run unmodified against samd21.c and an SD card from sdcard.c. Times   */
+/* are model cycles at 48 MHz, so they follow from the card parameters   */
+/* printed at the start and from the SAMD21_*_CYCLES costs, not from the */
+/* host. The commands are counted by the card, the data is compared with */
+/* what the card holds. "asleep" is the share of the time the CPU spent  */
+/* in WFI.                                                               */
+/*                                                                       */
+/*   sdbench [scenario ...]      (all scenarios when none is given)      */
+/*-----------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "samd21.h"
+#include "sdcard.h"
+#include "sam.h"
+#include "SD.h"
+#include "SPI.h"
+#include "NVM.h"
+#include "clock.h"
+#include "ff.h"
+#include "diskio.h"
+#include "diskcache.h"
+#include "delay.h"
+
+#define CS0		PORT_PA08		/* Chip select of slot 0, SD_CS_PINS */
+
+static SDCPARAM Param;
+static BYTE Buf[256 * 512];
+static FATFS Vol;
+static FIL File;
+static int Bad;
+static uint64_t T0;
+
+
+static void fail (const char* what, int res)
+{
+	printf("FAIL: %s (%d)\n", what, res);
+	exit(1);
+}
+
+
+static void chk (int res, const char* what)
+{
+	if (res) fail(what, res);
+}
+
+
+static void fill (BYTE* p, DWORD ofs, UINT len, int seed)
+{
+	UINT i;
+
+	for (i = 0; i < len; i++) p[i] = (BYTE)((ofs + i) * 7 + seed + ((ofs + i) >> 9));
+}
+
+
+/* Compare count sectors from sector with the card contents */
+static void verify (const BYTE* p, DWORD sector, UINT count)
+{
+	if (memcmp(p, sdcard_data(0) + (size_t)sector * 512, (size_t)count * 512)) Bad++;
+}
+
+
+/* Put a pattern on the card, written behind the driver's back */
+static void pattern (DWORD sector, UINT count)
+{
+	size_t i;
+
+	for (i = 0; i < (size_t)count * 512; i++) sdcard_data(0)[(size_t)sector * 512 + i] = (BYTE)(i * 13 + (i >> 9) + sector);
+}
+
+
+static void start (void)
+{
+	sdcard_clear(0);
+	samd21_clear_stats();
+	T0 = samd21_now();
+}
+
+
+/* One result line: model time, throughput and what the card saw */
+static void report (const char* what, DWORD bytes)
+{
+	const SDCSTATS* c = sdcard_stats(0);
+	const SAMSTATS* m = samd21_stats();
+	uint64_t cyc = samd21_now() - T0;
+
+	printf("%-24s %7.0f us %7.0f KB/s  asleep %3.0f%%  CMD17 %-5lu CMD18 %-4lu CMD12 %-4lu CMD25 %-4lu bus %lu B\n",
+		what, cyc / (SAMD21_HZ / 1e6), bytes / 1024.0 / (cyc / (double)SAMD21_HZ), 100.0 * m->sleep / cyc,
+		(unsigned long)c->cmd[17], (unsigned long)c->cmd[18], (unsigned long)c->cmd[12],
+		(unsigned long)c->cmd[25], (unsigned long)c->bytes);
+
+	/* Bus errors the driver must never cause (receive overflows are expected,
+	   SPI_WriteBlock() lets them happen and clears BUFOVF afterwards) */
+	if (m->dropped || m->detached || m->clashes) {
+		printf("FAIL: %lu dropped, %lu detached, %lu clashes\n",
+			(unsigned long)m->dropped, (unsigned long)m->detached, (unsigned long)m->clashes);
+		Bad++;
+	}
+}
+
+
+/* Fresh card in slot 0, initialized through disk_initialize() */
+static void fw_insert (void)
+{
+	chk(disk_initialize(0), "disk_initialize");
+}
+
+
+static void insert (const SDCPARAM* p)
+{
+	sdcard_insert(0, CS0, p);
+	samd21_run(fw_insert);
+}
+
+
+static void fw_start (void)
+{
+	SysTickInit();
+}
+
+
+
+/*-----------------------------------------------------------------------*/
+/* read: CMD17 per sector against one CMD18 stream                       */
+/*-----------------------------------------------------------------------*/
+/* 128 KB read three ways: a CMD17 per sector, one CMD18 with a single   */
+/* CMD12 (SDCard_ReadMultipleBlock), and disk_media_read calls of 8      */
+/* sectors that continue one CMD18 stream. Then a 1 MB file is read     */
+/* through FatFs, and a block with a corrupted CRC must fail the read.   */
+
+static void fw_read (void)
+{
+	const SDCSTATS* c = sdcard_stats(0);
+	DWORD s;
+	UINT br;
+
+	pattern(4096, 256);
+
+	start();
+	for (s = 0; s < 256; s++) chk(SDCard_ReadSingleBlock(4096 + s, Buf + s * 512), "CMD17 read");
+	report("CMD17 x 256", 256 * 512);
+	verify(Buf, 4096, 256);
+	if (c->cmd[17] != 256) Bad++;
+
+	memset(Buf, 0, sizeof Buf);
+	start();
+	chk(SDCard_ReadMultipleBlock(4096, Buf, 256), "CMD18 read");
+	report("CMD18 x 1", 256 * 512);
+	verify(Buf, 4096, 256);
+	if (c->cmd[18] != 1 || c->cmd[12] != 1) Bad++;
+
+	memset(Buf, 0, sizeof Buf);
+	start();
+	for (s = 0; s < 256; s += 8) chk(disk_media_read(0, Buf + s * 512, 4096 + s, 8), "stream read");
+	chk(SDCard_StopTransfer(), "stop");
+	report("disk_media_read 8 x 32", 256 * 512);
+	verify(Buf, 4096, 256);
+	if (c->cmd[18] != 1 || c->cmd[12] != 1) Bad++;
+
+	/* FatFs on top, with the sector cache and read-ahead below it */
+	chk(f_mount(&Vol, "0:", 0), "f_mount");
+	chk(f_mkfs("0:", 0, 4096), "f_mkfs");
+	chk(f_mount(&Vol, "0:", 1), "f_mount");
+	chk(f_open(&File, "0:big.bin", FA_WRITE | FA_CREATE_ALWAYS), "f_open");
+	for (s = 0; s < 1024 * 1024; s += sizeof Buf) {
+		fill(Buf, s, sizeof Buf, 1);
+		chk(f_write(&File, Buf, sizeof Buf, &br) || br != sizeof Buf, "f_write");
+	}
+	chk(f_close(&File), "f_close");
+	chk(f_mount(0, "0:", 0), "unmount");
+	chk(f_mount(&Vol, "0:", 1), "f_mount");
+
+	start();
+	chk(f_open(&File, "0:big.bin", FA_READ), "f_open");
+	for (s = 0; s < 1024 * 1024; s += br) {
+		chk(f_read(&File, Buf, 32768, &br), "f_read");
+		if (!br) break;
+		fill(Buf + 32768, s, br, 1);
+		if (memcmp(Buf, Buf + 32768, br)) Bad++;
+	}
+	f_close(&File);
+	report("f_read 1 MB by 32 KB", s);
+	if (s != 1024 * 1024) Bad++;
+	chk(f_mount(0, "0:", 0), "unmount");
+
+	/* A damaged block is caught by the CRC16 and the stream is closed */
+	sdcard_fault(0, SDCARD_FAULT_CRC, 1);
+	if (SDCard_ReadMultipleBlock(4096, Buf, 4) == 0 || SDCard_GetStats()->crcErrors == 0) Bad++;
+	if (SDCard_ReadMultipleBlock(4096, Buf, 4) != 0) Bad++;
+	verify(Buf, 4096, 4);
+}
+
+
+static void bench_read (void)
+{
+	insert(&Param);
+	samd21_run(fw_read);
+}
+
+
+
+/*-----------------------------------------------------------------------*/
+/* stream: one CMD18 across sequential disk_read calls                   */
+/*-----------------------------------------------------------------------*/
+/* Single-sector reads that follow on must stay in one CMD18 stream,     */
+/* reads that jump between two areas must reopen it each time, and an    */
+/* open stream left idle for SD_STREAM_IDLE_MS is closed by              */
+/* SDCard_Service(). The CMD18 and CMD12 counts are the card's.          */
+
+static void fw_stream (void)
+{
+	const SDCSTATS* c = sdcard_stats(0);
+	DWORD s;
+
+	pattern(4096, 256);
+	pattern(8192, 256);
+	pattern(12288, 256);
+
+	memset(Buf, 0, sizeof Buf);
+	start();
+	for (s = 0; s < 256; s++) chk(disk_media_read(0, Buf + s * 512, 4096 + s, 1), "sequential read");
+	chk(SDCard_StopTransfer(), "stop");
+	report("sequential 1 x 256", 256 * 512);
+	verify(Buf, 4096, 256);
+	if (c->cmd[18] != 1 || c->cmd[12] != 1) Bad++;
+
+	memset(Buf, 0, sizeof Buf);
+	start();
+	for (s = 0; s < 256; s++) {
+		chk(disk_media_read(0, Buf + s * 512, (s & 1 ? 8192 : 4096) + s / 2, 1), "alternating read");
+	}
+	chk(SDCard_StopTransfer(), "stop");
+	report("alternating 1 x 256", 256 * 512);
+	for (s = 0; s < 256; s++) verify(Buf + s * 512, (s & 1 ? 8192 : 4096) + s / 2, 1);
+	if (c->cmd[18] != 256 || c->cmd[12] != 256) Bad++;
+
+	/* Through the sector cache and read-ahead, as FatFs calls it */
+	memset(Buf, 0, sizeof Buf);
+	start();
+	for (s = 0; s < 256; s++) chk(disk_read(0, Buf + s * 512, 12288 + s, 1), "disk_read");
+	chk(disk_ioctl(0, CTRL_SYNC, 0), "sync");
+	report("disk_read 1 x 256", 256 * 512);
+	verify(Buf, 12288, 256);
+	if (c->cmd[18] != 1 || c->cmd[12] != 1) Bad++;
+
+	/* An idle stream is closed by the service call, not by the next read */
+	start();
+	chk(disk_media_read(0, Buf, 4096, 1), "read");
+	delay_ms(SD_STREAM_IDLE_MS / 2);
+	SDCard_Service();
+	if (c->cmd[12] != 0) Bad++;
+	delay_ms(SD_STREAM_IDLE_MS);
+	SDCard_Service();
+	if (c->cmd[12] != 1) Bad++;
+	chk(disk_media_read(0, Buf + 512, 4097, 1), "read after idle");
+	chk(SDCard_StopTransfer(), "stop");
+	verify(Buf, 4096, 2);
+	if (c->cmd[18] != 2 || c->cmd[12] != 2) Bad++;
+	printf("idle close: CMD12 from SDCard_Service() after %d ms idle, next read reopens\n",
+		SD_STREAM_IDLE_MS);
+}
+
+
+static void bench_stream (void)
+{
+	insert(&Param);
+	samd21_run(fw_stream);
+}
+
+
+
+/*-----------------------------------------------------------------------*/
+/* busy: write busy slept through, woken by MISO on the EIC              */
+/*-----------------------------------------------------------------------*/
+/* 1 MB goes out in CMD25 streams of 8 blocks, and then as single-block  */
+/* streams, each closed by a stop token whose busy is waited out too.    */
+/* With SD_USE_BUSY_SLEEP the CPU must sleep through the busy periods    */
+/* and wake on the MISO release without taking longer than polling. The  */
+/* wake-ups are split between the EIC and SysTick. A card that stays     */
+/* busy must fail the stop on SysTick time, within the one               */
+/* SD_WRITE_TIMEOUT_MS shared by the last block and the stop token, and  */
+/* then recover.                                                         */
+/*                                                                       */
+/*   make -B sdbench BENCH_FLAGS=-DSD_USE_BUSY_SLEEP=0 && ./sdbench busy */
+/*                                                                       */
+/* gives the same writes polled at full speed, for comparison.           */
+
+static void busy_report (const char* what, DWORD bytes)
+{
+	const SAMSTATS* m = samd21_stats();
+	uint64_t awake = samd21_now() - T0 - m->sleep;
+
+	report(what, bytes);
+	printf("%-24s awake %7.0f us per MB, %lu wake-ups: %lu EIC, %lu SysTick\n", "",
+		awake / (SAMD21_HZ / 1e6) * (1024.0 * 1024 / bytes), (unsigned long)m->wakeups,
+		(unsigned long)m->eicIrqs, (unsigned long)m->ticks);
+	if (SD_USE_BUSY_SLEEP && (m->eicIrqs == 0 || m->sleep == 0)) Bad++;
+	if (!SD_USE_BUSY_SLEEP && m->eicIrqs) Bad++;
+}
+
+
+static void fw_busy (void)
+{
+	DWORD s;
+	uint64_t t;
+	int res;
+
+	fill(Buf, 0, sizeof Buf, 3);
+	start();
+	for (s = 0; s < 2048; s += 8) chk(SDCard_WriteStream(16384 + s, Buf + (s & 255) * 512, 8), "CMD25 write");
+	chk(SDCard_StopTransfer(), "stop");
+	busy_report("CMD25 8 x 256", 2048 * 512);
+	for (s = 0; s < 2048; s += 256) verify(Buf, 16384 + s, 256);
+
+	fill(Buf, 0, sizeof Buf, 4);
+	start();
+	for (s = 0; s < 256; s++) {
+		chk(SDCard_WriteStream(20480 + s, Buf + s * 512, 1), "write");
+		chk(SDCard_StopTransfer(), "stop");
+	}
+	busy_report("CMD25 1 + stop x 256", 256 * 512);
+	verify(Buf, 20480, 256);
+
+	/* A card stuck busy: the SysTick fallback ends the wait */
+	sdcard_fault(0, SDCARD_FAULT_BUSY, 1);
+	start();
+	chk(SDCard_WriteStream(24576, Buf, 1), "write");
+	res = SDCard_StopTransfer();
+	t = (samd21_now() - T0) / (SAMD21_HZ / 1000);
+	printf("stuck busy: stop returned %d after %lu ms (SD_WRITE_TIMEOUT_MS %d), %lu EIC wake-ups\n",
+		res, (unsigned long)t, SD_WRITE_TIMEOUT_MS, (unsigned long)samd21_stats()->eicIrqs);
+	if (res == 0 || t < SD_WRITE_TIMEOUT_MS - 1 || t > SD_WRITE_TIMEOUT_MS + 10) Bad++;
+
+	/* Once the card lets go, writing works again */
+	delay_ms(SDCARD_STUCK_US / 1000);
+	chk(SDCard_WriteStream(24576, Buf, 8), "write after stuck busy");
+	chk(SDCard_StopTransfer(), "stop");
+	verify(Buf, 24576, 8);
+}
+
+
+static void bench_busy (void)
+{
+	insert(&Param);
+	printf("busy wait: %s\n", SD_USE_BUSY_SLEEP ? "sleep, EIC wake on MISO" : "polled");
+	samd21_run(fw_busy);
+}
+
+
+
+/*-----------------------------------------------------------------------*/
+/* speed: High-Speed switch against a card that stays at default speed  */
+/*-----------------------------------------------------------------------*/
+/* The same card with and without CMD6 High-Speed support, each with its */
+/* own serial so the clock is trained afresh. The capable card must be   */
+/* switched, reported by MMC_GET_SPEED and trained to 24 MHz, the other  */
+/* must stay at default speed, where 24 MHz breaks its data, and train   */
+/* to 12 MHz. 128 KB is read with CMD18 and 1 MB written with CMD25 on   */
+/* each. Built with BENCH_FLAGS=-DSD_USE_HIGH_SPEED=0 both stay at       */
+/* default speed.                                                        */
+
+static BYTE Mode;
+
+static void fw_speed (void)
+{
+	DWORD s;
+
+	chk(disk_ioctl(0, MMC_GET_SPEED, &Mode), "MMC_GET_SPEED");
+	printf("MMC_GET_SPEED %u (%s), CMD6 x %lu, SCK trained to %lu MHz\n", Mode,
+		Mode ? "High-Speed" : "default speed", (unsigned long)sdcard_stats(0)->cmd[6],
+		(unsigned long)(SPI_BAUD_HZ(SPI_GetBaud()) / 1000000));
+
+	pattern(4096, 256);
+	start();
+	chk(SDCard_ReadMultipleBlock(4096, Buf, 256), "CMD18 read");
+	report(Mode ? "CMD18 x 1, High-Speed" : "CMD18 x 1, default", 256 * 512);
+	verify(Buf, 4096, 256);
+
+	fill(Buf, 0, sizeof Buf, 5);
+	start();
+	for (s = 0; s < 2048; s += 256) chk(SDCard_WriteStream(16384 + s, Buf, 256), "CMD25 write");
+	chk(SDCard_StopTransfer(), "stop");
+	report(Mode ? "CMD25 1 MB, High-Speed" : "CMD25 1 MB, default", 2048 * 512);
+	for (s = 0; s < 2048; s += 256) verify(Buf, 16384 + s, 256);
+}
+
+
+static void bench_speed (void)
+{
+	SDCPARAM p = Param;
+
+	insert(&p);
+	samd21_run(fw_speed);
+	if (Mode != SD_USE_HIGH_SPEED || SPI_GetBaud() != (Mode ? 0 : 1)) Bad++;
+
+	p.highSpeed = 0;
+	p.serial++;
+	insert(&p);
+	samd21_run(fw_speed);
+	if (Mode != 0 || SPI_GetBaud() != 1 || sdcard_stats(0)->corrupted) Bad++;
+}
+
+
+
+/*-----------------------------------------------------------------------*/
+/* Scenario table                                                        */
+/*-----------------------------------------------------------------------*/
+
+typedef struct {
+	const char* name;
+	void (*run)(void);
+} SCENARIO;
+
+static const SCENARIO Scenario[] = {
+	{ "read", bench_read },
+	{ "stream", bench_stream },
+	{ "busy", bench_busy },
+	{ "speed", bench_speed }
+};
+
+#define NSCENARIOS	(sizeof Scenario / sizeof Scenario[0])
+
+
+int main (int argc, char* argv[])
+{
+	unsigned i;
+	int a;
+
+	samd21_init();
+	samd21_flash(NVM_StoreRow, NVM_STORE_ROW_SIZE);
+	samd21_uart(getenv("SDBENCH_UART") ? stderr : 0);
+	samd21_spin(!SD_USE_BUSY_SLEEP);	/* Without sleep, waits on the DMAC poll RAM */
+	samd21_run(fw_start);
+
+	sdcard_defaults(&Param);
+	sdcard_print(stdout, &Param);
+	printf("model: %u cycles per register access, %u per DMA beat, %u per interrupt\n",
+		SAMD21_ACCESS_CYCLES, SAMD21_DMA_CYCLES, SAMD21_ISR_CYCLES);
+
+	for (i = 0; i < NSCENARIOS; i++) {
+		for (a = 1; a < argc && strcmp(argv[a], Scenario[i].name); a++) ;
+		if (argc == 1 || a < argc) {
+			printf("--- %s\n", Scenario[i].name);
+			Scenario[i].run();
+		}
+	}
+	if (Bad) {
+		printf("FAIL: %d mismatches\n", Bad);
+		return 1;
+	}
+	return 0;
+}
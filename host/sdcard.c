@@ -0,0 +1,553 @@
+/*-----------------------------------------------------------------------*/
+/* SD card model for host builds                                         */
+/*-----------------------------------------------------------------------*/
+/* Each byte clocked by SERCOM1 is exchanged at the end of its shift:    */
+/* the card puts out what it had ready (queued response bytes first,     */
+/* then busy, read tokens and data) and then consumes the MOSI byte.     */
+/* Command frames and data blocks carry real CRCs, and the register      */
+/* images are laid out the way sd.c parses them.                         */
+/*-----------------------------------------------------------------------*/
+
+#include "samd21.h"
+#include "sdcard.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define US(us)		((uint64_t)(us) * (SAMD21_HZ / 1000000u))
+#define QUEUE_SIZE	16
+
+/* Card states */
+enum { ST_IDLE, ST_READ, ST_WTOKEN, ST_WDATA, ST_BUSY };
+
+typedef struct {
+	int			present;
+	SDCPARAM	p;
+	SDCSTATS	st;
+	uint8_t*	data;
+	int			sel;
+
+	int			state, after;	/* after: state once busy ends */
+	uint64_t	readyAt;		/* End of busy, or first read token */
+	uint64_t	initAt;			/* ACMD41 completes from here */
+	int			idle, app, crcOn, hs, multi;
+	uint32_t	sector, eraseStart, eraseEnd;
+
+	uint8_t		frame[6];
+	int			fn;
+	uint8_t		q[QUEUE_SIZE];	/* Response bytes ahead of the state output */
+	int			qh, qn;
+
+	uint8_t		blk[515];		/* Outgoing data packet: token, data, CRC16 */
+	int			blkLen, blkPos;	/* blkPos -1 while waiting for readyAt */
+	const uint8_t*	reg;		/* Register image to send, 0 for a sector */
+	int			regLen;
+
+	uint8_t		wbuf[514];		/* Incoming data block and its CRC16 */
+	int			wn;
+
+	int			crcFaults, busyFaults;
+
+	uint8_t		csd[16], cid[16], scr[8], status[64], sw[64];
+} SDCARD;
+
+/* SD 2.00, erased data reads as 1, 1 and 4 bit bus */
+static const uint8_t Scr[8] = { 0x02, 0xB5, 0x80, 0x00 };
+
+static SDCARD Card[SDCARD_SLOTS];
+static int Attached[SDCARD_SLOTS];
+
+
+static uint8_t crc7 (const uint8_t* p, int n)
+{
+	uint8_t c = 0;
+	int i;
+
+	while (n--) {
+		c ^= *p++;
+		for (i = 0; i < 8; i++) c = (c & 0x80) ? (uint8_t)(c << 1 ^ 0x12) : (uint8_t)(c << 1);
+	}
+	return c >> 1;
+}
+
+
+static uint16_t crc16 (const uint8_t* p, int n)
+{
+	uint16_t c = 0;
+	int i;
+
+	while (n--) {
+		c ^= (uint16_t)(*p++ << 8);
+		for (i = 0; i < 8; i++) c = (c & 0x8000) ? (uint16_t)(c << 1 ^ 0x1021) : (uint16_t)(c << 1);
+	}
+	return c;
+}
+
+
+void sdcard_defaults (SDCPARAM* p)
+{
+	memset(p, 0, sizeof *p);
+	p->sectors = 131072;		/* 64 MB */
+	p->highSpeed = 1;
+	p->dsMaxHz = 20000000;		/* Default speed is specified up to 25 MHz, this card has less margin */
+	p->hsMaxHz = 50000000;
+	p->initUs = 1000;
+	p->readUs = 250;
+	p->nextUs = 10;
+	p->writeUs = 800;
+	p->blockUs = 80;
+	p->stopUs = 400;
+	p->eraseUs = 2000;
+	p->serial = 0x12345678;
+	p->auCode = 7;
+}
+
+
+void sdcard_print (FILE* fp, const SDCPARAM* p)
+{
+	fprintf(fp, "card: %lu sectors, %s, data good to %lu MHz (DS) / %lu MHz (HS)\n",
+		(unsigned long)p->sectors, p->highSpeed ? "High-Speed capable" : "default speed only",
+		(unsigned long)(p->dsMaxHz / 1000000), (unsigned long)(p->hsMaxHz / 1000000));
+	fprintf(fp, "card: read %lu us + %lu us/block, write %lu us (CMD24) / %lu us/block (CMD25), stop %lu us\n",
+		(unsigned long)p->readUs, (unsigned long)p->nextUs, (unsigned long)p->writeUs,
+		(unsigned long)p->blockUs, (unsigned long)p->stopUs);
+}
+
+
+/* Register images */
+static void build_registers (SDCARD* c)
+{
+	uint32_t csize = c->p.sectors / 1024 - 1;
+
+	memset(c->csd, 0, 16);
+	c->csd[0] = 0x40;					/* CSD 2.0 */
+	c->csd[1] = 0x0E;
+	c->csd[3] = c->hs ? 0x5A : 0x32;	/* TRAN_SPEED 50 / 25 MHz */
+	c->csd[4] = c->p.highSpeed ? 0x5B : 0x1B;	/* CCC classes 4, 5, 7, 8, and 10 (switch) when HS capable */
+	c->csd[5] = 0x59;					/* CCC classes 0 and 2, READ_BL_LEN 9 */
+	c->csd[7] = (uint8_t)(csize >> 16 & 0x3F);
+	c->csd[8] = (uint8_t)(csize >> 8);
+	c->csd[9] = (uint8_t)csize;
+	c->csd[10] = 0x7F;					/* ERASE_BLK_EN, SECTOR_SIZE 127 */
+	c->csd[11] = 0x80;
+	c->csd[12] = 0x0A;					/* WRITE_BL_LEN 9 */
+	c->csd[13] = 0x40;
+	c->csd[15] = (uint8_t)(crc7(c->csd, 15) << 1 | 1);
+
+	memset(c->cid, 0, 16);
+	c->cid[0] = 0x03;
+	memcpy(c->cid + 1, "SDHOST", 6);
+	c->cid[8] = 0x10;
+	c->cid[9] = (uint8_t)(c->p.serial >> 24);
+	c->cid[10] = (uint8_t)(c->p.serial >> 16);
+	c->cid[11] = (uint8_t)(c->p.serial >> 8);
+	c->cid[12] = (uint8_t)c->p.serial;
+	c->cid[13] = 0x01;
+	c->cid[14] = 0x4A;
+	c->cid[15] = (uint8_t)(crc7(c->cid, 15) << 1 | 1);
+
+	memcpy(c->scr, Scr, 8);
+
+	memset(c->status, 0, 64);
+	c->status[8] = 4;					/* Speed class 10 */
+	c->status[10] = (uint8_t)(c->p.auCode << 4);
+	c->status[12] = 1;					/* ERASE_SIZE 1 AU */
+	c->status[13] = 1 << 2 | 1;			/* ERASE_TIMEOUT 1 s, ERASE_OFFSET 1 s */
+}
+
+
+/* CMD6 status: group 1 supports functions 0 and 1 */
+static void build_switch (SDCARD* c, uint32_t arg)
+{
+	int fn = arg & 15;
+
+	memset(c->sw, 0, 64);
+	c->sw[0] = 0x00;
+	c->sw[1] = 0x64;					/* 100 mA */
+	c->sw[12] = 0x80;
+	c->sw[13] = 0x03;
+	c->sw[16] = (uint8_t)((fn == 1 || fn == 0) ? fn : 15);
+	c->sw[17] = 0x00;					/* Status version 0 */
+	if ((arg & 0x80000000u) && fn == 1) {
+		c->hs = 1;
+		build_registers(c);
+	}
+}
+
+
+static void queue (SDCARD* c, uint8_t b)
+{
+	if (c->qn == QUEUE_SIZE) {
+		fprintf(stderr, "sdcard: response queue overflow\n");
+		abort();
+	}
+	c->q[(c->qh + c->qn++) % QUEUE_SIZE] = b;
+}
+
+
+static void busy (SDCARD* c, uint64_t now, uint64_t cycles, int after)
+{
+	c->state = ST_BUSY;
+	c->after = after;
+	c->readyAt = now + cycles;
+}
+
+
+/* Start a data packet: a register image, or sectors from c->sector */
+static void start_read (SDCARD* c, uint64_t now, const uint8_t* reg, int len, uint32_t us)
+{
+	c->state = ST_READ;
+	c->reg = reg;
+	c->regLen = len;
+	c->blkPos = -1;
+	c->readyAt = now + US(us);
+}
+
+
+static void load_block (SDCARD* c, uint32_t hz)
+{
+	int n = c->reg ? c->regLen : 512;
+	uint16_t crc;
+
+	c->blk[0] = 0xFE;
+	memcpy(c->blk + 1, c->reg ? c->reg : c->data + (size_t)c->sector * 512, n);
+	crc = crc16(c->blk + 1, n);
+	c->blk[n + 1] = (uint8_t)(crc >> 8);
+	c->blk[n + 2] = (uint8_t)crc;
+	c->blkLen = n + 3;
+	c->blkPos = 0;
+	if (c->reg) return;
+
+	/* Data sampled too late at this SCK comes back with a bad bit */
+	if (hz > (c->hs ? c->p.hsMaxHz : c->p.dsMaxHz) || c->crcFaults) {
+		if (c->crcFaults) c->crcFaults--;
+		c->blk[1 + (c->sector * 37 + c->st.corrupted) % 512] ^= 0x10;
+		c->st.corrupted++;
+	}
+	c->st.blocksRead++;
+}
+
+
+static void command (SDCARD* c, uint64_t now)
+{
+	uint8_t cmd = c->frame[0] & 0x3F, r1;
+	uint32_t arg = (uint32_t)c->frame[1] << 24 | (uint32_t)c->frame[2] << 16 | (uint32_t)c->frame[3] << 8 | c->frame[4];
+	int app = c->app;
+
+	c->app = 0;
+	if (c->state == ST_READ) c->state = ST_IDLE;	/* Any command ends a read */
+	if (app) c->st.acmd[cmd]++; else c->st.cmd[cmd]++;
+
+	/* CMD0 and CMD8 are always checked, everything once CMD59 is on */
+	if ((c->crcOn || cmd == 0 || cmd == 8) && (c->frame[5] >> 1) != crc7(c->frame, 5)) {
+		c->st.crcErrors++;
+		queue(c, 0xFF);
+		queue(c, (uint8_t)(0x08 | c->idle));
+		return;
+	}
+
+	if (cmd == 12) {							/* Stuff byte, R1, then a short busy */
+		queue(c, 0xFF);
+		queue(c, 0x00);
+		busy(c, now, US(2), ST_IDLE);
+		return;
+	}
+
+	r1 = (uint8_t)c->idle;
+	queue(c, 0xFF);								/* Ncr */
+	if (cmd == 0) {
+		c->idle = 1;
+		c->crcOn = 0;
+		c->hs = 0;
+		build_registers(c);
+		c->initAt = now + US(c->p.initUs);
+		queue(c, 0x01);
+		return;
+	}
+	if (c->idle && cmd != 8 && cmd != 55 && cmd != 58 && cmd != 59 && !(app && cmd == 41)) {
+		queue(c, 0x05);							/* Only initialization commands while idle */
+		return;
+	}
+
+	switch (app ? cmd | 0x80 : cmd) {
+	case 8:
+		queue(c, r1);
+		queue(c, 0x00);
+		queue(c, 0x00);
+		queue(c, (uint8_t)(arg >> 8 & 0x0F));
+		queue(c, (uint8_t)arg);
+		return;
+	case 55:
+		c->app = 1;
+		queue(c, r1);
+		return;
+	case 41 | 0x80:
+		if (now >= c->initAt) c->idle = 0;
+		queue(c, (uint8_t)c->idle);
+		return;
+	case 58:
+		queue(c, r1);
+		queue(c, c->idle ? 0x40 : 0xC0);		/* Busy bit once powered up, CCS */
+		queue(c, 0xFF);
+		queue(c, 0x80);
+		queue(c, 0x00);
+		return;
+	case 16:
+		queue(c, arg == 512 ? r1 : 0x40);
+		return;
+	case 59:
+		c->crcOn = arg & 1;
+		queue(c, r1);
+		return;
+	case 9:
+		queue(c, 0);
+		start_read(c, now, c->csd, 16, 2);
+		return;
+	case 10:
+		queue(c, 0);
+		start_read(c, now, c->cid, 16, 2);
+		return;
+	case 13 | 0x80:
+		queue(c, 0);
+		queue(c, 0);
+		start_read(c, now, c->status, 64, 2);
+		return;
+	case 51 | 0x80:
+		queue(c, 0);
+		start_read(c, now, c->scr, 8, 2);
+		return;
+	case 6:
+		if (!c->p.highSpeed) break;
+		queue(c, 0);
+		build_switch(c, arg);
+		start_read(c, now, c->sw, 64, 2);
+		return;
+	case 13:
+		queue(c, 0);
+		queue(c, 0);
+		return;
+	case 17:
+	case 18:
+		if (arg >= c->p.sectors) {
+			queue(c, 0x40);
+			return;
+		}
+		queue(c, 0);
+		c->sector = arg;
+		c->multi = cmd == 18;
+		start_read(c, now, 0, 0, c->p.readUs);
+		return;
+	case 24:
+	case 25:
+		if (arg >= c->p.sectors) {
+			queue(c, 0x40);
+			return;
+		}
+		queue(c, 0);
+		c->sector = arg;
+		c->multi = cmd == 25;
+		c->state = ST_WTOKEN;
+		return;
+	case 23 | 0x80:
+		queue(c, 0);
+		return;
+	case 32:
+		c->eraseStart = arg;
+		queue(c, 0);
+		return;
+	case 33:
+		c->eraseEnd = arg;
+		queue(c, 0);
+		return;
+	case 38:
+		if (c->eraseEnd < c->eraseStart || c->eraseEnd >= c->p.sectors) {
+			queue(c, 0x10);
+			return;
+		}
+		memset(c->data + (size_t)c->eraseStart * 512, 0xFF, (size_t)(c->eraseEnd - c->eraseStart + 1) * 512);
+		c->st.erased += c->eraseEnd - c->eraseStart + 1;
+		queue(c, 0);
+		busy(c, now, US(c->p.eraseUs), ST_IDLE);
+		return;
+	}
+	queue(c, (uint8_t)(0x04 | c->idle));		/* Illegal command */
+}
+
+
+/* Byte the card drives during this shift */
+static uint8_t output (SDCARD* c, uint64_t now, uint32_t hz)
+{
+	uint8_t b;
+
+	if (c->qn) {
+		b = c->q[c->qh];
+		c->qh = (c->qh + 1) % QUEUE_SIZE;
+		c->qn--;
+		return b;
+	}
+	switch (c->state) {
+	case ST_BUSY:
+		if (now < c->readyAt) return 0x00;
+		c->state = c->after;
+		return 0xFF;
+	case ST_READ:
+		if (c->blkPos < 0) {
+			if (now < c->readyAt) return 0xFF;
+			load_block(c, hz);
+		}
+		b = c->blk[c->blkPos++];
+		if (c->blkPos == c->blkLen) {
+			if (!c->reg && c->multi && c->sector + 1 < c->p.sectors) {
+				c->sector++;
+				c->blkPos = -1;
+				c->readyAt = now + US(c->p.nextUs);
+			} else {
+				c->state = ST_IDLE;
+			}
+		}
+		return b;
+	}
+	return 0xFF;
+}
+
+
+static void input (SDCARD* c, uint8_t mosi, uint64_t now)
+{
+	uint16_t crc;
+	uint64_t t;
+
+	switch (c->state) {
+	case ST_WTOKEN:
+		if (mosi == 0xFE || (c->multi && mosi == 0xFC)) {
+			c->state = ST_WDATA;
+			c->wn = 0;
+		} else if (c->multi && mosi == 0xFD) {	/* Stop tran: one byte, then busy */
+			queue(c, 0xFF);
+			busy(c, now, US(c->p.stopUs), ST_IDLE);
+		}
+		return;
+	case ST_WDATA:
+		c->wbuf[c->wn++] = mosi;
+		if (c->wn < 514) return;
+		crc = (uint16_t)(c->wbuf[512] << 8 | c->wbuf[513]);
+		if (c->crcOn && crc != crc16(c->wbuf, 512)) {
+			c->st.crcErrors++;
+			queue(c, 0x0B);
+			busy(c, now, US(2), c->multi ? ST_WTOKEN : ST_IDLE);
+			return;
+		}
+		memcpy(c->data + (size_t)c->sector * 512, c->wbuf, 512);
+		c->st.blocksWritten++;
+		queue(c, 0xE5);
+		t = US(c->multi ? c->p.blockUs : c->p.writeUs);
+		if (c->busyFaults) {
+			c->busyFaults--;
+			t = US(SDCARD_STUCK_US);
+		}
+		if (c->multi && c->sector + 1 < c->p.sectors) c->sector++;
+		busy(c, now, t, c->multi ? ST_WTOKEN : ST_IDLE);
+		return;
+	case ST_BUSY:
+		return;
+	}
+
+	/* Idle or sending read data: watch for a command frame */
+	if (c->fn == 0 && (mosi & 0xC0) != 0x40) return;
+	c->frame[c->fn++] = mosi;
+	if (c->fn == 6) {
+		c->fn = 0;
+		command(c, now);
+	}
+}
+
+
+static uint8_t card_xfer (void* ctx, uint8_t mosi, uint64_t now, uint32_t hz)
+{
+	SDCARD* c = ctx;
+	uint8_t miso;
+
+	if (!c->present) return 0xFF;
+	c->st.bytes++;
+	miso = output(c, now, hz);
+	input(c, mosi, now);
+	return miso;
+}
+
+
+static void card_select (void* ctx, int sel, uint64_t now)
+{
+	SDCARD* c = ctx;
+
+	(void)now;
+	c->sel = sel;
+	if (sel || !c->present) return;
+
+	/* Deselecting drops the frame and the response, programming goes on.
+	   A CMD55 stays in effect for the next command, as on a real card. */
+	c->fn = 0;
+	c->qn = 0;
+	if (c->state == ST_BUSY) c->after = ST_IDLE;
+	else c->state = ST_IDLE;
+}
+
+
+static uint64_t card_ready (void* ctx, uint64_t now)
+{
+	SDCARD* c = ctx;
+
+	if (!c->present || c->state != ST_BUSY) return now;
+	return c->readyAt > now ? c->readyAt : now;
+}
+
+
+void sdcard_insert (int slot, uint32_t cs, const SDCPARAM* param)
+{
+	SDCARD* c = &Card[slot];
+	SAMDEV dev = { cs, c, card_xfer, card_select, card_ready };
+
+	free(c->data);
+	memset(c, 0, sizeof *c);
+	c->p = *param;
+	c->data = calloc(param->sectors, 512);
+	if (!c->data) {
+		fprintf(stderr, "sdcard: no memory for %lu sectors\n", (unsigned long)param->sectors);
+		abort();
+	}
+	build_registers(c);
+	c->idle = 1;
+	c->present = 1;
+	if (!Attached[slot]) {
+		samd21_attach(&dev);
+		Attached[slot] = 1;
+	}
+}
+
+
+void sdcard_remove (int slot)
+{
+	Card[slot].present = 0;
+}
+
+
+uint8_t* sdcard_data (int slot)
+{
+	return Card[slot].data;
+}
+
+
+const SDCSTATS* sdcard_stats (int slot)
+{
+	return &Card[slot].st;
+}
+
+
+void sdcard_clear (int slot)
+{
+	memset(&Card[slot].st, 0, sizeof Card[slot].st);
+}
+
+
+void sdcard_fault (int slot, int kind, int n)
+{
+	if (kind == SDCARD_FAULT_CRC) Card[slot].crcFaults = n;
+	if (kind == SDCARD_FAULT_BUSY) Card[slot].busyFaults = n;
+}
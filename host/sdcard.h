@@ -0,0 +1,75 @@
+/*-----------------------------------------------------------------------/
+/  SD card model for host builds                                         /
+/-----------------------------------------------------------------------/
+/  An SDHC card in SPI mode on a SAMD21 model chip select. It answers    /
+/  the commands sd.c issues byte for byte, with CRCs, and takes the      /
+/  access and programming times from its SDCPARAM.                       /
+/-----------------------------------------------------------------------*/
+
+#ifndef _SDCARD_DEFINED
+#define _SDCARD_DEFINED
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdio.h>
+#include <stdint.h>
+
+#define SDCARD_SLOTS		2	/* Cards that can be inserted at a time */
+
+/* Faults for sdcard_fault() */
+#define SDCARD_FAULT_CRC	0	/* Flip a bit in the next n read blocks after their CRC */
+#define SDCARD_FAULT_BUSY	1	/* Hold the next n write busy periods for SDCARD_STUCK_US */
+
+#define SDCARD_STUCK_US		1000000u
+
+
+/* Card characteristics */
+typedef struct {
+	uint32_t	sectors;	/* Capacity in 512 byte sectors, a multiple of 1024 */
+	uint8_t		highSpeed;	/* 1: Supports the CMD6 High-Speed switch */
+	uint32_t	dsMaxHz;	/* Fastest SCK read data survives at default speed */
+	uint32_t	hsMaxHz;	/* ... and after switching to High-Speed */
+	uint32_t	initUs;		/* ACMD41 reports idle until this long after CMD0 */
+	uint32_t	readUs;		/* CMD17/CMD18 command to first data token */
+	uint32_t	nextUs;		/* Gap between blocks of a CMD18 */
+	uint32_t	writeUs;	/* Programming busy after a CMD24 block */
+	uint32_t	blockUs;	/* ... after each CMD25 block */
+	uint32_t	stopUs;		/* Busy after the stop tran token */
+	uint32_t	eraseUs;	/* Busy after CMD38 */
+	uint32_t	serial;		/* Product serial number in the CID */
+	uint8_t		auCode;		/* AU_SIZE of the SD status, 7 is 1 MB */
+} SDCPARAM;
+
+
+/* Card counters */
+typedef struct {
+	uint32_t	cmd[64];	/* Commands received, by number */
+	uint32_t	acmd[64];	/* Application commands received, by number */
+	uint32_t	blocksRead;	/* Data blocks sent, registers excluded */
+	uint32_t	blocksWritten;	/* Data blocks accepted */
+	uint32_t	crcErrors;	/* Command frames and data blocks with a bad CRC */
+	uint32_t	corrupted;	/* Read blocks damaged by a too fast SCK or a fault */
+	uint32_t	erased;		/* Sectors erased by CMD38 */
+	uint64_t	bytes;		/* Bytes clocked while selected */
+} SDCSTATS;
+
+
+/*---------------------------------------*/
+/* Prototypes for the card model         */
+
+void sdcard_defaults (SDCPARAM* param);
+void sdcard_print (FILE* fp, const SDCPARAM* param);
+void sdcard_insert (int slot, uint32_t cs, const SDCPARAM* param);
+void sdcard_remove (int slot);
+uint8_t* sdcard_data (int slot);
+const SDCSTATS* sdcard_stats (int slot);
+void sdcard_clear (int slot);
+void sdcard_fault (int slot, int kind, int n);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
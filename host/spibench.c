@@ -0,0 +1,223 @@
+/*-----------------------------------------------------------------------*/
+/* SPI block transfer cycle counts on the SAMD21 model                   */
+/*-----------------------------------------------------------------------*/
+/* SPI.c runs against samd21.c with a test device on SERCOM1 that sends  */
+/* a known byte sequence and records what it receives. Each transfer is  */
+/* timed in 48 MHz CPU cycles at 12 MHz (BAUD 1) and 24 MHz (BAUD 0)     */
+/* SCK, together with the share of that time SCK was running and the CPU */
+/* slept, and its data is checked in both directions. The DMA.c          */
+/* transfers run on the model's DMAC, with its CRC unit checked against  */
+/* CRC16_Calc() and the CPU time left over while a transfer runs.        */
+/*-----------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "samd21.h"
+#include "sam.h"
+#include "SPI.h"
+#include "DMA.h"
+#include "crc.h"
+#include "delay.h"
+
+#define LEN		512
+
+static SPI_Device Dev = { PORT_PA28, 0 };
+static uint8_t Buf[LEN], Sent[LEN + 16];
+static unsigned NSent, NOut;
+static int Bad;
+static int Calls;
+static uint8_t Status;
+
+
+/* Device: sends byte n of its sequence, keeps what it gets */
+static uint8_t seq (unsigned n)
+{
+	return (uint8_t)(n * 29 + (n >> 8) + 7);
+}
+
+
+static uint8_t dev_xfer (void* ctx, uint8_t mosi, uint64_t now, uint32_t hz)
+{
+	(void)ctx;
+	(void)now;
+	(void)hz;
+	if (NSent < sizeof Sent) Sent[NSent++] = mosi;
+	return seq(NOut++);
+}
+
+
+static void reset_dev (void)
+{
+	NSent = NOut = 0;
+	memset(Sent, 0, sizeof Sent);
+}
+
+
+static uint64_t T0;
+
+static void start (void)
+{
+	reset_dev();
+	samd21_clear_stats();
+	T0 = samd21_now();
+}
+
+
+static void report (const char* what, uint8_t baud)
+{
+	const SAMSTATS* m = samd21_stats();
+	uint64_t cyc = samd21_now() - T0;
+
+	printf("%2lu MHz %-19s %6lu cycles %5.1f us %6.0f KB/s  SCK busy %3.0f%%  asleep %3.0f%%  %4.1f cycles/byte\n",
+		(unsigned long)(SPI_BAUD_HZ(baud) / 1000000), what, (unsigned long)cyc,
+		cyc / (SAMD21_HZ / 1e6), LEN / 1024.0 / (cyc / (double)SAMD21_HZ),
+		100.0 * m->spiCycles / cyc, 100.0 * m->sleep / cyc, (double)cyc / LEN);
+	if (m->dropped || m->detached || m->clashes) {
+		printf("FAIL: %lu dropped, %lu detached, %lu clashes\n",
+			(unsigned long)m->dropped, (unsigned long)m->detached, (unsigned long)m->clashes);
+		Bad++;
+	}
+}
+
+
+/* Received bytes must be the device sequence, in order */
+static void check_read (const uint8_t* p, unsigned n)
+{
+	unsigned i;
+
+	for (i = 0; i < n; i++) {
+		if (p[i] != seq(i)) {
+			Bad++;
+			return;
+		}
+	}
+}
+
+
+/* DMA_SPI_Start() completion, called from DMAC_Handler() */
+static void done (uint8_t status)
+{
+	Calls++;
+	Status = status;
+}
+
+
+static void run (uint8_t baud)
+{
+	unsigned i, work;
+	uint16_t crc;
+
+	Dev.baud = baud;
+	SPI_Select(&Dev);
+
+	start();
+	for (i = 0; i < LEN; i++) Buf[i] = SPI_Exchange8bit(0xFF);
+	report("SPI_Exchange8bit", baud);
+	check_read(Buf, LEN);
+	if (samd21_stats()->overflows) Bad++;
+
+	memset(Buf, 0, LEN);
+	start();
+	SPI_ReadBlock(Buf, LEN);
+	report("SPI_ReadBlock", baud);
+	check_read(Buf, LEN);
+	if (samd21_stats()->overflows) Bad++;
+	for (i = 0; i < LEN; i++) if (Sent[i] != 0xFF) Bad++;
+
+	for (i = 0; i < LEN; i++) Buf[i] = (uint8_t)(i * 3 + 1);
+	start();
+	SPI_WriteBlock(Buf, LEN);
+	report("SPI_WriteBlock", baud);
+	if (NSent != LEN || memcmp(Sent, Buf, LEN)) Bad++;
+
+	start();
+	SPI_FillBlock(0xA5, LEN);
+	report("SPI_FillBlock", baud);
+	for (i = 0; i < LEN; i++) if (Sent[i] != 0xA5) Bad++;
+	if (NSent != LEN) Bad++;
+
+	/* The receiver is drained after a write, the next exchange is in step */
+	reset_dev();
+	if (SPI_Exchange8bit(0x00) != seq(0)) Bad++;
+
+	/* Short blocks */
+	for (i = 1; i <= 3; i++) {
+		reset_dev();
+		SPI_ReadBlock(Buf, (uint16_t)i);
+		check_read(Buf, i);
+		if (NSent != i) Bad++;
+	}
+
+	/* DMAC, blocking: the CRC unit sees the bytes moved by its channel */
+	memset(Buf, 0, LEN);
+	start();
+	DMA_CRC_Begin(DMA_CH_SPI_RX);
+	if (DMA_SPI_Transfer(Buf, 0, LEN) != DMA_OK) Bad++;
+	crc = DMA_CRC_End();
+	report("DMA_SPI_Transfer rx", baud);
+	check_read(Buf, LEN);
+	if (crc != CRC16_Calc(Buf, LEN)) Bad++;
+	if (samd21_stats()->overflows) Bad++;
+	for (i = 0; i < LEN; i++) if (Sent[i] != 0xFF) Bad++;
+
+	for (i = 0; i < LEN; i++) Buf[i] = (uint8_t)(i * 5 + 3);
+	start();
+	DMA_CRC_Begin(DMA_CH_SPI_TX);
+	if (DMA_SPI_Transfer(0, Buf, LEN) != DMA_OK) Bad++;
+	crc = DMA_CRC_End();
+	report("DMA_SPI_Transfer tx", baud);
+	if (NSent != LEN || memcmp(Sent, Buf, LEN)) Bad++;
+	if (crc != CRC16_Calc(Buf, LEN)) Bad++;
+	if (samd21_stats()->overflows) Bad++;
+
+	/* RX discarded, 0xFF sent: the card busy and gap clocking */
+	reset_dev();
+	if (DMA_SPI_Transfer(0, 0, 64) != DMA_OK) Bad++;
+	for (i = 0; i < 64; i++) if (Sent[i] != 0xFF) Bad++;
+	if (NSent != 64 || SPI_Exchange8bit(0xFF) != seq(64)) Bad++;
+
+	/* DMAC, started: the CPU works while the block moves, the callback
+	   comes once, and a second start or a zero length is refused */
+	memset(Buf, 0, LEN);
+	Calls = 0;
+	start();
+	if (DMA_SPI_Start(Buf, 0, LEN, done)) Bad++;
+	if (DMA_SPI_Start(Buf, 0, LEN, done) == 0) Bad++;
+	for (work = 0; DMA_SPI_Busy(); work++) delay_n_cycles(1);
+	report("DMA_SPI_Start rx", baud);
+	printf("%2lu MHz %-19s %3.0f%% of the transfer left to the CPU\n",
+		(unsigned long)(SPI_BAUD_HZ(baud) / 1000000), "",
+		100.0 * work * 7 / (double)(samd21_now() - T0));
+	check_read(Buf, LEN);
+	if (Calls != 1 || Status != DMA_OK) Bad++;
+	if (DMA_SPI_Start(Buf, 0, 0, done) == 0) Bad++;
+
+	SPI_Deselect(&Dev);
+}
+
+
+static void fw_main (void)
+{
+	SPI_Bus_Init();
+	SPI_DeviceInit(&Dev);
+	DMA_Initialize();
+	run(1);
+	run(0);
+}
+
+
+int main (void)
+{
+	SAMDEV dev = { PORT_PA28, 0, dev_xfer, 0, 0 };
+
+	samd21_init();
+	samd21_attach(&dev);
+	printf("model: %u cycles per register access, %u-byte blocks\n", SAMD21_ACCESS_CYCLES, LEN);
+	samd21_run(fw_main);
+	if (Bad) {
+		printf("FAIL: %d mismatches\n", Bad);
+		return 1;
+	}
+	return 0;
+}
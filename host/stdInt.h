@@ -0,0 +1,3 @@
+/* Host shim: diskio.c includes <stdInt.h>, which only exists on
+   case-insensitive file systems */
+#include <stdint.h>
@@ -23,6 +23,9 @@
 //////////////////////////////////////////////////////////////////////////
 #include "SD.h"
 #include "SPI.h"
+#include "DMA.h"
+#include "crc.h"
+#include "NVM.h"
 #include "app.h"
 #include "delay.h"
 #include "USART3.h"
@@ -44,33 +47,117 @@ UINT bw;       // Number of bytes written
 
 // Global variables for SD card operations
 uint8_t dataBuffer[512];
-uint8_t SD_Type = 0;
 
-// Define SS (Slave Select) pin controls
-#define GPIO_MAP_SS                      PORT_PA08
-#define GPIO_GROUP_SS                    0
-#define SPI_CS_LOW()                     PORT->Group[GPIO_GROUP_SS].OUTCLR.reg = GPIO_MAP_SS;
-#define SPI_CS_HIGH()                    PORT->Group[GPIO_GROUP_SS].OUTSET.reg = GPIO_MAP_SS;
+// Open-ended CMD18 stream, kept open while reads stay sequential
+static uint8_t  SD_ReadOpen = 0;
+static uint32_t SD_ReadNext = 0;
+
+// Open-ended CMD25 stream, kept open while writes stay sequential
+static uint8_t  SD_WriteOpen = 0;
+static uint32_t SD_WriteNext = 0;
+static uint32_t SD_WriteStart = 0;
+
+// Chip select state, a transaction selects the card only once
+static uint8_t SD_Selected = 0;
+
+// Time of the last block moved through an open stream
+static uint32_t SD_LastTick = 0;
+
+// Command and block counters
+static SD_Stats SD_Counters;
+
+// Card slots sharing SERCOM1, SDCard_Use() picks the one the other calls act on
+typedef struct {
+    SPI_Device  device;     // Chip select and the rate the card is clocked at
+    SD_CardInfo info;       // Card registers, read once at init
+} SD_Slot;
+
+static const uint32_t SD_CsPins[SD_CARDS] = SD_CS_PINS;
+static SD_Slot SD_Slots[SD_CARDS];
+static SD_Slot *SD_Card = &SD_Slots[0];
+
+// Asynchronous request, advanced by SDCard_Poll()
+#define SD_REQ_READ      0
+#define SD_REQ_WRITE     1
+#define SD_REQ_STOP      2  // Only close open streams
+
+#define SD_ST_IDLE       0  // No request, SD_Result holds the last outcome
+#define SD_ST_ROUTE      1  // Close streams the request cannot use, then open or continue
+#define SD_ST_STOP_READ  2  // CMD12 sent, waiting out its busy
+#define SD_ST_STOP_WRITE 3  // Waiting for the card before the stop tran token
+#define SD_ST_STOP_BUSY  4  // Stop tran sent, waiting out programming
+#define SD_ST_OPEN       5  // Send CMD18 or CMD25
+#define SD_ST_RX_TOKEN   6  // Waiting for a data start token
+#define SD_ST_RX_DATA    7  // Data block moving in
+#define SD_ST_TX_READY   8  // Waiting for the card to accept the next block
+#define SD_ST_TX_DATA    9  // Data block moving out
+
+static uint8_t  SD_State = SD_ST_IDLE;
+static uint8_t  SD_Result = SD_ASYNC_DONE;
+static uint8_t  SD_ReqKind;
+static uint8_t  SD_ReqFailed;
+static uint32_t SD_ReqAddr;
+static uint8_t *SD_ReqBuf;
+static uint32_t SD_ReqCount;
+static uint32_t SD_WaitTick;    // Start of the current wait, for its timeout
+#if SD_USE_DMA
+static volatile uint8_t SD_DmaStatus;
+#endif
+
+uint8_t SDCard_StopTransfer(void);
+
+// CMD6 arguments: mode bit, other groups left unchanged (0xF), group 1 function
+#define SD_SWITCH_CHECK                  0x00FFFFF0
+#define SD_SWITCH_SET                    0x80FFFFF0
+#define SD_SWITCH_HIGH_SPEED             0x00000001
+
+// Data packet tokens and timeouts
+#define SD_TOKEN_START_BLOCK             0xFE
+#define SD_TOKEN_MULTI_WRITE             0xFC
+#define SD_TOKEN_STOP_TRAN               0xFD
+#define SD_DATA_RESP_MASK                0x1F
+#define SD_DATA_RESP_ACCEPTED            0x05
+#define SD_TOKEN_TIMEOUT                 0x00FFFFF
+
+// Set the card's SCK rate, applied now and on every select
+static void SDCard_SetBaud(uint8_t baud) {
+    SD_Card->device.baud = baud;
+    SPI_SetBaud(baud);
+}
 
 // Set SPI to low speed for initialization
 void SDCard_InitSpeed(void) {
-    SPI_Initialize_Slow();
+    SPI_Bus_Init();
+
+    // Every chip select must be high before any card is spoken to
+    for (uint8_t i = 0; i < SD_CARDS; i++) {
+        SD_Slots[i].device.csPin = SD_CsPins[i];
+        SPI_DeviceInit(&SD_Slots[i].device);
+    }
+    SDCard_SetBaud(SPI_BAUD(SPI_SLOW_HZ));
 }
 
 // Set SPI to high speed for operation
 void SDCard_RunSpeed(void) {
-    SPI_Initialize_Fast();
+    SDCard_SetBaud(SPI_BAUD(SPI_FAST_HZ));
 }
 
 // Control the Slave Select line
 void SDCard_SS(uint8_t cs) {
+    SD_Selected = (cs != 1);
     if (cs == 1) {
-        SPI_CS_HIGH();
+        SPI_Deselect(&SD_Card->device);
     } else {
-        SPI_CS_LOW();
+        SPI_Select(&SD_Card->device);
     }
 }
 
+// End a transaction: deselect and clock one byte so the card releases MISO
+static void SDCard_Release(void) {
+    SDCard_SS(1);
+    SPI_SD_Send_Byte(0xFF);
+}
+
 // Wait for the SD card to be ready for reading
 uint8_t SDCard_WaitRead(void) {
     uint32_t timeout = 0x00FFFFF;
@@ -102,53 +189,1072 @@ uint8_t SD_WaitReady(void) {
     return 0; // Ready
 }
 
-// Write a command to the SD card
-uint8_t SDCard_WriteCmd(uint8_t cmd, uint32_t arg, uint8_t crc) {
+// Send a command frame and return R1, leaving the card selected. An ACMD
+// (SD_APP | CMDn) sends CMD55 first under the same select.
+static uint8_t SDCard_SendCmd(uint8_t cmd, uint32_t arg, uint8_t crc) {
     uint16_t timeout = 512;
     uint8_t response;
+    uint8_t frame[6];
 
-    SDCard_SS(1);
+    // Any other command ends an open stream first
+    if ((SD_ReadOpen || SD_WriteOpen) && (cmd | 0x40) != CMD12) {
+        SDCard_StopTransfer();
+    }
+
+    if (cmd & SD_APP) {
+        response = SDCard_SendCmd(CMD55, 0, 0xFF);
+        if (response > 1) {
+            return response;
+        }
+        cmd &= ~SD_APP;
+    }
+
+#if SD_USE_STATS
+    SD_Counters.cmd[cmd & 0x3F]++;
+#endif
+
+    // Select once per transaction, later commands only need the gap byte
+    if (!SD_Selected) {
+        SDCard_SS(0);
+    }
     SPI_SD_Send_Byte(0xFF);
-    SDCard_SS(0);
 
     // Send command packet
-    SPI_SD_Send_Byte(cmd | 0x40);
-    SPI_SD_Send_Byte((uint8_t)(arg >> 24));
-    SPI_SD_Send_Byte((uint8_t)(arg >> 16));
-    SPI_SD_Send_Byte((uint8_t)(arg >> 8));
-    SPI_SD_Send_Byte((uint8_t)arg);
-    SPI_SD_Send_Byte(crc);
-
-    // Wait for a response
+    frame[0] = cmd | 0x40;
+    frame[1] = (uint8_t)(arg >> 24);
+    frame[2] = (uint8_t)(arg >> 16);
+    frame[3] = (uint8_t)(arg >> 8);
+    frame[4] = (uint8_t)arg;
+    frame[5] = crc;
+#if SD_USE_CRC
+    // Once CMD59 is on the card checks every frame, so always send a real CRC7
+    frame[5] = CRC7_Calc(frame, 5) | 0x01;
+#endif
+    SPI_WriteBlock(frame, 6);
+
+    // CMD12 is followed by a stuff byte which may still carry read data
+    if ((cmd | 0x40) == CMD12) {
+        SPI_SD_Send_Byte(0xFF);
+    }
+
+    // Wait for a response (R1 always has bit 7 clear)
     do {
         response = SPI_SD_Send_Byte(0xFF);
         timeout--;
-    } while ((response == 0xFF) && timeout);
+    } while ((response & 0x80) && timeout);
 
     if (timeout == 0) {
         UART3_Write_Text("Command response timeout\n");
     }
 
+    return response;
+}
+
+// Write a command to the SD card
+uint8_t SDCard_WriteCmd(uint8_t cmd, uint32_t arg, uint8_t crc) {
+    uint8_t response;
+
+    response = SDCard_SendCmd(cmd, arg, crc);
+
     // Deselect and send one more byte to finalize
-    SDCard_SS(1);
-    SPI_SD_Send_Byte(0xFF);
+    SDCard_Release();
 
     return response; // Return response from SD card
 }
 
+// Convert a sector number to the address unit used by the card
+static uint32_t SDCard_BlockAddr(uint32_t sector) {
+    // SDHC/SDXC cards are block addressed, older cards use byte addresses
+    return (SD_Card->info.type == SD_TYPE_V2HC) ? sector : (sector << 9);
+}
+
+// Move a data block off the bus, with its CRC16 when checking is enabled
+static uint8_t SDCard_RxBlock(uint8_t *buf, uint16_t len, uint16_t *crc) {
+#if SD_USE_DMA
+    uint8_t status;
+
+#if SD_USE_CRC
+    DMA_CRC_Begin(DMA_CH_SPI_RX);
+#endif
+    status = DMA_SPI_Transfer(buf, 0, len);
+#if SD_USE_CRC
+    *crc = DMA_CRC_End();
+#endif
+    (void)crc;
+    return (status != DMA_OK);
+#else
+    SPI_ReadBlock(buf, len);
+#if SD_USE_CRC
+    *crc = CRC16_Calc(buf, len);
+#endif
+    (void)crc;
+    return 0;
+#endif
+}
+
+// Move a data block onto the bus, with its CRC16 when checking is enabled
+static uint8_t SDCard_TxBlock(const uint8_t *buf, uint16_t len, uint16_t *crc) {
+#if SD_USE_DMA
+    uint8_t status;
+
+#if SD_USE_CRC
+    DMA_CRC_Begin(DMA_CH_SPI_TX);
+#endif
+    status = DMA_SPI_Transfer(0, buf, len);
+#if SD_USE_CRC
+    *crc = DMA_CRC_End();
+#endif
+    (void)crc;
+    return (status != DMA_OK);
+#else
+#if SD_USE_CRC
+    *crc = CRC16_Calc(buf, len);
+#endif
+    (void)crc;
+    SPI_WriteBlock(buf, len);
+    return 0;
+#endif
+}
+
+// Wait for the data start token and read one data packet from the card
+static uint8_t SDCard_RecvData(uint8_t *buf, uint16_t len) {
+    uint32_t timeout = SD_TOKEN_TIMEOUT;
+    uint8_t token;
+    uint16_t crc = 0;
+
+    do {
+        token = SPI_SD_Send_Byte(0xFF);
+    } while ((token == 0xFF) && --timeout);
+
+    if (token != SD_TOKEN_START_BLOCK) {
+        UART3_Write_Text("Data token timeout\n");
+        return 1;
+    }
+
+    if (SDCard_RxBlock(buf, len, &crc)) {
+        return 1;
+    }
+
+#if SD_USE_CRC
+    // Compare against the CRC16 sent by the card
+    uint16_t cardCrc = (uint16_t)SPI_SD_Read_Byte() << 8;
+    cardCrc |= SPI_SD_Read_Byte();
+    if (cardCrc != crc) {
+#if SD_USE_STATS
+        SD_Counters.crcErrors++;
+#endif
+        UART3_Write_Text("Data CRC error\n");
+        return 1;
+    }
+#else
+    // Discard the CRC16
+    SPI_FillBlock(0xFF, 2);
+#endif
+
+#if SD_USE_STATS
+    SD_Counters.blocksRead++;
+#endif
+
+    return 0;
+}
+
+// Run one command as a single transaction: select, send it, read its whole
+// response into buf and release. Returns R1, or 0xFF if the payload failed.
+uint8_t SDCard_Command(uint8_t cmd, uint32_t arg, uint8_t crc, uint8_t resp, uint8_t *buf, uint16_t len) {
+    uint8_t response = SDCard_SendCmd(cmd, arg, crc);
+
+    // The payload only follows an R1 with no error bits
+    if ((response & 0xFE) == 0) {
+        switch (resp) {
+            case SD_RESP_R1B:
+                if (SD_WaitReady()) {
+                    response = 0xFF;
+                }
+                break;
+
+            case SD_RESP_R2:
+                buf[0] = SPI_SD_Read_Byte();
+                break;
+
+            case SD_RESP_R3:
+            case SD_RESP_R7:
+                for (uint8_t i = 0; i < 4; i++) {
+                    buf[i] = SPI_SD_Read_Byte();
+                }
+                break;
+
+            case SD_RESP_DATA:
+                // ACMD13 answers with R2, skip its second byte
+                if (cmd == (SD_APP | CMD13)) {
+                    SPI_SD_Read_Byte();
+                }
+                if (SDCard_RecvData(buf, len)) {
+                    response = 0xFF;
+                }
+                break;
+        }
+    }
+
+    SDCard_Release();
+
+    return response;
+}
+
+// Read a single 512 byte block with CMD17
+uint8_t SDCard_ReadSingleBlock(uint32_t addr, uint8_t *buf) {
+    return SDCard_Command(CMD17, SDCard_BlockAddr(addr), 0xFF, SD_RESP_DATA, buf, 512) ? 1 : 0;
+}
+
+// True once an open stream has been idle longer than SD_STREAM_IDLE_MS
+static uint8_t SDCard_StreamExpired(void) {
+    return (uint32_t)(SysTick_Millis() - SD_LastTick) >= SD_STREAM_IDLE_MS;
+}
+
+// Send one data packet and check the card's data response token
+static uint8_t SDCard_SendData(uint8_t token, const uint8_t *buf) {
+    uint8_t response;
+    uint16_t crc = 0;
+
+    // The card may still be programming the previous block
+    if (SDCard_WaitRead()) {
+        return 1;
+    }
+
+    SPI_SD_Send_Byte(token);
+    if (SDCard_TxBlock(buf, 512, &crc)) {
+        return 1;
+    }
+
+#if SD_USE_CRC
+    SPI_SD_Send_Byte((uint8_t)(crc >> 8));
+    SPI_SD_Send_Byte((uint8_t)crc);
+#else
+    // Dummy CRC16, the card ignores it while CRC checking is off
+    SPI_FillBlock(0xFF, 2);
+#endif
+
+    response = SPI_SD_Send_Byte(0xFF);
+    if ((response & SD_DATA_RESP_MASK) != SD_DATA_RESP_ACCEPTED) {
+        UART3_Write_Text("Data block rejected\n");
+        return 1;
+    }
+
+#if SD_USE_STATS
+    SD_Counters.blocksWritten++;
+#endif
+
+    return 0;
+}
+
+// Write a single 512 byte block with CMD24
+uint8_t SDCard_WriteSingleBlock(uint32_t addr, const uint8_t *buf) {
+    uint8_t result = 1;
+
+    if (SDCard_SendCmd(CMD24, SDCard_BlockAddr(addr), 0xFF) == 0) {
+        result = SDCard_SendData(SD_TOKEN_START_BLOCK, buf);
+
+        // Wait for the card to finish programming
+        if (SDCard_WaitRead()) {
+            result = 1;
+        }
+    }
+
+    SDCard_Release();
+
+    return result;
+}
+
+// Write count 512 byte blocks with a single CMD25 stream
+uint8_t SDCard_WriteMultipleBlock(uint32_t addr, const uint8_t *buf, uint32_t count) {
+    uint8_t result = 0;
+    uint8_t preset = 0;
+
+#if SD_USE_ACMD23
+    // Tell the card how many blocks to pre-erase (SET_WR_BLK_ERASE_COUNT)
+    SDCard_SendCmd(SD_APP | CMD23, count & 0x007FFFFF, 0xFF);
+#endif
+
+#if SD_USE_CMD23
+    // Declare the block count so the stream ends without a stop token
+    if (SDCard_SendCmd(CMD23, count, 0xFF) == 0) {
+        preset = 1;
+    }
+#endif
+
+    if (SDCard_SendCmd(CMD25, SDCard_BlockAddr(addr), 0xFF) != 0) {
+        SDCard_Release();
+        return 1;
+    }
+
+    while (count--) {
+        if (SDCard_SendData(SD_TOKEN_MULTI_WRITE, buf)) {
+            result = 1;
+            break;
+        }
+        buf += 512;
+    }
+
+    // Close the stream with the stop tran token unless CMD23 already did
+    if (!preset || result) {
+        SDCard_WaitRead();
+        SPI_SD_Send_Byte(SD_TOKEN_STOP_TRAN);
+        SPI_SD_Send_Byte(0xFF);
+    }
+
+    // Wait for the card to finish programming
+    if (SDCard_WaitRead()) {
+        result = 1;
+    }
+
+    SDCard_Release();
+
+    return result;
+}
+
+// Stream count 512 byte blocks with a single CMD18 and one CMD12 stop
+uint8_t SDCard_ReadMultipleBlock(uint32_t addr, uint8_t *buf, uint32_t count) {
+    uint8_t result = 0;
+
+    if (SDCard_SendCmd(CMD18, SDCard_BlockAddr(addr), 0xFF) != 0) {
+        SDCard_Release();
+        return 1;
+    }
+
+    while (count--) {
+        if (SDCard_RecvData(buf, 512)) {
+            result = 1;
+            break;
+        }
+        buf += 512;
+    }
+
+    // Stop transmission, then wait out the R1b busy
+    SDCard_SendCmd(CMD12, 0, 0xFF);
+    if (SD_WaitReady()) {
+        result = 1;
+    }
+
+    SDCard_Release();
+
+    return result;
+}
+
+// True once the open write stream has been held for SD_WRITE_DEADLINE_MS
+static uint8_t SDCard_WriteExpired(void) {
+    return (uint32_t)(SysTick_Millis() - SD_WriteStart) >= SD_WRITE_DEADLINE_MS;
+}
+
+// True once the current asynchronous wait has lasted ms
+static uint8_t SDCard_WaitExpired(uint16_t ms) {
+    return (uint32_t)(SysTick_Millis() - SD_WaitTick) >= ms;
+}
+
+// Clock up to SD_POLL_BYTES bytes, 1 once the card releases MISO (0xFF)
+static uint8_t SDCard_PollIdle(void) {
+    for (uint8_t i = 0; i < SD_POLL_BYTES; i++) {
+        if (SPI_SD_Send_Byte(0xFF) == 0xFF) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// Clock up to SD_POLL_BYTES bytes, return the first one that is not 0xFF
+static uint8_t SDCard_PollToken(void) {
+    uint8_t token = 0xFF;
+
+    for (uint8_t i = 0; i < SD_POLL_BYTES && token == 0xFF; i++) {
+        token = SPI_SD_Send_Byte(0xFF);
+    }
+    return token;
+}
+
+#if SD_USE_DMA
+// DMAC completion, runs in the DMAC interrupt
+static void SDCard_DmaDone(uint8_t status) {
+    SD_DmaStatus = status;
+}
+#endif
+
+// Start moving one data block for the asynchronous path (rx or tx is NULL)
+static uint8_t SDCard_DataStart(uint8_t *rx, const uint8_t *tx) {
+#if SD_USE_DMA
+#if SD_USE_CRC
+    DMA_CRC_Begin(rx ? DMA_CH_SPI_RX : DMA_CH_SPI_TX);
+#endif
+    SD_DmaStatus = DMA_OK;
+    return DMA_SPI_Start(rx, tx, 512, SDCard_DmaDone);
+#else
+    // Without the DMAC the block moves here and the data state finds it done
+    if (rx) {
+        SPI_ReadBlock(rx, 512);
+    } else {
+        SPI_WriteBlock(tx, 512);
+    }
+    return 0;
+#endif
+}
+
+// Finish the block started by SDCard_DataStart, 1 on a bus error
+static uint8_t SDCard_DataEnd(const uint8_t *buf, uint16_t *crc) {
+#if SD_USE_DMA
+#if SD_USE_CRC
+    *crc = DMA_CRC_End();
+#endif
+    (void)buf;
+    (void)crc;
+    return (SD_DmaStatus != DMA_OK);
+#else
+#if SD_USE_CRC
+    *crc = CRC16_Calc(buf, 512);
+#endif
+    (void)buf;
+    (void)crc;
+    return 0;
+#endif
+}
+
+// Abandon the request: close whatever stream is open, then report an error
+static void SDCard_Fail(char *msg) {
+    UART3_Write_Text(msg);
+    SD_ReqFailed = 1;
+    SD_ReqKind = SD_REQ_STOP;
+    SD_State = SD_ST_ROUTE;
+}
+
+// Queue a request for SDCard_Poll(), 1 if one is already in progress
+static uint8_t SDCard_Submit(uint8_t kind, uint32_t addr, uint8_t *buf, uint32_t count) {
+    if (SD_State != SD_ST_IDLE) {
+        return 1;
+    }
+
+    SD_ReqKind = kind;
+    SD_ReqAddr = addr;
+    SD_ReqBuf = buf;
+    SD_ReqCount = count;
+    SD_ReqFailed = 0;
+    SD_Result = SD_ASYNC_BUSY;
+    SD_State = SD_ST_ROUTE;
+    return 0;
+}
+
+// Start reading count blocks, continuing the open CMD18 stream when addr follows on
+uint8_t SDCard_SubmitRead(uint32_t addr, uint8_t *buf, uint32_t count) {
+    return SDCard_Submit(SD_REQ_READ, addr, buf, count);
+}
+
+// Start writing count blocks, continuing the open CMD25 stream when addr follows on
+uint8_t SDCard_SubmitWrite(uint32_t addr, const uint8_t *buf, uint32_t count) {
+    return SDCard_Submit(SD_REQ_WRITE, addr, (uint8_t *)buf, count);
+}
+
+// Advance the request as far as the card allows without waiting
+uint8_t SDCard_Poll(void) {
+    uint8_t token;
+    uint16_t crc = 0;
+
+    for (;;) {
+        switch (SD_State) {
+        case SD_ST_IDLE:
+            return SD_Result;
+
+        case SD_ST_ROUTE:
+            // All blocks moved, the stream stays open for the next request
+            if (SD_ReqKind != SD_REQ_STOP && SD_ReqCount == 0) {
+                SD_State = SD_ST_IDLE;
+                SD_Result = SD_ASYNC_DONE;
+                break;
+            }
+
+            // Close a stream this request cannot continue
+            if (SD_ReadOpen && (SD_ReqKind != SD_REQ_READ || SD_ReqAddr != SD_ReadNext
+                                || SDCard_StreamExpired())) {
+                SD_ReadOpen = 0;
+                SDCard_SendCmd(CMD12, 0, 0xFF);
+                SD_WaitTick = SysTick_Millis();
+                SD_State = SD_ST_STOP_READ;
+                break;
+            }
+            if (SD_WriteOpen && (SD_ReqKind != SD_REQ_WRITE || SD_ReqAddr != SD_WriteNext
+                                 || SDCard_StreamExpired() || SDCard_WriteExpired())) {
+                SD_WriteOpen = 0;
+                SD_WaitTick = SysTick_Millis();
+                SD_State = SD_ST_STOP_WRITE;
+                break;
+            }
+
+            if (SD_ReqKind == SD_REQ_STOP) {
+                SD_State = SD_ST_IDLE;
+                SD_Result = SD_ReqFailed ? SD_ASYNC_ERROR : SD_ASYNC_DONE;
+                break;
+            }
+
+            SD_WaitTick = SysTick_Millis();
+            if (SD_ReqKind == SD_REQ_READ) {
+                SD_State = SD_ReadOpen ? SD_ST_RX_TOKEN : SD_ST_OPEN;
+            } else {
+                SD_State = SD_WriteOpen ? SD_ST_TX_READY : SD_ST_OPEN;
+            }
+            break;
+
+        case SD_ST_STOP_READ:
+            // Wait out the R1b busy of CMD12
+            if (!SDCard_PollIdle()) {
+                if (!SDCard_WaitExpired(SD_READ_TIMEOUT_MS)) {
+                    return SD_ASYNC_BUSY;
+                }
+                UART3_Write_Text("Ready wait timeout\n");
+                SD_ReqFailed = 1;
+                SD_ReqKind = SD_REQ_STOP;
+            }
+            SDCard_Release();
+            SD_State = SD_ST_ROUTE;
+            break;
+
+        case SD_ST_STOP_WRITE:
+            // The card may still be programming the last block
+            if (!SDCard_PollIdle()) {
+                if (!SDCard_WaitExpired(SD_WRITE_TIMEOUT_MS)) {
+                    return SD_ASYNC_BUSY;
+                }
+                // The last block never finished, give up on the stop token
+                UART3_Write_Text("Write busy timeout\n");
+                SD_ReqFailed = 1;
+                SD_ReqKind = SD_REQ_STOP;
+                SDCard_Release();
+                SD_State = SD_ST_ROUTE;
+                break;
+            }
+            SPI_SD_Send_Byte(SD_TOKEN_STOP_TRAN);
+            SPI_SD_Send_Byte(0xFF);
+            SD_State = SD_ST_STOP_BUSY;
+            break;
+
+        case SD_ST_STOP_BUSY:
+            // Wait for the card to finish programming, on the same deadline
+            // as the wait before the stop token
+            if (!SDCard_PollIdle()) {
+                if (!SDCard_WaitExpired(SD_WRITE_TIMEOUT_MS)) {
+                    return SD_ASYNC_BUSY;
+                }
+                UART3_Write_Text("Write stop timeout\n");
+                SD_ReqFailed = 1;
+                SD_ReqKind = SD_REQ_STOP;
+            }
+            SDCard_Release();
+            SD_State = SD_ST_ROUTE;
+            break;
+
+        case SD_ST_OPEN:
+            if (SD_ReqKind == SD_REQ_READ) {
+                if (SDCard_SendCmd(CMD18, SDCard_BlockAddr(SD_ReqAddr), 0xFF) != 0) {
+                    SDCard_Release();
+                    SDCard_Fail("Read command rejected\n");
+                    break;
+                }
+                SD_ReadOpen = 1;
+                SD_ReadNext = SD_ReqAddr;
+                SD_State = SD_ST_RX_TOKEN;
+            } else {
+#if SD_USE_ACMD23
+                // Pre-erase hint, never more than this stream is certain to write
+                if (SD_ReqCount > 1) {
+                    SDCard_SendCmd(SD_APP | CMD23, SD_ReqCount & 0x007FFFFF, 0xFF);
+                }
+#endif
+                if (SDCard_SendCmd(CMD25, SDCard_BlockAddr(SD_ReqAddr), 0xFF) != 0) {
+                    SDCard_Release();
+                    SDCard_Fail("Write command rejected\n");
+                    break;
+                }
+                SD_WriteOpen = 1;
+                SD_WriteNext = SD_ReqAddr;
+                SD_WriteStart = SysTick_Millis();
+                SD_State = SD_ST_TX_READY;
+            }
+            SD_WaitTick = SysTick_Millis();
+            break;
+
+        case SD_ST_RX_TOKEN:
+            // The card stays selected between blocks, holding the next one
+            token = SDCard_PollToken();
+            if (token == 0xFF) {
+                if (!SDCard_WaitExpired(SD_READ_TIMEOUT_MS)) {
+                    return SD_ASYNC_BUSY;
+                }
+                SDCard_Fail("Data token timeout\n");
+                break;
+            }
+            if (token != SD_TOKEN_START_BLOCK || SDCard_DataStart(SD_ReqBuf, 0)) {
+                SDCard_Fail("Data token error\n");
+                break;
+            }
+            SD_State = SD_ST_RX_DATA;
+            break;
+
+        case SD_ST_RX_DATA:
+#if SD_USE_DMA
+            if (DMA_SPI_Busy()) {
+                return SD_ASYNC_BUSY;
+            }
+#endif
+            if (SDCard_DataEnd(SD_ReqBuf, &crc)) {
+                SDCard_Fail("Data transfer error\n");
+                break;
+            }
+#if SD_USE_CRC
+            // Compare against the CRC16 sent by the card
+            token = SPI_SD_Read_Byte();
+            if ((((uint16_t)token << 8) | SPI_SD_Read_Byte()) != crc) {
+#if SD_USE_STATS
+                SD_Counters.crcErrors++;
+#endif
+                SDCard_Fail("Data CRC error\n");
+                break;
+            }
+#else
+            // Discard the CRC16
+            SPI_FillBlock(0xFF, 2);
+#endif
+#if SD_USE_STATS
+            SD_Counters.blocksRead++;
+#endif
+            SD_ReqBuf += 512;
+            SD_ReadNext++;
+            SD_LastTick = SysTick_Millis();
+            SD_WaitTick = SD_LastTick;
+            SD_State = --SD_ReqCount ? SD_ST_RX_TOKEN : SD_ST_ROUTE;
+            break;
+
+        case SD_ST_TX_READY:
+            // Busy from the last block is waited out before the next one is sent
+            if (!SDCard_PollIdle()) {
+                if (!SDCard_WaitExpired(SD_WRITE_TIMEOUT_MS)) {
+                    return SD_ASYNC_BUSY;
+                }
+                SDCard_Fail("Write busy timeout\n");
+                break;
+            }
+            SPI_SD_Send_Byte(SD_TOKEN_MULTI_WRITE);
+            if (SDCard_DataStart(0, SD_ReqBuf)) {
+                SDCard_Fail("Data transfer error\n");
+                break;
+            }
+            SD_State = SD_ST_TX_DATA;
+            break;
+
+        case SD_ST_TX_DATA:
+#if SD_USE_DMA
+            if (DMA_SPI_Busy()) {
+                return SD_ASYNC_BUSY;
+            }
+#endif
+            if (SDCard_DataEnd(SD_ReqBuf, &crc)) {
+                SDCard_Fail("Data transfer error\n");
+                break;
+            }
+#if SD_USE_CRC
+            SPI_SD_Send_Byte((uint8_t)(crc >> 8));
+            SPI_SD_Send_Byte((uint8_t)crc);
+#else
+            // Dummy CRC16, the card ignores it while CRC checking is off
+            SPI_FillBlock(0xFF, 2);
+#endif
+            token = SPI_SD_Send_Byte(0xFF);
+            if ((token & SD_DATA_RESP_MASK) != SD_DATA_RESP_ACCEPTED) {
+                SDCard_Fail("Data block rejected\n");
+                break;
+            }
+#if SD_USE_STATS
+            SD_Counters.blocksWritten++;
+#endif
+            SD_ReqBuf += 512;
+            SD_WriteNext++;
+            SD_LastTick = SysTick_Millis();
+            SD_WaitTick = SD_LastTick;
+            SD_State = --SD_ReqCount ? SD_ST_TX_READY : SD_ST_ROUTE;
+            break;
+
+        default:
+            SD_State = SD_ST_IDLE;
+            SD_Result = SD_ASYNC_ERROR;
+            break;
+        }
+    }
+}
+
+#if SD_USE_BUSY_SLEEP
+// Sleep until the selected card releases MISO or the next SysTick
+static void SDCard_SleepBusy(void) {
+    SPI_MISO_WakeArm();
+
+    // WFI still wakes on a pending interrupt while PRIMASK is set
+    __disable_irq();
+    if (!SPI_MISO_WakeFired()) {
+        __WFI();
+    }
+    __enable_irq();
+
+    SPI_MISO_WakeRelease();
+}
+
+// Sleep until the request can move on: MISO released after a write, the
+// DMAC finished, or the next SysTick, which also enforces the timeouts
+static void SDCard_Sleep(void) {
+    if (SD_State == SD_ST_TX_READY || SD_State == SD_ST_STOP_WRITE
+        || SD_State == SD_ST_STOP_BUSY) {
+        SDCard_SleepBusy();
+    } else if (SD_State == SD_ST_RX_DATA || SD_State == SD_ST_TX_DATA) {
+        // WFI still wakes on a pending interrupt while PRIMASK is set
+        __disable_irq();
+        if (DMA_SPI_Busy()) {
+            __WFI();
+        }
+        __enable_irq();
+    }
+    // Waiting for a data token needs clocks, keep polling
+}
+#endif
+
+// Run the current request to completion
+static uint8_t SDCard_Wait(void) {
+    uint8_t result;
+
+    while ((result = SDCard_Poll()) == SD_ASYNC_BUSY) {
+#if SD_USE_BUSY_SLEEP
+        SDCard_Sleep();
+#endif
+    }
+    return result;
+}
+
+// Read count blocks, blocking wrapper around SDCard_SubmitRead()
+uint8_t SDCard_ReadStream(uint32_t addr, uint8_t *buf, uint32_t count) {
+    SDCard_Wait();
+    SDCard_SubmitRead(addr, buf, count);
+    return SDCard_Wait();
+}
+
+// Write count blocks, blocking wrapper around SDCard_SubmitWrite()
+uint8_t SDCard_WriteStream(uint32_t addr, const uint8_t *buf, uint32_t count) {
+    SDCard_Wait();
+    SDCard_SubmitWrite(addr, buf, count);
+    return SDCard_Wait();
+}
+
+// Close any open-ended transfer
+uint8_t SDCard_StopTransfer(void) {
+    SDCard_Wait();
+    SDCard_Submit(SD_REQ_STOP, 0, 0, 0);
+    return SDCard_Wait();
+}
+
+// Make card the target of the following calls, closing the previous card's streams first
+uint8_t SDCard_Use(uint8_t card) {
+    uint8_t result = 0;
+
+    if (card >= SD_CARDS) {
+        return 1;
+    }
+    if (SD_Card != &SD_Slots[card]) {
+        result = SDCard_StopTransfer();
+        SD_Card = &SD_Slots[card];
+    }
+    return result;
+}
+
+// Advance a pending request and close streams that have gone idle, call from the main loop
+void SDCard_Service(void) {
+    if (SD_State != SD_ST_IDLE) {
+        SDCard_Poll();
+    } else if (((SD_ReadOpen || SD_WriteOpen) && SDCard_StreamExpired())
+               || (SD_WriteOpen && SDCard_WriteExpired())) {
+        SDCard_Submit(SD_REQ_STOP, 0, 0, 0);
+        SDCard_Poll();
+    }
+}
+
+// Erase count units of au sectors from start with CMD32/CMD33/CMD38
+static uint8_t SDCard_EraseUnits(uint32_t start, uint32_t count, uint32_t au) {
+    const uint8_t *status = SD_Card->info.sdStatus;
+    uint16_t eraseSize = ((uint16_t)status[11] << 8) | status[12];
+    uint32_t timeout, tick;
+    uint8_t result = 1;
+
+    // ERASE_SIZE units take ERASE_TIMEOUT s, plus ERASE_OFFSET s, when the card reports them
+    if (eraseSize && (status[13] >> 2)) {
+        timeout = ((count + eraseSize - 1) / eraseSize * (status[13] >> 2) + (status[13] & 3)) * 1000UL;
+    } else {
+        timeout = count * SD_ERASE_TIMEOUT_MS;
+    }
+
+    // CMD32, CMD33, CMD38 and the CMD13 check run under one select
+    if (SDCard_SendCmd(CMD32, SDCard_BlockAddr(start), 0xFF) != 0
+        || SDCard_SendCmd(CMD33, SDCard_BlockAddr(start + count * au - 1), 0xFF) != 0) {
+        UART3_Write_Text("Erase range rejected\n");
+        SDCard_Release();
+        return 1;
+    }
+
+    // CMD38 answers with R1b, the card holds MISO low until the erase is done
+    if (SDCard_SendCmd(CMD38, 0, 0xFF) == 0) {
+        tick = SysTick_Millis();
+        result = 0;
+        while (SPI_SD_Send_Byte(0xFF) != 0xFF) {
+            if ((uint32_t)(SysTick_Millis() - tick) >= timeout) {
+                UART3_Write_Text("Erase timeout\n");
+                result = 1;
+                break;
+            }
+#if SD_USE_BUSY_SLEEP
+            SDCard_SleepBusy();
+#endif
+        }
+    }
+
+    // Write protected or out of range units are skipped without an R1 error, ask CMD13 (R2)
+    if (result == 0 && (SDCard_SendCmd(CMD13, 0, 0xFF) != 0 || SPI_SD_Read_Byte() != 0)) {
+        UART3_Write_Text("Erase failed\n");
+        result = 1;
+    }
+
+    SDCard_Release();
+
+    return result;
+}
+
+// Erase the whole allocation units inside sectors start..end (inclusive). Partial
+// units at either end are left alone, erasing them would only make the card copy.
+uint8_t SDCard_Erase(uint32_t start, uint32_t end) {
+    uint32_t au = SD_Card->info.auSectors ? SD_Card->info.auSectors : 1;
+    uint32_t units, n;
+
+    // Erase needs command class 5
+    if (end < start || end >= SD_Card->info.sectors || !(SD_Card->info.csd[4] & 0x02)) {
+        return 1;
+    }
+
+    start = (start + au - 1) / au;
+    units = (end + 1) / au;
+    if (units <= start) {
+        return 0;   // No whole unit in the range
+    }
+    units -= start;
+    start *= au;
+
+    // Split long ranges so each CMD38 busy stays within a sane timeout
+    while (units) {
+        n = (units > SD_ERASE_MAX_UNITS) ? SD_ERASE_MAX_UNITS : units;
+        if (SDCard_EraseUnits(start, n, au)) {
+            return 1;
+        }
+        start += n * au;
+        units -= n;
+    }
+
+    return 0;
+}
+
+// Command and block counters since the last SDCard_ClearStats()
+const SD_Stats *SDCard_GetStats(void) {
+    return &SD_Counters;
+}
+
+void SDCard_ClearStats(void) {
+    memset(&SD_Counters, 0, sizeof(SD_Counters));
+}
+
+// AU_SIZE code to sectors: 16 KB doubling up to 4 MB (SD 2.0), then
+// 8, 12, 16, 24, 32 and 64 MB (SD 3.0); code 0 is not defined
+static const uint32_t SD_AuSectors[16] = {
+    0, 32, 64, 128, 256, 512, 1024, 2048,
+    4096, 8192, 16384, 24576, 32768, 49152, 65536, 131072
+};
+
+// Fill the card info from its registers, 1 if the CSD could not be read
+static uint8_t SDCard_ReadInfo(void) {
+    const uint8_t *csd = SD_Card->info.csd;
+    uint8_t n;
+
+    if (SDCard_Command(CMD10, 0, 0xFF, SD_RESP_DATA, SD_Card->info.cid, 16)) {
+        UART3_Write_Text("Error reading CID\n");
+    }
+    if (SDCard_Command(SD_APP | CMD51, 0, 0xFF, SD_RESP_DATA, SD_Card->info.scr, 8)) {
+        UART3_Write_Text("Error reading SCR\n");
+    }
+    if (SDCard_Command(SD_APP | CMD13, 0, 0xFF, SD_RESP_DATA, SD_Card->info.sdStatus, 64) == 0) {
+        // AU_SIZE is a table code, SPEED_CLASS 0..4 is class 0, 2, 4, 6, 10
+        n = SD_Card->info.sdStatus[10] >> 4;
+        if (n) {
+            SD_Card->info.auSectors = SD_AuSectors[n];
+        }
+        n = SD_Card->info.sdStatus[8];
+        SD_Card->info.speedClass = (n == 4) ? 10 : (n < 4) ? (uint8_t)(n * 2) : 0;
+    } else {
+        UART3_Write_Text("Error reading SD status\n");
+    }
+
+    if (SDCard_Command(CMD9, 0, 0xFF, SD_RESP_DATA, SD_Card->info.csd, 16)) {
+        return 1;
+    }
+
+    if ((csd[0] >> 6) == 1) {
+        // CSD 2.0: C_SIZE is 22 bits in units of 512 KB
+        SD_Card->info.sectors = ((((uint32_t)(csd[7] & 0x3F) << 16) | ((uint32_t)csd[8] << 8) | csd[9]) + 1) << 10;
+    } else {
+        // CSD 1.0: (C_SIZE + 1) << (C_SIZE_MULT + 2) blocks of READ_BL_LEN bytes
+        n = (csd[5] & 15) + ((csd[10] & 128) >> 7) + ((csd[9] & 3) << 1) + 2;
+        SD_Card->info.sectors = ((csd[8] >> 6) + ((uint32_t)csd[7] << 2) + ((uint32_t)(csd[6] & 3) << 10) + 1) << (n - 9);
+    }
+
+    // No AU size reported, fall back to the CSD erase sector size
+    if (SD_Card->info.auSectors == 0) {
+        SD_Card->info.auSectors = (((csd[10] & 63) << 1) + ((uint32_t)(csd[11] & 128) >> 7) + 1) << ((csd[13] >> 6) - 1);
+    }
+
+    return 0;
+}
+
+#if SD_USE_HIGH_SPEED
+// Switch to High-Speed timing with CMD6 when the card supports it, 1 if it stays at default speed
+static uint8_t SDCard_HighSpeed(void) {
+    uint8_t *status = dataBuffer;
+
+    // CMD6 needs SD 1.10 or later (SCR) and command class 10 (CSD)
+    if ((SD_Card->info.scr[0] & 0x0F) < 1 || !(SD_Card->info.csd[4] & 0x40)) {
+        return 1;
+    }
+
+    // Check mode: is function 1 (High-Speed) of group 1 supported
+    if (SDCard_Command(CMD6, SD_SWITCH_CHECK | SD_SWITCH_HIGH_SPEED, 0xFF, SD_RESP_DATA, status, 64)
+        || !(status[13] & 0x02)) {
+        return 1;
+    }
+
+    // Switch mode: the status reports the function the card now runs
+    if (SDCard_Command(CMD6, SD_SWITCH_SET | SD_SWITCH_HIGH_SPEED, 0xFF, SD_RESP_DATA, status, 64)
+        || (status[16] & 0x0F) != 1) {
+        UART3_Write_Text("High-Speed switch failed\n");
+        return 1;
+    }
+
+    SD_Card->info.highSpeed = 1;
+    UART3_Write_Text("Card: High-Speed\n");
+    return 0;
+}
+#endif
+
+// Card registers read by SDCard_Init()
+const SD_CardInfo *SDCard_GetInfo(void) {
+    return &SD_Card->info;
+}
+
+#if SD_USE_TRAINING
+// Rate found by SDCard_TrainClock(), kept in flash for the card it was found on
+typedef struct {
+    uint32_t magic;
+    uint8_t  cid[16];
+    uint8_t  baud;
+    uint8_t  pad[3];
+} SD_TrainRecord;
+
+#define SD_TRAIN_MAGIC  0x53445452  // "SDTR"
+
+// Read the training sector count times at the current rate, 1 on any bad read
+static uint8_t SDCard_ProbeClock(uint16_t count, uint16_t crc) {
+    while (count--) {
+        if (SDCard_ReadSingleBlock(SD_TRAIN_SECTOR, dataBuffer)
+            || CRC16_Calc(dataBuffer, 512) != crc) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// Settle on the fastest SCK the card reads back reliably, reusing the stored rate for a known card
+uint8_t SDCard_TrainClock(void) {
+    SD_TrainRecord recs[SD_CARDS];
+    SD_TrainRecord *rec = &recs[SD_Card - SD_Slots];
+    uint16_t crc;
+    uint8_t baud;
+
+    // Reference copy at the default rate, every probe must match it
+    SDCard_SetBaud(SPI_BAUD(SPI_FAST_HZ));
+    if (SDCard_ReadSingleBlock(SD_TRAIN_SECTOR, dataBuffer)) {
+        return 1;
+    }
+    crc = CRC16_Calc(dataBuffer, 512);
+
+    // One record per slot
+    NVM_ReadStore(recs, sizeof(recs));
+    if (rec->magic == SD_TRAIN_MAGIC && memcmp(rec->cid, SD_Card->info.cid, 16) == 0
+        && rec->baud <= SD_TRAIN_SLOWEST) {
+        SDCard_SetBaud(rec->baud);
+        if (SDCard_ProbeClock(SD_TRAIN_READS, crc) == 0) {
+            return 0;
+        }
+    }
+
+    // Fastest first; a rate must pass a quick screen and then the soak
+    for (baud = 0; baud <= SD_TRAIN_SLOWEST; baud++) {
+        SDCard_SetBaud(baud);
+        if (SDCard_ProbeClock(SD_TRAIN_READS, crc) == 0
+            && SDCard_ProbeClock(SD_TRAIN_SOAK, crc) == 0) {
+            break;
+        }
+    }
+
+    if (baud > SD_TRAIN_SLOWEST) {
+        UART3_Write_Text("Clock training failed\n");
+        SDCard_SetBaud(SPI_BAUD(SPI_FAST_HZ));
+        return 1;
+    }
+
+    baud += SD_TRAIN_MARGIN;
+    if (baud > SD_TRAIN_SLOWEST) {
+        baud = SD_TRAIN_SLOWEST;
+    }
+    SDCard_SetBaud(baud);
+
+    memset(rec, 0, sizeof(*rec));
+    rec->magic = SD_TRAIN_MAGIC;
+    memcpy(rec->cid, SD_Card->info.cid, 16);
+    rec->baud = baud;
+    if (NVM_WriteStore(recs, sizeof(recs))) {
+        UART3_Write_Text("Error saving clock rate\n");
+    }
+
+    return 0;
+}
+#endif
+
 // Initialize the SD card
 uint8_t SDCard_Init(void) {
     uint8_t response;
+    uint8_t r7[4];
     uint16_t retry = 0;
 
+    // Forget any stream, request or registers left from a previous card
+    memset(&SD_Card->info, 0, sizeof(SD_Card->info));
+    SD_ReadOpen = 0;
+    SD_WriteOpen = 0;
+    SD_State = SD_ST_IDLE;
+    SD_Result = SD_ASYNC_DONE;
+
+#if SD_USE_DMA
+    DMA_Initialize();
+#endif
+
+#if SD_USE_BUSY_SLEEP
+    SPI_MISO_WakeInit();
+#endif
+
     // Set to low speed for initialization
     SDCard_InitSpeed();
     delay_ms(100);
 
     // Send initial 80 clock pulses
-    for (uint8_t i = 0; i < 10; i++) {
-        SPI_SD_Send_Byte(0xFF);
-    }
+    SPI_FillBlock(0xFF, 10);
 
     // Try to reset the SD card
     do {
@@ -162,13 +1268,12 @@ uint8_t SDCard_Init(void) {
 
     UART3_Write_Text("Card reset successful\n");
 
-    // Check SD card version with CMD8
-    response = SDCard_WriteCmd(CMD8, 0x1AA, 0x87);
-    if (response == 1) {
+    // Check SD card version with CMD8, a V2 card echoes the voltage range and check pattern
+    response = SDCard_Command(CMD8, 0x1AA, 0x87, SD_RESP_R7, r7, 4);
+    if (response == 1 && (r7[2] & 0x0F) == 0x01 && r7[3] == 0xAA) {
         uint16_t counter = 0xFFFF;
         do {
-            SDCard_WriteCmd(CMD55, 0, 0xFF);
-            response = SDCard_WriteCmd(CMD41, 0x40000000, 0xFF);
+            response = SDCard_Command(SD_APP | CMD41, 0x40000000, 0xFF, SD_RESP_R1, 0, 0);
             counter--;
             if (counter == 0) {
                 UART3_Write_Text("Timeout during initialization\n");
@@ -176,19 +1281,16 @@ uint8_t SDCard_Init(void) {
             }
         } while (response);
 
-        response = SDCard_WriteCmd(CMD58, 0, 0xFF);
+        // The OCR follows R1 in the same transaction
+        response = SDCard_Command(CMD58, 0, 0xFF, SD_RESP_R3, SD_Card->info.ocr, 4);
+
         if (response != 0x00) {
             UART3_Write_Text("Error reading OCR\n");
             return STA_NOINIT;
         }
 
-        // Read OCR register
-        for (uint8_t i = 0; i < 4; i++) {
-            dataBuffer[i] = SPI_SD_Read_Byte();
-        }
-
-        SD_Type = (dataBuffer[0] & 0x40) ? SD_TYPE_V2HC : SD_TYPE_V2;
-        UART3_Write_Text(SD_Type == SD_TYPE_V2HC ? "Card: V2.0 SDHC\n" : "Card Type: V2.0\n");
+        SD_Card->info.type = (SD_Card->info.ocr[0] & 0x40) ? SD_TYPE_V2HC : SD_TYPE_V2;
+        UART3_Write_Text(SD_Card->info.type == SD_TYPE_V2HC ? "Card: V2.0 SDHC\n" : "Card Type: V2.0\n");
     } else {
         UART3_Write_Text("Unsupported SD card type\n");
         return STA_NOINIT;
@@ -199,12 +1301,33 @@ uint8_t SDCard_Init(void) {
         UART3_Write_Text("Error setting block length\n");
     }
 
+#if SD_USE_CRC
+    // Have the card check command and data CRCs
+    if (SDCard_WriteCmd(CMD59, 1, 0xFF) != 0) {
+        UART3_Write_Text("Error enabling CRC\n");
+    }
+#endif
+
     UART3_Write_Text("Initialization complete\n");
 
     // Switch to high speed for normal operation
     SDCard_RunSpeed();
     SDCard_SS(1);
 
+    // Keep the card registers so later queries need no commands
+    if (SDCard_ReadInfo()) {
+        UART3_Write_Text("Error reading CSD\n");
+    }
+
+#if SD_USE_HIGH_SPEED
+    // Before training, so the rate is found with the timing the card will run
+    SDCard_HighSpeed();
+#endif
+
+#if SD_USE_TRAINING
+    SDCard_TrainClock();
+#endif
+
     return 0; // Success
 }
 
@@ -36,20 +36,105 @@
 // SD Card instruction commands
 #define CMD0  0x40 // Use SPI interface
 #define CMD1  0x41 // Use SPI interface
+#define CMD6  0x46 // Check or switch card function (High-Speed)
 #define CMD8  0x48 // Get SD card version
 #define CMD9  0x49 // Get Card Specific Data
+#define CMD10 0x4A // Get Card Identification
 #define CMD12 0x4C // Stop data transmission in Multiple Read Operation
-#define CMD13 0x4D // Send status register
+#define CMD13 0x4D // Send status register (ACMD13: SD status)
 #define CMD16 0x50 // Set SD card block size to 512Byte.
 #define CMD17 0x51 // For reading the SD card send to this
 #define CMD18 0x52 // Transfer data blocks from Card to HOST
-#define CMD23 0x57 // Write Sector
+#define CMD23 0x57 // Set block count (ACMD23: pre-erase block count)
 #define CMD24 0x58 // For writing to the SD card send to this
 #define CMD25 0x59 // For writing to the SD card send to this
+#define CMD32 0x60 // Set the first block to erase (ERASE_WR_BLK_START)
+#define CMD33 0x61 // Set the last block to erase (ERASE_WR_BLK_END)
+#define CMD38 0x66 // Erase the selected blocks
 #define CMD41 0x69 // Activate SD card
+#define CMD51 0x73 // ACMD51: Read SD Configuration Register
 #define CMD55 0x77 // Define next command in specific command
 #define CMD58 0x7A // Reads OCR data
 #define CMD59 0x7B // Turn CRC ON or OFF
+#define SD_APP 0x80 // OR into a command to send it as an ACMD (CMD55 first, same transaction)
+
+// SDCard_Command() response formats
+#define SD_RESP_R1      0 // R1 only
+#define SD_RESP_R1B     1 // R1, then the card holds MISO low while busy
+#define SD_RESP_R2      2 // R1 and one status byte (CMD13)
+#define SD_RESP_R3      3 // R1 and the 4 byte OCR (CMD58)
+#define SD_RESP_R7      4 // R1 and the 4 byte interface condition (CMD8)
+#define SD_RESP_DATA    5 // R1 and a data packet of len bytes (CMD6, CMD9, CMD10, CMD17, ACMD13, ACMD51)
+
+// Multiple block write options
+#define SD_USE_ACMD23   1 // Send ACMD23 so the card can pre-erase before CMD25
+#define SD_USE_CMD23    0 // Send CMD23 block count (only if the SCR reports CMD23 support)
+
+// Data block transfer options
+#define SD_USE_DMA      1 // Move data blocks with the DMAC instead of polled SPI
+#define SD_USE_CRC      1 // Enable CMD59 and check the CRC16 of every data block
+
+// Open-ended transfer options
+#define SD_STREAM_IDLE_MS     20   // Close an idle CMD18/CMD25 stream after this many ms
+#define SD_WRITE_DEADLINE_MS  1000 // Close a CMD25 stream held open this long
+
+// Asynchronous request options
+#define SD_POLL_BYTES         8    // Bytes clocked per SDCard_Poll() while the card is busy
+#define SD_READ_TIMEOUT_MS    100  // Longest wait for a data token or CMD12 busy
+#define SD_WRITE_TIMEOUT_MS   500  // Longest wait for the card to finish programming
+#ifndef SD_USE_BUSY_SLEEP
+#define SD_USE_BUSY_SLEEP     1    // Blocking calls sleep through write busy, woken by MISO (PA19) on the EIC
+#endif
+
+// SDCard_Poll() results
+#define SD_ASYNC_DONE   0 // Request finished (also returned while idle)
+#define SD_ASYNC_ERROR  1 // Request failed, open streams have been closed
+#define SD_ASYNC_BUSY   2 // Request still in progress
+
+// Bus speed options
+#ifndef SD_USE_HIGH_SPEED
+#define SD_USE_HIGH_SPEED 1  // Switch to High-Speed timing with CMD6 when the card supports it
+#endif
+
+// SCK training options
+#define SD_USE_TRAINING   1  // Probe SCK rates after init and keep the fastest reliable one in flash
+#define SD_TRAIN_SECTOR   0  // Sector read back at every rate
+#define SD_TRAIN_SLOWEST  5  // Slowest SPI BAUD value tried (4 MHz)
+#define SD_TRAIN_READS    4  // CRC-checked reads a rate must pass to be considered
+#define SD_TRAIN_SOAK     32 // Further reads the chosen rate must pass
+#define SD_TRAIN_MARGIN   0  // BAUD steps to back off from the fastest passing rate
+
+// Erase options
+#define SD_ERASE_TIMEOUT_MS 250 // Erase busy allowed per unit when the SD status gives no erase timing
+#define SD_ERASE_MAX_UNITS  64  // Largest number of allocation units erased by one CMD38
+
+// Card slots on SERCOM1, each behind its own chip select
+#define SD_CARDS        2                       // Number of card slots
+#define SD_CS_PINS      { PORT_PA08, PORT_PA09 } // Chip select of each slot
+
+// Driver statistics
+#define SD_USE_STATS    1 // Count commands and blocks in SD_Stats
+
+typedef struct {
+    uint32_t cmd[64];       // Commands issued, indexed by command number
+    uint32_t blocksRead;    // Data blocks received
+    uint32_t blocksWritten; // Data blocks accepted by the card
+    uint32_t crcErrors;     // Data blocks received with a bad CRC16
+} SD_Stats;
+
+// Card registers read once by SDCard_Init()
+typedef struct {
+    uint8_t  type;          // SD_TYPE_*
+    uint8_t  ocr[4];        // Operation conditions (CMD58)
+    uint8_t  csd[16];       // Card specific data (CMD9)
+    uint8_t  cid[16];       // Card identification (CMD10)
+    uint8_t  scr[8];        // SD configuration (ACMD51)
+    uint8_t  sdStatus[64];  // SD status (ACMD13)
+    uint32_t sectors;       // Capacity in 512 byte sectors, 0 if the CSD was not read
+    uint32_t auSectors;     // Allocation unit (erase block) in sectors
+    uint8_t  speedClass;    // Speed class 0, 2, 4, 6 or 10
+    uint8_t  highSpeed;     // 1 once CMD6 switched the card to High-Speed timing
+} SD_CardInfo;
 
 /**
  * \def SDCard_Init
@@ -59,6 +144,14 @@
 uint8_t SDCard_Init(void);
 
 
+/**
+ * \def SDCard_Use
+ * \brief Selects the card slot the other SDCard_ calls act on, closing any
+ *        stream left open on the previous card. SDCard_Init() each slot once.
+ * \param uint8_t card
+ */
+uint8_t SDCard_Use(uint8_t card);
+
 /**
  * \def SDCard_WriteCmd
  * \brief writes a command to the SD Card
@@ -66,6 +159,14 @@ uint8_t SDCard_Init(void);
  */
 uint8_t SDCard_WriteCmd( uint8_t cmd, uint32_t arg, uint8_t crc );
 
+/**
+ * \def SDCard_Command
+ * \brief runs one command as a single transaction, CS held until the whole
+ *        response (resp, payload into buf) is read. Returns R1, 0xFF on a failed payload
+ * \param  uint8_t cmd, uint32_t arg, uint8_t crc, uint8_t resp, uint8_t *buf, uint16_t len
+ */
+uint8_t SDCard_Command(uint8_t cmd, uint32_t arg, uint8_t crc, uint8_t resp, uint8_t *buf, uint16_t len);
+
 /**
  * \def SDCard_SS
  * \brief  slave select SD card
@@ -90,24 +191,103 @@ uint8_t SDCard_ReadSingleBlock(uint32_t addr,uint8_t *buf);
 
 /**
  * \def  SDCard_WriteMultipleBlock
- * \brief  Writes multiple blocks of data to the SD Card
- * \param  uint32_t addr,uint8_t *buf,uint8_t count
+ * \brief  Writes count blocks of data to the SD Card with one CMD25
+ * \param  uint32_t addr,uint8_t *buf,uint32_t count
  */
-uint8_t SDCard_WriteMultipleBlock(uint32_t addr, const uint8_t *buf, uint8_t count);
+uint8_t SDCard_WriteMultipleBlock(uint32_t addr, const uint8_t *buf, uint32_t count);
 
 
 /**
- * \def  SDCard_WriteMultipleBlock
- * \brief  Reads multiple blocks of data from the SD Card
- * \param  uint32_t addr,uint8_t *buf,uint8_t count
+ * \def  SDCard_ReadMultipleBlock
+ * \brief  Reads count blocks of data from the SD Card with one CMD18
+ * \param  uint32_t addr,uint8_t *buf,uint32_t count
+ */
+uint8_t SDCard_ReadMultipleBlock(uint32_t addr,uint8_t *buf,uint32_t count);
+
+/**
+ * \def  SDCard_ReadStream
+ * \brief  Reads count blocks, keeping CMD18 open for the next sequential call
+ * \param  uint32_t addr,uint8_t *buf,uint32_t count
+ */
+uint8_t SDCard_ReadStream(uint32_t addr, uint8_t *buf, uint32_t count);
+
+/**
+ * \def  SDCard_WriteStream
+ * \brief  Writes count blocks, keeping CMD25 open for the next sequential call
+ * \param  uint32_t addr,const uint8_t *buf,uint32_t count
+ */
+uint8_t SDCard_WriteStream(uint32_t addr, const uint8_t *buf, uint32_t count);
+
+/**
+ * \def  SDCard_Erase
+ * \brief  Erases the whole allocation units inside sectors start..end (inclusive)
+ * \param  uint32_t start,uint32_t end
+ */
+uint8_t SDCard_Erase(uint32_t start, uint32_t end);
+
+/**
+ * \def  SDCard_SubmitRead
+ * \brief  Starts reading count blocks without waiting, 1 if a request is in progress
+ * \param  uint32_t addr,uint8_t *buf,uint32_t count
+ */
+uint8_t SDCard_SubmitRead(uint32_t addr, uint8_t *buf, uint32_t count);
+
+/**
+ * \def  SDCard_SubmitWrite
+ * \brief  Starts writing count blocks without waiting, 1 if a request is in progress
+ * \param  uint32_t addr,const uint8_t *buf,uint32_t count
+ */
+uint8_t SDCard_SubmitWrite(uint32_t addr, const uint8_t *buf, uint32_t count);
+
+/**
+ * \def  SDCard_Poll
+ * \brief  Advances the submitted request, returns SD_ASYNC_BUSY until it completes.
+ *         buf must stay valid until then. Finish the request before any other
+ *         SDCard_ call; requests bypass the disk cache layers.
+ * \param  none
+ */
+uint8_t SDCard_Poll(void);
+
+/**
+ * \def  SDCard_StopTransfer
+ * \brief  Closes any open-ended transfer
+ * \param  none
+ */
+uint8_t SDCard_StopTransfer(void);
+
+/**
+ * \def  SDCard_Service
+ * \brief  Advances a submitted request and closes idle transfers, call from the main loop
+ * \param  none
+ */
+void SDCard_Service(void);
+
+/**
+ * \def  SDCard_GetStats
+ * \brief  Returns the command and block counters
+ * \param  none
+ */
+const SD_Stats *SDCard_GetStats(void);
+
+/**
+ * \def  SDCard_ClearStats
+ * \brief  Resets the command and block counters
+ * \param  none
+ */
+void SDCard_ClearStats(void);
+
+/**
+ * \def  SDCard_TrainClock
+ * \brief  Picks the fastest SCK rate that reads back reliably, stored per card in flash
+ * \param  none
  */
-uint8_t SDCard_ReadMultipleBlock(uint32_t addr,uint8_t *buf,uint8_t count);
+uint8_t SDCard_TrainClock(void);
 
 /**
- * \def  SDCard_CardID
- * \brief  SD Card Card Identification routines
- * \param  uint8_t cmd, uint8_t *buf
+ * \def  SDCard_GetInfo
+ * \brief  Returns the card registers and geometry read by SDCard_Init()
+ * \param  none
  */
-uint8_t SDCard_CardID(uint8_t cmd, uint8_t *buf);
+const SD_CardInfo *SDCard_GetInfo(void);
 
 #endif /* SD_H_ */